@@ -2328,7 +2328,8 @@ config() {
 
         linux)
 
-            SCDU_CFLAGS+=" -D SCDU_OS_LINUX"
+            SCDU_CFLAGS+=" -D SCDU_OS_LINUX -pthread"
+            SCDU_LFLAGS+=" -pthread"
 
             add_path SCDU_PATH "/usr/local/bin"
 
@@ -2502,8 +2503,10 @@ config() {
     # libs
     ############################################################################
 
-    SCDU_LIBS="$SCDU_ALG_LIB_RPATH"
-    SCDU_LIBS+=" $SCDU_FFS_LIB_RPATH"
+    # each library must precede those it uses (see build.txt)
+
+    SCDU_LIBS="$SCDU_FFS_LIB_RPATH"
+    SCDU_LIBS+=" $SCDU_ALG_LIB_RPATH"
     SCDU_LIBS+=" $SCDU_COR_LIB_RPATH"
 
     ############################################################################
@@ -0,0 +1,176 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+
+#include "../core/core.h"
+
+#include "hash.h"
+
+// 64-bit variant of Yann Collet's xxHash algorithm (BSD licensed)
+// digests are identical to the reference XXH64() implementation
+
+static const Uint64 P1 = U64(11400714785074694791);
+static const Uint64 P2 = U64(14029467366897019727);
+static const Uint64 P3 = U64(1609587929392839161);
+static const Uint64 P4 = U64(9650029242287828579);
+static const Uint64 P5 = U64(2870177450012600261);
+
+static inline Uint64 rotl(Uint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline Uint64 read64(const Uint8* p)
+{
+    Uint64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline Uint32 read32(const Uint8* p)
+{
+    Uint32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline Uint64 step(Uint64 acc, Uint64 lane)
+{
+    acc += lane * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+}
+
+static inline Uint64 merge(Uint64 acc, Uint64 val)
+{
+    acc ^= step(0, val);
+    return acc * P1 + P4;
+}
+
+static Uint64 finish(Uint64 h, const Uint8* p, Size len)
+{
+    while ( len >= 8 )
+    {
+        h ^= step(0, read64(p));
+        h = rotl(h, 27) * P1 + P4;
+        p += 8;
+        len -= 8;
+    }
+
+    if ( len >= 4 )
+    {
+        h ^= (Uint64) read32(p) * P1;
+        h = rotl(h, 23) * P2 + P3;
+        p += 4;
+        len -= 4;
+    }
+
+    while ( len > 0 )
+    {
+        h ^= (*p) * P5;
+        h = rotl(h, 11) * P1;
+        p++;
+        len--;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+Hash64::Hash64(Uint64 seed)
+{
+    mSeed = seed;
+    reset();
+}
+
+void Hash64::reset()
+{
+    mAcc[0] = mSeed + P1 + P2;
+    mAcc[1] = mSeed + P2;
+    mAcc[2] = mSeed;
+    mAcc[3] = mSeed - P1;
+    mTotal = 0;
+    mBufLen = 0;
+}
+
+void Hash64::add(const void* data, Size len)
+{
+    const Uint8* p = (const Uint8*) data;
+    const Uint8* e = p + len;
+    Size n;
+
+    mTotal += len;
+
+    if ( mBufLen > 0 )
+    {
+        n = HASH_STRIPE - mBufLen;
+        if ( n > len ) n = len;
+
+        memcpy(mBuf + mBufLen, p, n);
+        mBufLen += n;
+        p += n;
+
+        if ( mBufLen < HASH_STRIPE ) return;
+
+        mAcc[0] = step(mAcc[0], read64(mBuf));
+        mAcc[1] = step(mAcc[1], read64(mBuf + 8));
+        mAcc[2] = step(mAcc[2], read64(mBuf + 16));
+        mAcc[3] = step(mAcc[3], read64(mBuf + 24));
+        mBufLen = 0;
+    }
+
+    // bulk of the data is consumed here in whole stripes
+
+    while ( e - p >= (ptrdiff_t) HASH_STRIPE )
+    {
+        mAcc[0] = step(mAcc[0], read64(p));
+        mAcc[1] = step(mAcc[1], read64(p + 8));
+        mAcc[2] = step(mAcc[2], read64(p + 16));
+        mAcc[3] = step(mAcc[3], read64(p + 24));
+        p += HASH_STRIPE;
+    }
+
+    if ( p < e )
+    {
+        mBufLen = e - p;
+        memcpy(mBuf, p, mBufLen);
+    }
+}
+
+Uint64 Hash64::value() const
+{
+    Uint64 h;
+
+    if ( mTotal >= HASH_STRIPE )
+    {
+        h = rotl(mAcc[0], 1) + rotl(mAcc[1], 7) + rotl(mAcc[2], 12) + rotl(mAcc[3], 18);
+        h = merge(h, mAcc[0]);
+        h = merge(h, mAcc[1]);
+        h = merge(h, mAcc[2]);
+        h = merge(h, mAcc[3]);
+    }
+    else
+    {
+        h = mSeed + P5;
+    }
+
+    h += mTotal;
+
+    return finish(h, mBuf, mBufLen);
+}
+
+Uint64 hash64(const void* data, Size len, Uint64 seed)
+{
+    Hash64 h(seed);
+
+    h.add(data, len);
+    return h.value();
+}
+
+// EOF
@@ -0,0 +1,30 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined HASH_H
+
+    #define HASH_H
+
+    const Size HASH_STRIPE = 32;
+
+    class Hash64
+    {
+    public:
+        Hash64(Uint64 seed = 0);
+        void reset();
+        void add(const void* data, Size len);
+        Uint64 value() const;
+
+    private:
+        Uint64  mSeed;
+        Uint64  mAcc[4];
+        Uint64  mTotal;
+        Uint8   mBuf[HASH_STRIPE];
+        Size    mBufLen;
+    };
+
+    extern Uint64 hash64(const void* data, Size len, Uint64 seed = 0);
+
+#endif // HASH_H
+
+// EOF
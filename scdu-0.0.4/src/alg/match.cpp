@@ -1,42 +1,703 @@
 // Copyright 2015-2016 RVJ Callanan.
 // Released under the GNU General Public License (Version 3).
 
+#include <string.h>
+
 #include "../core/core.h"
+#include "hash.h"
+
+#include "match.h"
+
+// A Pattern splits a glob at each '*' into runs which are matched in turn:
+// the first is anchored at the start of the string, the last at the end and
+// any others are found left to right in between (taking the first place a
+// run fits never rules out a match since each star can absorb anything).
+// The length of the string is checked against the shortest possible match
+// and then the tail is compared first, so a name which fails on its length
+// or extension is rejected before any scanning. A pattern with no wildcards
+// is a plain comparison.
+//
+// Here as in the interpreted matchers, '?' matches any character but '.'.
+
+static inline char fold(char c);
+static bool matchCS(const char* pat, const char* str, const char* end);
+static bool matchCI(const char* pat, const char* str, const char* end);
+
+Pattern::Pattern()
+{
+    mPat = 0;
+    mSegCount = 0;
+    mMin = 0;
+    mCaseless = false;
+    mLiteral = false;
+    mGeneral = false;
+}
+
+void Pattern::compile(const char* pat, bool caseless)
+{
+    Size i;
+
+    mPat = pat;
+    mCaseless = caseless;
+    mSegCount = 1;
+    mMin = 0;
+    mLiteral = true;
+    mGeneral = false;
+
+    mSegs[0].at = 0;
+    mSegs[0].len = 0;
+    mSegs[0].wild = false;
+
+    for ( i = 0; pat[i] != 0; i++ )
+    {
+        if ( pat[i] == '*' )
+        {
+            mLiteral = false;
+
+            if ( mSegCount == PATTERN_SEGS_MAX )
+            {
+                mGeneral = true;
+                return;
+            }
+
+            Seg& seg = mSegs[mSegCount++];
+
+            seg.at = i + 1;
+            seg.len = 0;
+            seg.wild = false;
+            continue;
+        }
+
+        Seg& seg = mSegs[mSegCount - 1];
+
+        if ( pat[i] == '?' )
+        {
+            seg.wild = true;
+            mLiteral = false;
+        }
+
+        seg.len++;
+        mMin++;
+    }
+}
+
+bool Pattern::isCompiled() const
+{
+    return (mPat != 0);
+}
+
+bool Pattern::isMatch(const char* str) const
+{
+    return isMatch(str, strlen(str));
+}
+
+bool Pattern::isMatch(StrView str) const
+{
+    return isMatch(str.cb(), str.len());
+}
+
+// str need not be terminated at len, so names may be matched in place.
+
+bool Pattern::isMatch(const char* str, Size len) const
+{
+    const char* p;
+    const char* end;
+
+    ASSERT(isCompiled());
+
+    if ( mGeneral ) return mCaseless ? matchCI(mPat, str, str + len) : matchCS(mPat, str, str + len);
+
+    if ( mSegCount == 1 )
+    {
+        if ( len != mMin ) return false;
+
+        if ( mLiteral && !mCaseless ) return memcmp(str, mPat, len) == 0;
+
+        return isSegAt(str, mSegs[0]);
+    }
+
+    if ( len < mMin ) return false;
+
+    const Seg& first = mSegs[0];
+    const Seg& last = mSegs[mSegCount - 1];
+
+    p = str + first.len;
+    end = str + len - last.len;
+
+    if ( !isSegAt(end, last) ) return false;
+    if ( !isSegAt(str, first) ) return false;
+
+    for ( Size k = 1; k < mSegCount - 1; k++ )
+    {
+        const Seg& seg = mSegs[k];
+
+        if ( seg.len == 0 ) continue;
+
+        p = findSeg(p, end, seg);
+        if ( p == 0 ) return false;
+
+        p += seg.len;
+    }
+
+    return true;
+}
+
+bool Pattern::isSegAt(const char* s, const Seg& seg) const
+{
+    const char* q = mPat + seg.at;
+
+    if ( !seg.wild ) return mCaseless ? caseCmp(s, q, seg.len) == 0 : memcmp(s, q, seg.len) == 0;
+
+    for ( Size i = 0; i < seg.len; i++ )
+    {
+        if ( q[i] == '?' )
+        {
+            if ( s[i] == '.' ) return false;
+        }
+        else if ( mCaseless ? fold(s[i]) != fold(q[i]) : s[i] != q[i] )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Finds the first place at or after s where seg fits before end.
+
+const char* Pattern::findSeg(const char* s, const char* end, const Seg& seg) const
+{
+    const char* q = mPat + seg.at;
+
+    if ( end - s < (ptrdiff_t) seg.len ) return 0;
+
+    end -= seg.len;
 
-// lookup tables for fast case conversion
+    if ( !seg.wild && !mCaseless )
+    {
+        // skip straight to candidates for the first character
+
+        while ( s <= end )
+        {
+            s = (const char*) memchr(s, q[0], (Size) (end - s) + 1);
+            if ( s == 0 ) return 0;
+            if ( memcmp(s, q, seg.len) == 0 ) return s;
+            s++;
+        }
+
+        return 0;
+    }
+
+    if ( !seg.wild ) return caseFind(s, (Size) (end - s) + seg.len, q, seg.len);
+
+    for ( ; s <= end; s++ )
+    {
+        if ( isSegAt(s, seg) ) return s;
+    }
 
-static const char lower[] =
+    return 0;
+}
+
+// A PatternSet sorts each of its patterns into the cheapest form that will
+// do. Simple patterns reduce to a literal key which is looked up in a hash
+// table from the name being matched:
+//
+//  KEY_EXACT:  name            (no wildcards)
+//  KEY_EXT:    *.ext           (looked up by the extension of the name)
+//  KEY_SUFFIX: *tail           (one lookup per distinct length of tail)
+//  KEY_PREFIX: head*           (one lookup per distinct length of head)
+//
+// All other patterns of up to 64 characters are packed into 64-bit words
+// and run together as one bit-parallel automaton: bit k of a word is set
+// while character k of some pattern has just been matched, so each
+// character of a name costs a shift, an or and two ands per word however
+// many patterns share it. Anything else is matched by a Pattern.
+//
+// With a caseless set, patterns and names are folded up front so that every
+// comparison is exact.
+
+const Uint8 KEY_EXACT = 0;
+const Uint8 KEY_EXT = 1;
+const Uint8 KEY_SUFFIX = 2;
+const Uint8 KEY_PREFIX = 3;
+
+const Size WORD_BITS = 64;
+
+struct PatternKey
 {
-      0,  1,   2,   3,   4,   5,   6,   7,   8,   9,   10,  11,  12,  13,  14,  15,
-     16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
-     32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
-     48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
-     64, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
-    'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',  91,  92,  93,  94,  95,
-     96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,
-    112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127
+    Uint64  hash;
+    Size    at;                         // offset in text
+    Size    len;
+    Uint8   kind;
 };
 
-static const char upper[] =
+struct PatternWord
 {
-     0,   1,   2,   3,   4,   5,   6,   7,   8,   9,   10,  11,  12,  13,  14,  15,
-    16,   17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
-    32,   33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
-    48,   49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
-    64,   65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,
-    80,   81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,
-    96,  'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O',
-    'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 123, 124, 125, 126, 127
+    Uint64  accept[256];                // positions accepting each character
+    Uint64  first;                      // first position of each pattern
+    Uint64  start;                      // first positions entered at start only
+    Uint64  any;                        // first positions entered anywhere
+    Uint64  loop;                       // positions followed by a star
+    Uint64  final;                      // last position of each pattern
+    Size    used;                       // positions allocated
 };
 
-bool isMatchCS(const char* pat, const char* str)
+PatternSet::PatternSet()
+{
+    mText = 0;
+    mTextCap = 0;
+    mPats = 0;
+    mPatCount = 0;
+    mPatCap = 0;
+    mCount = 0;
+    mKeys = 0;
+    mKeyCount = 0;
+    mKeyCap = 0;
+    mSlots = 0;
+    mSlotCap = 0;
+    mPrefixCount = 0;
+    mSuffixCount = 0;
+    mKinds = 0;
+    mWords = 0;
+    mWordCount = 0;
+    mWordCap = 0;
+    mCaseless = false;
+    mAll = false;
+}
+
+PatternSet::~PatternSet()
+{
+    release();
+}
+
+// Compiles a list of patterns separated by PATTERN_SEP. The list is copied
+// so it need not outlive the set.
+
+void PatternSet::compile(const char* list, bool caseless)
+{
+    Size    n, i, j;
+    Size    cap;
+
+    release();
+
+    mCaseless = caseless;
+
+    n = strlen(list);
+    mTextCap = n + 1;
+    memAlloc(&mText, mTextCap);
+    memcpy(mText, list, mTextCap);
+
+    if ( caseless ) caseToUpper(mText, mText, n);
+
+    for ( i = 0; i <= n; i = j + 1 )
+    {
+        for ( j = i; j < n && mText[j] != PATTERN_SEP; j++ ) {}
+
+        mText[j] = 0;
+        if ( j > i ) add(mText + i, j - i);
+    }
+
+    // keys are hashed once all are known, at no more than half load
+
+    if ( mKeyCount != 0 )
+    {
+        for ( cap = 16; cap < 2 * mKeyCount; cap *= 2 ) {}
+
+        mSlotCap = cap;
+        memAlloc(&mSlots, mSlotCap * sizeof(Uint32));
+        memset(mSlots, 0, mSlotCap * sizeof(Uint32));
+
+        for ( Size k = 0; k < mKeyCount; k++ )
+        {
+            i = (Size) mKeys[k].hash & (mSlotCap - 1);
+            while ( mSlots[i] != 0 ) i = (i + 1) & (mSlotCap - 1);
+            mSlots[i] = (Uint32) k + 1;
+        }
+    }
+}
+
+void PatternSet::release()
+{
+    if ( mText != 0 ) memFree(&mText, mTextCap);
+    if ( mPats != 0 ) memFree(&mPats, mPatCap * sizeof(Pattern));
+    if ( mKeys != 0 ) memFree(&mKeys, mKeyCap * sizeof(PatternKey));
+    if ( mSlots != 0 ) memFree(&mSlots, mSlotCap * sizeof(Uint32));
+    if ( mWords != 0 ) memFree(&mWords, mWordCap * sizeof(PatternWord));
+
+    mTextCap = 0;
+    mPatCount = 0;
+    mPatCap = 0;
+    mCount = 0;
+    mKeyCount = 0;
+    mKeyCap = 0;
+    mSlotCap = 0;
+    mPrefixCount = 0;
+    mSuffixCount = 0;
+    mKinds = 0;
+    mWordCount = 0;
+    mWordCap = 0;
+    mAll = false;
+}
+
+bool PatternSet::isCompiled() const
+{
+    return (mText != 0);
+}
+
+Size PatternSet::count() const
+{
+    return mCount;
+}
+
+bool PatternSet::isMatch(StrView str) const
+{
+    return isMatch(str.cb(), str.len());
+}
+
+// As with Pattern, str need not be terminated at len.
+
+bool PatternSet::isMatch(const char* str, Size len) const
+{
+    char        buf[PATTERN_NAME_MAX];
+    const char* s;
+
+    ASSERT(isCompiled());
+
+    if ( mAll ) return true;
+
+    s = str;
+
+    if ( mCaseless )
+    {
+        if ( len > PATTERN_NAME_MAX )
+        {
+            // too long to fold here (hardly arises): try one by one
+
+            for ( const char* p = mText; p < mText + mTextCap - 1; p += strlen(p) + 1 )
+            {
+                Pattern pat;
+
+                if ( *p == 0 ) continue;
+
+                pat.compile(p, true);
+                if ( pat.isMatch(str, len) ) return true;
+            }
+
+            return false;
+        }
+
+        caseToUpper(buf, str, len);
+        s = buf;
+    }
+
+    if ( mKinds & (1 << KEY_EXACT) )
+    {
+        if ( hasKey(KEY_EXACT, s, len) ) return true;
+    }
+
+    if ( mKinds & (1 << KEY_EXT) )
+    {
+        Size i = len;
+
+        while ( i != 0 && s[i - 1] != '.' ) i--;
+
+        if ( i != 0 && hasKey(KEY_EXT, s + i, len - i) ) return true;
+    }
+
+    for ( Size k = 0; k < mSuffixCount; k++ )
+    {
+        Size n = mSuffixLens[k];
+
+        if ( n <= len && hasKey(KEY_SUFFIX, s + len - n, n) ) return true;
+    }
+
+    for ( Size k = 0; k < mPrefixCount; k++ )
+    {
+        Size n = mPrefixLens[k];
+
+        if ( n <= len && hasKey(KEY_PREFIX, s, n) ) return true;
+    }
+
+    if ( mWordCount != 0 && isWordMatch(s, len) ) return true;
+
+    for ( Size k = 0; k < mPatCount; k++ )
+    {
+        if ( mPats[k].isMatch(s, len) ) return true;
+    }
+
+    return false;
+}
+
+void PatternSet::add(char* pat, Size len)
+{
+    Size    lead, trail, stars, cap;
+    bool    query;
+
+    mCount++;
+
+    lead = 0;
+    while ( lead < len && pat[lead] == '*' ) lead++;
+
+    if ( lead == len )
+    {
+        mAll = true;
+        return;
+    }
+
+    trail = 0;
+    while ( pat[len - 1 - trail] == '*' ) trail++;
+
+    stars = 0;
+    query = false;
+
+    for ( Size i = lead; i < len - trail; i++ )
+    {
+        if ( pat[i] == '*' ) stars++;
+        if ( pat[i] == '?' ) query = true;
+    }
+
+    if ( stars == 0 && !query )
+    {
+        const char* lit = pat + lead;
+        Size        n = len - lead - trail;
+
+        if ( lead == 0 && trail == 0 )
+        {
+            addKey(KEY_EXACT, lit, n);
+            return;
+        }
+
+        if ( trail == 0 && lit[0] == '.' && memchr(lit + 1, '.', n - 1) == 0 )
+        {
+            addKey(KEY_EXT, lit + 1, n - 1);
+            return;
+        }
+
+        if ( trail == 0 && addLen(mSuffixLens, mSuffixCount, n) )
+        {
+            addKey(KEY_SUFFIX, lit, n);
+            return;
+        }
+
+        if ( lead == 0 && addLen(mPrefixLens, mPrefixCount, n) )
+        {
+            addKey(KEY_PREFIX, lit, n);
+            return;
+        }
+    }
+
+    if ( addWord(pat, len) ) return;
+
+    if ( mPatCount == mPatCap )
+    {
+        cap = mPatCap == 0 ? 16 : mPatCap * 2;
+
+        if ( mPats == 0 ) memAlloc(&mPats, cap * sizeof(Pattern));
+        else memRealloc(&mPats, cap * sizeof(Pattern), mPatCap * sizeof(Pattern));
+
+        mPatCap = cap;
+    }
+
+    // pattern text is already folded so its case no longer matters
+
+    mPats[mPatCount] = Pattern();
+    mPats[mPatCount++].compile(pat, false);
+}
+
+void PatternSet::addKey(Uint8 kind, const char* s, Size len)
+{
+    Size cap;
+
+    if ( mKeyCount == mKeyCap )
+    {
+        cap = mKeyCap == 0 ? 64 : mKeyCap * 2;
+
+        if ( mKeys == 0 ) memAlloc(&mKeys, cap * sizeof(PatternKey));
+        else memRealloc(&mKeys, cap * sizeof(PatternKey), mKeyCap * sizeof(PatternKey));
+
+        mKeyCap = cap;
+    }
+
+    PatternKey& k = mKeys[mKeyCount++];
+
+    k.hash = hash64(s, len, kind);
+    k.at = (Size) (s - mText);
+    k.len = len;
+    k.kind = kind;
+
+    mKinds |= 1 << kind;
+}
+
+// Notes a prefix or suffix length; false if there are too many already.
+
+bool PatternSet::addLen(Size* lens, Size& count, Size len)
+{
+    for ( Size i = 0; i < count; i++ )
+    {
+        if ( lens[i] == len ) return true;
+    }
+
+    if ( count == PATTERN_LENS_MAX ) return false;
+
+    lens[count++] = len;
+
+    return true;
+}
+
+// Adds a pattern to the automaton; false if it has too many positions.
+
+bool PatternSet::addWord(const char* pat, Size len)
+{
+    Size    n, b, cap;
+    bool    lead;
+
+    n = 0;
+
+    for ( Size i = 0; i < len; i++ )
+    {
+        if ( pat[i] != '*' ) n++;
+    }
+
+    if ( n > WORD_BITS ) return false;
+
+    if ( mWordCount == 0 || mWords[mWordCount - 1].used + n > WORD_BITS )
+    {
+        if ( mWordCount == mWordCap )
+        {
+            cap = mWordCap == 0 ? 4 : mWordCap * 2;
+
+            if ( mWords == 0 ) memAlloc(&mWords, cap * sizeof(PatternWord));
+            else memRealloc(&mWords, cap * sizeof(PatternWord), mWordCap * sizeof(PatternWord));
+
+            mWordCap = cap;
+        }
+
+        memset(&mWords[mWordCount++], 0, sizeof(PatternWord));
+    }
+
+    PatternWord& w = mWords[mWordCount - 1];
+
+    b = w.used;
+    lead = pat[0] == '*';
+
+    w.first |= (Uint64) 1 << b;
+
+    if ( lead ) w.any |= (Uint64) 1 << b;
+    else w.start |= (Uint64) 1 << b;
+
+    for ( Size i = 0; i < len; i++ )
+    {
+        if ( pat[i] == '*' )
+        {
+            // a star keeps the position before it alive (leading stars
+            // are handled by entering the first position anywhere)
+
+            if ( b != w.used ) w.loop |= (Uint64) 1 << (b - 1);
+            continue;
+        }
+
+        if ( pat[i] == '?' )
+        {
+            for ( Size c = 0; c < 256; c++ )
+            {
+                if ( c != '.' ) w.accept[c] |= (Uint64) 1 << b;
+            }
+        }
+        else
+        {
+            w.accept[(Uint8) pat[i]] |= (Uint64) 1 << b;
+        }
+
+        b++;
+    }
+
+    w.final |= (Uint64) 1 << (b - 1);
+    w.used = b;
+
+    return true;
+}
+
+bool PatternSet::hasKey(Uint8 kind, const char* s, Size len) const
+{
+    Uint64  h;
+    Size    i;
+    Uint32  k;
+
+    h = hash64(s, len, kind);
+
+    for ( i = (Size) h & (mSlotCap - 1); (k = mSlots[i]) != 0; i = (i + 1) & (mSlotCap - 1) )
+    {
+        const PatternKey& key = mKeys[k - 1];
+
+        if ( key.hash != h || key.len != len || key.kind != kind ) continue;
+        if ( memcmp(mText + key.at, s, len) == 0 ) return true;
+    }
+
+    return false;
+}
+
+bool PatternSet::isWordMatch(const char* s, Size len) const
+{
+    if ( len == 0 ) return false;
+
+    for ( Size k = 0; k < mWordCount; k++ )
+    {
+        const PatternWord& w = mWords[k];
+
+        Uint64 d = (w.start | w.any) & w.accept[(Uint8) s[0]];
+
+        for ( Size i = 1; i < len; i++ )
+        {
+            // nothing alive and nothing can start: no pattern here matches
+
+            if ( d == 0 && w.any == 0 ) break;
+
+            d = ((((d << 1) & ~w.first) | w.any) & w.accept[(Uint8) s[i]]) | (d & w.loop);
+        }
+
+        if ( d & w.final ) return true;
+    }
+
+    return false;
+}
+
+bool isMatchCS(const char* pat, StrView str)
+{
+    Pattern p;
+
+    p.compile(pat, false);
+
+    return p.isMatch(str);
+}
+
+bool isMatchCI(const char* pat, StrView str)
+{
+    Pattern p;
+
+    p.compile(pat, true);
+
+    return p.isMatch(str);
+}
+
+// Folds ASCII letters to upper case; other characters (including any byte
+// of 128 and over) are unchanged.
+
+static inline char fold(char c)
+{
+    return (Uint8) (c - 'a') < 26 ? (char) (c - 32) : c;
+}
+
+// Interpreted matching for patterns with too many stars to compile.
+// The string ends at end rather than at a terminator.
+
+static bool matchCS(const char* pat, const char* str, const char* end)
 {
     const char* s;
     const char* p;
     bool star = false;
 
 loop:
-    for (s = str, p = pat; *s; ++s, ++p)
+    for (s = str, p = pat; s < end; ++s, ++p)
     {
         switch ( *p )
         {
@@ -63,14 +724,14 @@ star_chk:
     goto loop;
 }
 
-bool isMatchCI(const char* pat, const char* str)
+static bool matchCI(const char* pat, const char* str, const char* end)
 {
     const char* s;
     const char* p;
     bool star = false;
 
 loop:
-    for (s = str, p = pat; *s; ++s, ++p)
+    for (s = str, p = pat; s < end; ++s, ++p)
     {
         switch ( *p )
         {
@@ -83,7 +744,7 @@ loop:
                 if (!*++pat) return true;
                 goto loop;
             default:
-                if (upper[(int)*s] != upper[(int)*p]) goto star_chk;
+                if (fold(*s) != fold(*p)) goto star_chk;
                 break;
         }
     }
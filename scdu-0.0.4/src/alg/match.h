@@ -5,9 +5,92 @@
 
     #define MATCH_H
 
-    extern bool isMatchCS(const char* pat, const char* str);
-    extern bool isMatchCI(const char* pat, const char* str);
+    const Size PATTERN_SEGS_MAX = 16;   // runs between stars (more are interpreted)
+    const Size PATTERN_LENS_MAX = 16;   // distinct prefix or suffix lengths in set
+    const Size PATTERN_NAME_MAX = 1024; // longest name folded by caseless set
+    const char PATTERN_SEP = ';';       // separates patterns in set
 
-#endif // PATTERN_H
+    class Pattern
+    {
+    public:
+        Pattern();
+        void compile(const char* pat, bool caseless);
+        bool isCompiled() const;
+        bool isMatch(const char* str) const;
+        bool isMatch(const char* str, Size len) const;
+        bool isMatch(StrView str) const;
 
-// EOF
\ No newline at end of file
+    private:
+        struct Seg
+        {
+            Size    at;                 // offset in pattern
+            Size    len;
+            bool    wild;               // has '?'
+        };
+
+        bool isSegAt(const char* s, const Seg& seg) const;
+        const char* findSeg(const char* s, const char* end, const Seg& seg) const;
+
+        const char* mPat;               // not copied: must outlive pattern
+        Seg         mSegs[PATTERN_SEGS_MAX];
+        Size        mSegCount;          // runs separated by stars
+        Size        mMin;               // shortest matching string
+        bool        mCaseless;
+        bool        mLiteral;           // no wildcards at all
+        bool        mGeneral;           // too many stars: interpreted
+    };
+
+    struct PatternKey;
+    struct PatternWord;
+
+    class PatternSet
+    {
+    public:
+        PatternSet();
+        ~PatternSet();
+        PatternSet(const PatternSet&) = delete;
+        PatternSet& operator=(const PatternSet&) = delete;
+        void compile(const char* list, bool caseless);
+        void release();
+        bool isCompiled() const;
+        Size count() const;
+        bool isMatch(const char* str, Size len) const;
+        bool isMatch(StrView str) const;
+
+    private:
+        void add(char* pat, Size len);
+        void addKey(Uint8 kind, const char* s, Size len);
+        bool addLen(Size* lens, Size& count, Size len);
+        bool addWord(const char* pat, Size len);
+        bool hasKey(Uint8 kind, const char* s, Size len) const;
+        bool isWordMatch(const char* s, Size len) const;
+
+        char*       mText;              // copy of list, split into patterns
+        Size        mTextCap;
+        Pattern*    mPats;              // patterns matched one by one
+        Size        mPatCount;
+        Size        mPatCap;
+        Size        mCount;             // patterns in set
+        PatternKey* mKeys;              // literal parts of simple patterns
+        Size        mKeyCount;
+        Size        mKeyCap;
+        Uint32*     mSlots;             // open-addressed hash of keys (+1)
+        Size        mSlotCap;
+        Size        mPrefixLens[PATTERN_LENS_MAX];
+        Size        mPrefixCount;
+        Size        mSuffixLens[PATTERN_LENS_MAX];
+        Size        mSuffixCount;
+        Uint32      mKinds;             // kinds of key present
+        PatternWord* mWords;            // combined automaton of other patterns
+        Size        mWordCount;
+        Size        mWordCap;
+        bool        mCaseless;
+        bool        mAll;               // some pattern matches everything
+    };
+
+    extern bool isMatchCS(const char* pat, StrView str);
+    extern bool isMatchCI(const char* pat, StrView str);
+
+#endif // MATCH_H
+
+// EOF
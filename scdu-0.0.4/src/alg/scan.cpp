@@ -0,0 +1,922 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+
+#if defined __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include "../core/core.h"
+
+#include "scan.h"
+
+// Patterns are compiled to a list of items, each a byte and a mask of the
+// bits which must match, split into segments at each '*'. A match is found by
+// a filter on two literal bytes of the first segment (the first and the last)
+// and then verified item by item. With SSE2 the filter tests 16 candidate
+// starts at a time; a pattern with no literal byte to anchor on falls back to
+// verifying every start.
+//
+// Data is fed a buffer at a time. Starts too close to the end of a buffer to
+// be decided are carried over (at most span - 1 bytes) and resolved against
+// the start of the next buffer, so matches which straddle buffers are found
+// without copying whole buffers.
+
+static int hexValue(char c);
+
+Finder::Finder()
+{
+    mItems = 0;
+    mSegCount = 0;
+    mSpan = 0;
+    mFirst = 0;
+    mLast = 0;
+    mAnchored = false;
+    mPos = 0;
+    mCarryLen = 0;
+}
+
+Finder::~Finder()
+{
+}
+
+// Compiles pat which is either text, where '?' matches any byte, or hex
+// digits in pairs, where '?' matches any nibble and white space is ignored.
+// In both, '*' matches a run of up to FIND_GAP_MAX bytes. Returns false if
+// pat is invalid or too long.
+
+bool Finder::compile(const char* pat, bool hex)
+{
+    int h, l;
+
+    mItems = 0;
+    mSegCount = 1;
+    mSegs[0] = 0;
+
+    while ( *pat != 0 )
+    {
+        char c = *pat++;
+
+        if ( c == '*' )
+        {
+            // leading, trailing and repeated stars add nothing
+
+            if ( mItems == mSegs[mSegCount - 1] ) continue;
+            if ( mSegCount > FIND_GAPS_MAX ) return false;
+
+            mSegs[mSegCount++] = mItems;
+            continue;
+        }
+
+        if ( hex && (c == ' ' || c == '\t') ) continue;
+
+        if ( mItems == FIND_ITEMS_MAX ) return false;
+
+        if ( !hex )
+        {
+            mBytes[mItems] = c == '?' ? 0 : (Uint8) c;
+            mMasks[mItems] = c == '?' ? 0 : 0xFF;
+            mItems++;
+            continue;
+        }
+
+        h = hexValue(c);
+        l = *pat == 0 ? -2 : hexValue(*pat++);
+        if ( h == -2 || l == -2 ) return false;
+
+        mMasks[mItems] = (Uint8) ((h < 0 ? 0 : 0xF0) | (l < 0 ? 0 : 0x0F));
+        mBytes[mItems] = (Uint8) (((h < 0 ? 0 : h) << 4) | (l < 0 ? 0 : l));
+        mItems++;
+    }
+
+    if ( mItems == mSegs[mSegCount - 1] ) mSegCount--;
+    if ( mItems == 0 ) return false;
+
+    mSegs[mSegCount] = mItems;
+    mSpan = mItems + (mSegCount - 1) * FIND_GAP_MAX;
+
+    // anchor on the outermost literal bytes of the first segment
+
+    mAnchored = false;
+
+    for ( Size i = 0; i < mSegs[1]; i++ )
+    {
+        if ( mMasks[i] != 0xFF ) continue;
+        if ( !mAnchored ) mFirst = i;
+        mLast = i;
+        mAnchored = true;
+    }
+
+    memset(mReach, 0, sizeof(mReach));
+    reset();
+
+    return true;
+}
+
+bool Finder::isCompiled() const
+{
+    return (mItems != 0);
+}
+
+Size Finder::span() const
+{
+    return mSpan;
+}
+
+// Starts a new stream (offsets are reported from zero).
+
+void Finder::reset()
+{
+    mPos = 0;
+    mCarryLen = 0;
+}
+
+// Searches the next len bytes of the stream; last marks the end of it.
+
+void Finder::feed(const Uint8* data, Size len, bool last, FindHit hit, void* arg)
+{
+    Size k, n, und;
+
+    ASSERT(isCompiled());
+
+    if ( len == 0 && mCarryLen == 0 ) return;
+
+    if ( mCarryLen != 0 )
+    {
+        // enough of data to decide every start carried over
+
+        k = mSpan - 1 < len ? mSpan - 1 : len;
+        if ( k != 0 ) memcpy(mCarry + mCarryLen, data, k);
+        n = mCarryLen + k;
+
+        if ( k == len )
+        {
+            // all of data fits in the carry, some starts may remain open
+
+            und = last ? n : n > mSpan - 1 ? n - (mSpan - 1) : 0;
+            scan(mCarry, n, 0, und, mPos - (Int64) mCarryLen, hit, arg);
+
+            memmove(mCarry, mCarry + und, n - und);
+            mCarryLen = n - und;
+            mPos += (Int64) len;
+            return;
+        }
+
+        scan(mCarry, n, 0, mCarryLen, mPos - (Int64) mCarryLen, hit, arg);
+        mCarryLen = 0;
+    }
+
+    und = last ? len : len > mSpan - 1 ? len - (mSpan - 1) : 0;
+    scan(data, len, 0, und, mPos, hit, arg);
+
+    memcpy(mCarry, data + und, len - und);
+    mCarryLen = len - und;
+    mPos += (Int64) len;
+}
+
+// Reports matches starting at from .. to - 1 in p (with len bytes valid).
+
+void Finder::scan(const Uint8* p, Size len, Size from, Size to, Int64 base, FindHit hit, void* arg)
+{
+    Size s = from;
+
+    if ( !mAnchored )
+    {
+        for ( ; s < to; s++ )
+        {
+            if ( verify(p + s, len - s) ) hit(base + (Int64) s, 0, arg);
+        }
+
+        return;
+    }
+
+    const Uint8 f = mBytes[mFirst];
+    const Uint8 l = mBytes[mLast];
+
+    #if defined __SSE2__
+
+        const __m128i vf = _mm_set1_epi8((char) f);
+        const __m128i vl = _mm_set1_epi8((char) l);
+
+        while ( s + 16 <= to && s + mLast + 16 <= len )
+        {
+            __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + s + mFirst)), vf);
+            __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + s + mLast)), vl);
+            Uint32  m = (Uint32) _mm_movemask_epi8(_mm_and_si128(a, b));
+
+            while ( m != 0 )
+            {
+                Size c = s + (Size) __builtin_ctz(m);
+
+                if ( verify(p + c, len - c) ) hit(base + (Int64) c, 0, arg);
+                m &= m - 1;
+            }
+
+            s += 16;
+        }
+
+    #else
+
+        // memchr() on the first anchor is the portable filter
+
+        while ( s < to && s + mLast < len )
+        {
+            Size c = len - s - mFirst < to - s ? len - s - mFirst : to - s;
+            const Uint8* q = (const Uint8*) memchr(p + s + mFirst, f, c);
+            if ( q == 0 ) return;
+
+            s = (Size) (q - p) - mFirst;
+            if ( s + mLast >= len ) return;
+
+            if ( p[s + mLast] == l && verify(p + s, len - s) ) hit(base + (Int64) s, 0, arg);
+            s++;
+        }
+
+    #endif
+
+    for ( ; s < to && s + mLast < len; s++ )
+    {
+        if ( p[s + mFirst] != f || p[s + mLast] != l ) continue;
+        if ( verify(p + s, len - s) ) hit(base + (Int64) s, 0, arg);
+    }
+}
+
+// Decides whether the pattern matches at p. The first segment is fixed at p;
+// the ends reachable by each later segment are tracked in mReach since the
+// bounded gaps rule out simply taking the first place a segment fits.
+
+bool Finder::verify(const Uint8* p, Size len)
+{
+    Uint8*  cur;
+    Uint8*  nxt;
+    Size    lo, hi, nlo, nhi, a, n, pos, near;
+    bool    seen;
+
+    n = mSegs[1];
+    if ( n > len || !fits(p, 0, n) ) return false;
+    if ( mSegCount == 1 ) return true;
+
+    cur = mReach[0];
+    nxt = mReach[1];
+    cur[n] = 1;
+    lo = n;
+    hi = n;
+
+    for ( Size k = 1; k < mSegCount; k++ )
+    {
+        a = mSegs[k];
+        n = mSegs[k + 1] - a;
+        nlo = 0;
+        nhi = 0;
+        seen = false;
+        near = lo;
+
+        // pos is a candidate if an end in cur lies within a gap before it
+
+        for ( pos = lo; pos <= hi + FIND_GAP_MAX && pos + n <= len; pos++ )
+        {
+            if ( pos <= hi && cur[pos] != 0 )
+            {
+                cur[pos] = 0;
+                near = pos;
+            }
+
+            if ( pos - near > FIND_GAP_MAX || !fits(p + pos, a, n) ) continue;
+
+            if ( k + 1 == mSegCount )
+            {
+                seen = true;
+                break;
+            }
+
+            nxt[pos + n] = 1;
+            if ( !seen ) nlo = pos + n;
+            nhi = pos + n;
+            seen = true;
+        }
+
+        for ( ; pos <= hi; pos++ ) cur[pos] = 0;
+
+        if ( !seen || k + 1 == mSegCount )
+        {
+            for ( pos = nlo; seen && pos <= nhi; pos++ ) nxt[pos] = 0;
+            return seen;
+        }
+
+        Uint8* t = cur;
+        cur = nxt;
+        nxt = t;
+        lo = nlo;
+        hi = nhi;
+    }
+
+    return false;
+}
+
+bool Finder::fits(const Uint8* p, Size item, Size n) const
+{
+    const Uint8* b = mBytes + item;
+    const Uint8* m = mMasks + item;
+
+    for ( Size i = 0; i < n; i++ )
+    {
+        if ( (p[i] & m[i]) != b[i] ) return false;
+    }
+
+    return true;
+}
+
+// A MultiFinder is an Aho-Corasick automaton over literal patterns. The trie
+// is built with sibling lists and then given failure links breadth-first.
+//
+// Where it fits in MULTI_TABLE_MAX, every transition is precomputed into a
+// dense table so that each byte costs one lookup. Bytes which appear in no
+// pattern all behave alike, so the table has a column per class of byte
+// rather than 256, which keeps thousands of patterns over a small alphabet
+// (hex digests, say) dense. Entries hold the target state premultiplied by
+// the row width, with the top bit flagging states at which a pattern ends.
+//
+// Automata too big for that keep just the trie edges, packed per state and
+// probed with memchr(), and follow failure links at run time (the root has a
+// full table since most bytes of typical content lead straight back to it).
+//
+// Either way the automaton state simply persists between calls to feed(), so
+// nothing is ever carried over from one buffer to the next.
+
+const Uint32 MULTI_EMITS = 0x80000000;  // flags transition to emitting state
+const Uint32 MULTI_STATE = 0x7FFFFFFF;
+
+struct MultiNode
+{
+    Uint32  first;                      // first child
+    Uint32  next;                       // next sibling
+    Uint32  fail;                       // longest proper suffix in trie
+    Uint32  out;                        // longest proper suffix ending a pattern
+    Uint32  end;                        // first pattern ending here (+1)
+    Uint8   byte;                       // label of edge from parent
+    bool    emits;                      // end or out is set
+};
+
+MultiFinder::MultiFinder()
+{
+    mNodes = 0;
+    mNodeCount = 0;
+    mNodeCap = 0;
+    mLens = 0;
+    mSame = 0;
+    mPatCount = 0;
+    mPatCap = 0;
+    memset(mRoot, 0, sizeof(mRoot));
+    memset(mClass, 0, sizeof(mClass));
+    mClasses = 0;
+    mDelta = 0;
+    mEdgeStart = 0;
+    mEdgeBytes = 0;
+    mEdgeNodes = 0;
+    mCompiled = false;
+    mState = 0;
+    mPos = 0;
+}
+
+MultiFinder::~MultiFinder()
+{
+    release();
+}
+
+// Adds pat, which is literal text or pairs of hex digits (white space is
+// ignored). Returns false if pat is empty, too long or has wildcards.
+
+bool MultiFinder::add(const char* pat, bool hex)
+{
+    Uint8   bytes[FIND_ITEMS_MAX];
+    Size    n, cap;
+    Uint32  s, c;
+    int     h, l;
+
+    ASSERT(!mCompiled);
+
+    n = 0;
+
+    while ( *pat != 0 )
+    {
+        char k = *pat++;
+
+        if ( hex && (k == ' ' || k == '\t') ) continue;
+        if ( n == FIND_ITEMS_MAX ) return false;
+
+        if ( !hex )
+        {
+            bytes[n++] = (Uint8) k;
+            continue;
+        }
+
+        h = hexValue(k);
+        l = *pat == 0 ? -2 : hexValue(*pat++);
+        if ( h < 0 || l < 0 ) return false;
+
+        bytes[n++] = (Uint8) ((h << 4) | l);
+    }
+
+    if ( n == 0 ) return false;
+
+    if ( mNodes == 0 )
+    {
+        mNodeCap = 1024;
+        memAlloc(&mNodes, mNodeCap * sizeof(MultiNode));
+        memset(mNodes, 0, sizeof(MultiNode));
+        mNodeCount = 1;
+    }
+
+    if ( mPatCount == mPatCap )
+    {
+        cap = mPatCap == 0 ? 256 : mPatCap * 2;
+
+        if ( mLens == 0 ) memAlloc(&mLens, cap * sizeof(Uint32));
+        else memRealloc(&mLens, cap * sizeof(Uint32), mPatCap * sizeof(Uint32));
+
+        if ( mSame == 0 ) memAlloc(&mSame, cap * sizeof(Uint32));
+        else memRealloc(&mSame, cap * sizeof(Uint32), mPatCap * sizeof(Uint32));
+
+        mPatCap = cap;
+    }
+
+    // walk down the trie, growing it as necessary
+
+    s = 0;
+
+    for ( Size i = 0; i < n; i++ )
+    {
+        c = child(s, bytes[i]);
+
+        if ( c == 0 )
+        {
+            if ( mNodeCount == mNodeCap )
+            {
+                cap = mNodeCap * 2;
+                memRealloc(&mNodes, cap * sizeof(MultiNode), mNodeCap * sizeof(MultiNode));
+                mNodeCap = cap;
+            }
+
+            c = (Uint32) mNodeCount++;
+            memset(&mNodes[c], 0, sizeof(MultiNode));
+            mNodes[c].byte = bytes[i];
+
+            if ( s == 0 )
+            {
+                mRoot[bytes[i]] = c;
+            }
+            else
+            {
+                mNodes[c].next = mNodes[s].first;
+                mNodes[s].first = c;
+            }
+        }
+
+        s = c;
+    }
+
+    // patterns with the same bytes are chained in order of addition
+
+    mLens[mPatCount] = (Uint32) n;
+    mSame[mPatCount] = 0;
+
+    if ( mNodes[s].end == 0 )
+    {
+        mNodes[s].end = (Uint32) mPatCount + 1;
+    }
+    else
+    {
+        Uint32 p = mNodes[s].end;
+        while ( mSame[p - 1] != 0 ) p = mSame[p - 1];
+        mSame[p - 1] = (Uint32) mPatCount + 1;
+    }
+
+    mPatCount++;
+
+    return true;
+}
+
+void MultiFinder::compile()
+{
+    Uint32* queue = 0;
+    Size    head, tail, edges;
+    Uint32  s, c, f;
+
+    ASSERT(!mCompiled);
+    ASSERT(mPatCount != 0);
+
+    // failure links breadth-first, so that each state's suffixes are done
+
+    memAlloc(&queue, mNodeCount * sizeof(Uint32));
+    head = 0;
+    tail = 0;
+
+    for ( Size b = 0; b < 256; b++ )
+    {
+        c = mRoot[b];
+        if ( c == 0 ) continue;
+
+        mNodes[c].fail = 0;
+        mNodes[c].out = 0;
+        mNodes[c].emits = mNodes[c].end != 0;
+        queue[tail++] = c;
+    }
+
+    while ( head < tail )
+    {
+        s = queue[head++];
+
+        for ( c = mNodes[s].first; c != 0; c = mNodes[c].next )
+        {
+            f = mNodes[s].fail;
+
+            while ( f != 0 && child(f, mNodes[c].byte) == 0 ) f = mNodes[f].fail;
+
+            f = child(f, mNodes[c].byte);
+
+            mNodes[c].fail = f;
+            mNodes[c].out = mNodes[f].end != 0 ? f : mNodes[f].out;
+            mNodes[c].emits = mNodes[c].end != 0 || mNodes[c].out != 0;
+            queue[tail++] = c;
+        }
+    }
+
+    ASSERT(tail == mNodeCount - 1);
+
+    // class 0 is for bytes in no pattern, the rest have a class each
+
+    mClasses = 1;
+
+    for ( Size i = 1; i < mNodeCount; i++ )
+    {
+        if ( mClass[mNodes[i].byte] == 0 ) mClass[mNodes[i].byte] = (Uint16) mClasses++;
+    }
+
+    if ( mNodeCount <= MULTI_TABLE_MAX / (mClasses * sizeof(Uint32)) )
+    {
+        // each row starts as a copy of the row of the failure state
+
+        Size w = mClasses;
+
+        memAlloc(&mDelta, mNodeCount * w * sizeof(Uint32));
+        memset(mDelta, 0, w * sizeof(Uint32));
+
+        for ( Size b = 0; b < 256; b++ )
+        {
+            if ( mRoot[b] != 0 ) mDelta[mClass[b]] = mRoot[b];
+        }
+
+        for ( Size i = 0; i < tail; i++ )
+        {
+            s = queue[i];
+
+            Uint32* row = mDelta + (Size) s * w;
+
+            memcpy(row, mDelta + (Size) mNodes[s].fail * w, w * sizeof(Uint32));
+
+            for ( c = mNodes[s].first; c != 0; c = mNodes[c].next )
+            {
+                row[mClass[mNodes[c].byte]] = c;
+            }
+        }
+
+        for ( Size i = 0; i < mNodeCount * w; i++ )
+        {
+            c = mDelta[i];
+            mDelta[i] = (Uint32) (c * w) | (mNodes[c].emits ? MULTI_EMITS : 0);
+        }
+    }
+    else
+    {
+        // trie edges packed per state (the root keeps its full table)
+
+        edges = mNodeCount;
+
+        memAlloc(&mEdgeStart, (mNodeCount + 1) * sizeof(Uint32));
+        memAlloc(&mEdgeBytes, edges);
+        memAlloc(&mEdgeNodes, edges * sizeof(Uint32));
+
+        edges = 0;
+
+        for ( s = 0; s < mNodeCount; s++ )
+        {
+            mEdgeStart[s] = (Uint32) edges;
+
+            for ( c = mNodes[s].first; c != 0; c = mNodes[c].next )
+            {
+                mEdgeBytes[edges] = mNodes[c].byte;
+                mEdgeNodes[edges] = c;
+                edges++;
+            }
+        }
+
+        mEdgeStart[mNodeCount] = (Uint32) edges;
+    }
+
+    memFree(&queue, mNodeCount * sizeof(Uint32));
+
+    mCompiled = true;
+    reset();
+}
+
+void MultiFinder::release()
+{
+    if ( mDelta != 0 ) memFree(&mDelta, mNodeCount * mClasses * sizeof(Uint32));
+    if ( mEdgeStart != 0 ) memFree(&mEdgeStart, (mNodeCount + 1) * sizeof(Uint32));
+    if ( mEdgeBytes != 0 ) memFree(&mEdgeBytes, mNodeCount);
+    if ( mEdgeNodes != 0 ) memFree(&mEdgeNodes, mNodeCount * sizeof(Uint32));
+    if ( mNodes != 0 ) memFree(&mNodes, mNodeCap * sizeof(MultiNode));
+    if ( mLens != 0 ) memFree(&mLens, mPatCap * sizeof(Uint32));
+    if ( mSame != 0 ) memFree(&mSame, mPatCap * sizeof(Uint32));
+
+    memset(mRoot, 0, sizeof(mRoot));
+    memset(mClass, 0, sizeof(mClass));
+
+    mClasses = 0;
+    mNodeCount = 0;
+    mNodeCap = 0;
+    mPatCount = 0;
+    mPatCap = 0;
+    mCompiled = false;
+    mState = 0;
+    mPos = 0;
+}
+
+bool MultiFinder::isCompiled() const
+{
+    return mCompiled;
+}
+
+bool MultiFinder::isDense() const
+{
+    return (mDelta != 0);
+}
+
+Size MultiFinder::patterns() const
+{
+    return mPatCount;
+}
+
+Size MultiFinder::states() const
+{
+    return mNodeCount;
+}
+
+// Starts a new stream (offsets are reported from zero).
+
+void MultiFinder::reset()
+{
+    mState = 0;
+    mPos = 0;
+}
+
+// Searches the next len bytes of the stream. Nothing is ever pending at the
+// end of a call, so last is accepted only for symmetry with Finder.
+
+void MultiFinder::feed(const Uint8* data, Size len, bool last, FindHit hit, void* arg)
+{
+    Uint32 s;
+
+    (void) last;
+
+    ASSERT(mCompiled);
+
+    s = mState;
+
+    if ( mDelta != 0 )
+    {
+        // s is the offset of the current row, so each byte costs one add
+        // and one load on the critical path
+
+        const Uint32* d = mDelta;
+        const Uint16* k = mClass;
+
+        for ( Size i = 0; i < len; i++ )
+        {
+            s = d[s + k[data[i]]];
+
+            if ( s & MULTI_EMITS )
+            {
+                s &= MULTI_STATE;
+                emit(s / (Uint32) mClasses, mPos + (Int64) i, hit, arg);
+            }
+        }
+    }
+    else
+    {
+        for ( Size i = 0; i < len; i++ )
+        {
+            s = step(s, data[i]);
+            if ( mNodes[s].emits ) emit(s, mPos + (Int64) i, hit, arg);
+        }
+    }
+
+    mState = s;
+    mPos += (Int64) len;
+}
+
+// Child of s labelled c (0 if none) using the build-time sibling lists.
+
+Uint32 MultiFinder::child(Uint32 s, Uint8 c) const
+{
+    if ( s == 0 ) return mRoot[c];
+
+    for ( Uint32 k = mNodes[s].first; k != 0; k = mNodes[k].next )
+    {
+        if ( mNodes[k].byte == c ) return k;
+    }
+
+    return 0;
+}
+
+// Transition from s on c using packed edges and failure links.
+
+Uint32 MultiFinder::step(Uint32 s, Uint8 c) const
+{
+    while ( s != 0 )
+    {
+        Uint32 a = mEdgeStart[s];
+        Uint32 n = mEdgeStart[s + 1] - a;
+
+        if ( n != 0 )
+        {
+            const Uint8* q = (const Uint8*) memchr(mEdgeBytes + a, c, n);
+            if ( q != 0 ) return mEdgeNodes[a + (Uint32) (q - (mEdgeBytes + a))];
+        }
+
+        s = mNodes[s].fail;
+    }
+
+    return mRoot[c];
+}
+
+// Reports every pattern ending at offset end in state s.
+
+void MultiFinder::emit(Uint32 s, Int64 end, FindHit hit, void* arg) const
+{
+    Uint32 t = mNodes[s].end != 0 ? s : mNodes[s].out;
+
+    for ( ; t != 0; t = mNodes[t].out )
+    {
+        for ( Uint32 p = mNodes[t].end; p != 0; p = mSame[p - 1] )
+        {
+            hit(end + 1 - (Int64) mLens[p - 1], p - 1, arg);
+        }
+    }
+}
+
+// With SSE2 (always present on amd64), 16 bytes are compared at a time and
+// the resulting bit mask is counted with popcount; the exact position of a
+// newline is only resolved within the block where a count runs out. Other
+// targets fall back to memchr() which is usually well optimised anyway.
+
+const Uint8 NEWLINE = '\n';
+
+// Returns the offset just past the count-th newline in data, or len if there
+// are fewer; count is reduced by the number of newlines passed over.
+
+Size skipLines(const Uint8* data, Size len, Size& count)
+{
+    const Uint8*    p = data;
+    const Uint8*    end = data + len;
+
+    if ( count == 0 ) return 0;
+
+    #if defined __SSE2__
+
+        const __m128i nl = _mm_set1_epi8((char) NEWLINE);
+
+        while ( end - p >= 16 )
+        {
+            __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) p), nl);
+            Uint32  m = (Uint32) _mm_movemask_epi8(a);
+            Size    c = (Size) __builtin_popcount(m);
+
+            if ( c >= count )
+            {
+                // drop all but the count-th set bit
+
+                while ( --count != 0 ) m &= m - 1;
+
+                return (Size) (p - data) + (Size) __builtin_ctz(m) + 1;
+            }
+
+            count -= c;
+            p += 16;
+        }
+
+        while ( p < end )
+        {
+            if ( *p++ == NEWLINE && --count == 0 ) return (Size) (p - data);
+        }
+
+    #else
+
+        while ( (p = (const Uint8*) memchr(p, NEWLINE, (Size) (end - p))) != 0 )
+        {
+            p++;
+            if ( --count == 0 ) return (Size) (p - data);
+        }
+
+    #endif
+
+    return len;
+}
+
+// Comparison works 64 bytes at a time with SSE2, combining four compares
+// into one mask so that long runs cost little more than the loads, and then
+// resolves the exact offset within the block. Elsewhere, 8-byte words are
+// compared before single bytes.
+
+// Returns the offset of the first byte which differs between a and b, or
+// len if there is none.
+
+Size skipSame(const Uint8* a, const Uint8* b, Size len)
+{
+    Size i = 0;
+
+    #if defined __SSE2__
+
+        while ( len - i >= 64 )
+        {
+            __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i)), _mm_loadu_si128((const __m128i*) (b + i)));
+            __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i + 16)), _mm_loadu_si128((const __m128i*) (b + i + 16)));
+            __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i + 32)), _mm_loadu_si128((const __m128i*) (b + i + 32)));
+            __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i + 48)), _mm_loadu_si128((const __m128i*) (b + i + 48)));
+
+            if ( _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3))) != 0xFFFF ) break;
+
+            i += 64;
+        }
+
+        while ( len - i >= 16 )
+        {
+            __m128i e = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i)), _mm_loadu_si128((const __m128i*) (b + i)));
+            Uint32  m = (Uint32) _mm_movemask_epi8(e) ^ 0xFFFF;
+
+            if ( m != 0 ) return i + (Size) __builtin_ctz(m);
+
+            i += 16;
+        }
+
+    #else
+
+        while ( len - i >= 8 )
+        {
+            Uint64 x, y;
+
+            memcpy(&x, a + i, 8);
+            memcpy(&y, b + i, 8);
+
+            if ( x != y ) break;
+
+            i += 8;
+        }
+
+    #endif
+
+    while ( i < len && a[i] == b[i] ) i++;
+
+    return i;
+}
+
+// Returns the offset of the first byte which is the same in a and b, or len
+// if there is none.
+
+Size skipDiff(const Uint8* a, const Uint8* b, Size len)
+{
+    Size i = 0;
+
+    #if defined __SSE2__
+
+        while ( len - i >= 16 )
+        {
+            __m128i e = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i)), _mm_loadu_si128((const __m128i*) (b + i)));
+            Uint32  m = (Uint32) _mm_movemask_epi8(e);
+
+            if ( m != 0 ) return i + (Size) __builtin_ctz(m);
+
+            i += 16;
+        }
+
+    #endif
+
+    while ( i < len && a[i] != b[i] ) i++;
+
+    return i;
+}
+
+// Value of hex digit, -1 for a wildcard and -2 otherwise.
+
+static int hexValue(char c)
+{
+    if ( c >= '0' && c <= '9' ) return c - '0';
+    if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    if ( c == '?' ) return -1;
+
+    return -2;
+}
+
+// EOF
@@ -0,0 +1,103 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined SCAN_H
+
+    #define SCAN_H
+
+    const Size FIND_ITEMS_MAX = 256;    // bytes (or wildcards) in pattern
+    const Size FIND_GAPS_MAX = 8;       // '*' wildcards in pattern
+    const Size FIND_GAP_MAX = 256;      // bytes matched by each '*'
+    const Size FIND_SPAN_MAX = FIND_ITEMS_MAX + FIND_GAPS_MAX * FIND_GAP_MAX;
+
+    const Size MULTI_TABLE_MAX = 64 * 1024 * 1024;  // largest dense automaton
+
+    // called for each match with the offset of its start within the stream;
+    // a Finder reports matches in order of start, a MultiFinder in order of
+    // end (and longer patterns first where several end together)
+
+    typedef void (*FindHit)(Int64 offset, Size pattern, void* arg);
+
+    class Finder
+    {
+    public:
+        Finder();
+        ~Finder();
+        Finder(const Finder&) = delete;
+        Finder& operator=(const Finder&) = delete;
+        bool compile(const char* pat, bool hex);
+        bool isCompiled() const;
+        Size span() const;
+        void reset();
+        void feed(const Uint8* data, Size len, bool last, FindHit hit, void* arg);
+
+    private:
+        void scan(const Uint8* p, Size len, Size from, Size to, Int64 base, FindHit hit, void* arg);
+        bool verify(const Uint8* p, Size len);
+        bool fits(const Uint8* p, Size item, Size n) const;
+
+        Uint8       mBytes[FIND_ITEMS_MAX];
+        Uint8       mMasks[FIND_ITEMS_MAX];  // bits which must match (0 = any)
+        Size        mItems;
+        Size        mSegs[FIND_GAPS_MAX + 2];   // first item of each segment
+        Size        mSegCount;
+        Size        mSpan;              // most bytes a match can cover
+        Size        mFirst;             // anchor offsets (first segment)
+        Size        mLast;
+        bool        mAnchored;          // first segment has a literal byte
+        Int64       mPos;               // stream offset of next data fed
+        Size        mCarryLen;
+        Uint8       mCarry[2 * FIND_SPAN_MAX];
+        Uint8       mReach[2][FIND_SPAN_MAX + 1];
+    };
+
+    struct MultiNode;
+
+    class MultiFinder
+    {
+    public:
+        MultiFinder();
+        ~MultiFinder();
+        MultiFinder(const MultiFinder&) = delete;
+        MultiFinder& operator=(const MultiFinder&) = delete;
+        bool add(const char* pat, bool hex);
+        void compile();
+        void release();
+        bool isCompiled() const;
+        bool isDense() const;
+        Size patterns() const;
+        Size states() const;
+        void reset();
+        void feed(const Uint8* data, Size len, bool last, FindHit hit, void* arg);
+
+    private:
+        Uint32 child(Uint32 s, Uint8 c) const;
+        Uint32 step(Uint32 s, Uint8 c) const;
+        void emit(Uint32 s, Int64 end, FindHit hit, void* arg) const;
+
+        MultiNode*  mNodes;             // trie with failure links
+        Size        mNodeCount;
+        Size        mNodeCap;
+        Uint32*     mLens;              // length of each pattern
+        Uint32*     mSame;              // next pattern with same bytes (+1)
+        Size        mPatCount;
+        Size        mPatCap;
+        Uint32      mRoot[256];         // children of root (0 = none)
+        Uint16      mClass[256];        // dense: class of each byte
+        Size        mClasses;
+        Uint32*     mDelta;             // dense: transition for each class
+        Uint32*     mEdgeStart;         // sparse: edges of each state
+        Uint8*      mEdgeBytes;
+        Uint32*     mEdgeNodes;
+        bool        mCompiled;
+        Uint32      mState;             // state after data fed so far
+        Int64       mPos;               // stream offset of next data fed
+    };
+
+    extern Size skipLines(const Uint8* data, Size len, Size& count);
+    extern Size skipSame(const Uint8* a, const Uint8* b, Size len);
+    extern Size skipDiff(const Uint8* a, const Uint8* b, Size len);
+
+#endif // SCAN_H
+
+// EOF
@@ -0,0 +1,167 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+
+#include "../core/core.h"
+#include "../alg/match.h"
+#include "../ffs/walk.h"
+
+#include "bench.h"
+
+// A developer benchmark, built in debug builds only so that it stays out of
+// the product's command set (see ACT_BENCH).
+
+#if defined SCDU_MODE_DEBUG
+
+    // The source is walked first to collect every path below it. Each string
+    // type then builds BENCH_STRS strings in turn from those paths, one at a
+    // time, and the heap allocations made meanwhile are counted from the
+    // allocation profile, which is switched on for the purpose if need be.
+
+    const Size BENCH_STRS = 1000000;        // strings built of each type
+
+    static Arena    text;                   // paths (which never move)
+    static const char** paths = 0;          // each path in text
+    static Size     pathCount = 0;
+    static Size     pathCap = 0;
+    static Size     pathChars = 0;
+
+    static Walker   walker;
+    static Mutex    mutex;                  // guards paths during walk
+    static AllocSite sites[ALLOC_SITES_MAX];
+
+    static bool visit(const WalkEntry& entry, Size worker, void* arg);
+    static Int64 allocations();
+    template <typename T> static void run(const char* name);
+
+    void bench()
+    {
+        FileInfo    info;
+        bool        profiling = allocsProfiling;
+        char        s[FMT_NUM_MAX + 1];
+        char        c[FMT_NUM_MAX + 1];
+        int         w;
+
+        ASSERT(cmd.params.count == 1);
+
+        const char* p = cmd.params[0].cb();
+
+        if ( fileInfo(p, info) < 0 || info.type != ET_DIR ) xer(XE_CMDPRM, p);
+
+        outA("gathering paths");
+
+        walker.configure();
+        walker.setFields(0);
+        walker.walk(p, visit, 0);
+
+        for ( Size i = 0; i < walker.failures(); i++ )
+        {
+            oufW("cannot read: %s", walker.failure(i));
+        }
+
+        if ( pathCount == 0 ) xer(XE_CMD, "no paths found (see recurse option)");
+
+        w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ITEMS, (Int64) pathCount);
+        ASSERT_ALWAYS(w >= 0);
+        w = format(c, FMT_NUM_MAX, FS_AUTO, QN_CHARS, (Int64) ( pathChars / pathCount ));
+        ASSERT_ALWAYS(w >= 0);
+        oufR("paths   : %s (%s on average)", s, c);
+        w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ITEMS, (Int64) BENCH_STRS);
+        ASSERT_ALWAYS(w >= 0);
+        oufR("strings : %s of each type", s);
+
+        outA("building strings");
+
+        if ( !profiling ) allocsProfile(true);
+
+        run<Str>("Str");
+        run<PathStr>("PathStr");
+
+        if ( !profiling ) allocsProfile(false);
+
+        if ( paths != 0 ) memFree(&paths, pathCap * sizeof(const char*));
+
+        pathCount = 0;
+        pathCap = 0;
+        pathChars = 0;
+
+        text.release();
+    }
+
+    static bool visit(const WalkEntry& entry, Size worker, void* arg)
+    {
+        Size cap;
+
+        (void) worker;
+        (void) arg;
+
+        mutex.lock();
+
+        if ( pathCount == pathCap )
+        {
+            cap = pathCap == 0 ? 1024 : pathCap * 2;
+
+            if ( paths == 0 ) memAlloc(&paths, cap * sizeof(const char*));
+            else memRealloc(&paths, cap * sizeof(const char*), pathCap * sizeof(const char*));
+
+            pathCap = cap;
+        }
+
+        paths[pathCount++] = text.strDup(entry.path, entry.len);
+        pathChars += entry.len;
+
+        mutex.unlock();
+
+        return true;
+    }
+
+    // allocations made so far at all sites profiled
+
+    static Int64 allocations()
+    {
+        Size    n;
+        Int64   count = 0;
+
+        n = allocsProfileTop(sites, ALLOC_SITES_MAX);
+
+        for ( Size i = 0; i < n; i++ ) count += sites[i].count;
+
+        return count;
+    }
+
+    // Times include the profiling of each heap allocation, so they overstate
+    // what an allocation costs normally; the counts are exact.
+
+    template <typename T>
+    static void run(const char* name)
+    {
+        Timer       timer;
+        Int64       before;
+        double      secs;
+        char        a[FMT_NUM_MAX + 1];
+        char        t[FMT_NUM_MAX + 1];
+        int         w;
+
+        before = allocations();
+        timer.reset();
+
+        // constructors are not inline (see str.cpp) so none is optimised away
+
+        for ( Size i = 0; i < BENCH_STRS; i++ )
+        {
+            T str(paths[i % pathCount]);
+        }
+
+        secs = timer.read();
+
+        w = format(a, FMT_NUM_MAX, FS_AUTO, QN_ITEMS, allocations() - before);
+        ASSERT_ALWAYS(w >= 0);
+        w = format(t, FMT_NUM_MAX, FS_AUTO, QN_MSECS, (Int64) ( secs * 1000 ));
+        ASSERT_ALWAYS(w >= 0);
+        oufR("%-7s : %s allocated in %s", name, a, t);
+    }
+
+#endif // SCDU_MODE_DEBUG
+
+// EOF
@@ -0,0 +1,14 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined BENCH_H
+
+    #define BENCH_H
+
+    #if defined SCDU_MODE_DEBUG
+        extern void bench();
+    #endif
+
+#endif // BENCH_H
+
+// EOF
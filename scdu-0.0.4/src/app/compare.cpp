@@ -0,0 +1,805 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "../core/core.h"
+#include "../alg/match.h"
+#include "../alg/scan.h"
+#include "../ffs/walk.h"
+
+#include "compare.h"
+
+// Each file is read by a thread of its own into a ring of CMP_SLOTS buffers
+// while the calling thread compares the previous pair of buffers, so both
+// devices are kept busy at once and comparison overlaps with reading. The
+// readers use the platform file calls directly, as the file error state of
+// FileReader is shared by all threads.
+//
+// Files of different sizes cannot be identical so they are reported without
+// reading any content, unless all differing ranges are wanted (--all), in
+// which case the common part is compared and the excess of the longer file
+// is reported as a final range.
+//
+// Two directories are compared as trees. Both are walked at once (the target
+// on a thread of its own) and their entries are sorted by path relative to
+// the root, so that a single merge-join pairs them up. Entries found on one
+// side only, or whose types or sizes differ, are conflicts from metadata
+// alone; content is only compared for files which agree in size but not in
+// modification time, or for all files of the same size with --verify.
+
+const Size CMP_SLOTS = 2;
+
+enum CmpResult
+{
+    CMP_SAME = 0,
+    CMP_DIFF,
+    CMP_SIZE,
+    CMP_FAIL
+};
+
+enum DiffKind
+{
+    DIF_MISSING = 0,                    // in source only
+    DIF_EXTRA,                          // in target only
+    DIF_TYPE,
+    DIF_SIZE,
+    DIF_CONTENT,
+    DIF_CHECK                           // content to be compared
+};
+
+struct TreeRec
+{
+    const char* path;                   // within text of side
+    EntType     type;
+    Int64       size;
+    Int64       mtime;
+};
+
+struct TreeSide
+{
+    Walker      walker;
+    Thread      thread;                 // walks target alongside source
+    const char* root;
+    Size        skip;                   // length of root prefix of paths
+    TreeRec*    recs;
+    Size        recCount;
+    Size        recCap;
+    Arena       text;                   // paths (which never move)
+};
+
+struct TreeDiff
+{
+    Size        a;                      // record in source (or SIZE_VAL_MAX)
+    Size        b;                      // record in target (or SIZE_VAL_MAX)
+    DiffKind    kind;
+};
+
+struct CmpSide
+{
+    Thread      thread;
+    File*       file;
+    const char* path;
+    Int64       left;                   // bytes still to be read
+    Uint8*      bufs[CMP_SLOTS];
+    Size        lens[CMP_SLOTS];
+    bool        full[CMP_SLOTS];        // buffer holds data not yet compared
+    bool        failed;
+};
+
+static CmpSide  sides[2];
+static Size     bufSize = 0;
+static bool     stop = false;           // readers must give up
+static Mutex    mutex;                  // guards buffer states
+static Cond     cond;                   // buffer states changed
+
+static TreeSide trees[2];
+static TreeDiff* diffs = 0;             // conflicts and checks in path order
+static Size     diffCount = 0;
+static Size     diffCap = 0;
+static Mutex    walkMutex;              // guards records during walks
+static const TreeSide* sorting = 0;     // side being sorted by recCmp()
+
+static bool     listAll = false;        // list every differing range
+static Int64    first = -1;             // offset of first difference
+static Int64    ranges = 0;             // differing ranges found
+static Int64    differ = 0;             // bytes in differing ranges
+static Int64    conflicts = 0;
+static Int64    checked = 0;            // files whose content was compared
+static Int64    errors = 0;
+
+static Progress progress;
+
+static void compareTrees(const char* a, const char* b);
+static void walkTarget(void* arg);
+static bool visit(const WalkEntry& entry, Size worker, void* arg);
+static void poll(void* arg);
+static void join();
+static void addDiff(Size a, Size b, DiffKind kind);
+static void conflict(DiffKind kind, const char* rel);
+static int recCmp(const void* a, const void* b);
+static int pathCmp(const char* a, const char* b);
+static bool isUnder(const char* rel, const char* dir);
+static CmpResult compareFiles(const char* a, const char* b, Int64 sizeA, Int64 sizeB);
+static void fill(void* arg);
+static void range(Int64 offset, Int64 len);
+static void report(CmpResult r, Int64 sizeA, Int64 sizeB);
+static void reportTrees();
+
+void compare()
+{
+    FileInfo    infoA;
+    FileInfo    infoB;
+    CmpResult   r = CMP_SAME;
+
+    ASSERT(cmd.params.count == 2);
+
+    const char* a = cmd.params[0].cb();
+    const char* b = cmd.params[1].cb();
+
+    if ( fileInfo(a, infoA) < 0 || ( infoA.type != ET_FILE && infoA.type != ET_DIR ) ) xer(XE_CMDPRM, a);
+    if ( fileInfo(b, infoB) < 0 || ( infoB.type != ET_FILE && infoB.type != ET_DIR ) ) xer(XE_CMDPRM, b);
+
+    if ( infoA.type != infoB.type ) xer(XE_CMD, "cannot compare file with directory");
+
+    outA("comparing");
+
+    bufSize = cmd.options.bufferSize * cmd.env.chunkSize;
+
+    for ( Size s = 0; s < 2; s++ )
+    {
+        for ( Size k = 0; k < CMP_SLOTS; k++ ) bufAlloc(&sides[s].bufs[k], bufSize);
+    }
+
+    progress.unitQty = QN_BYTES;
+    progress.itemQty = QN_FILES;
+    progress.hitsQty = QN_CONFLICTS;
+    progress.hits = 0;
+    progress.snip = a;
+    progress.overall.units.estimate = 0;
+    progress.overall.units.complete = 0;
+    progress.overall.items.estimate = 0;
+    progress.overall.items.complete = 0;
+    progress.current.units.estimate = 0;
+    progress.current.units.complete = 0;
+    progress.status = PS_INIT;
+
+    outP(progress);
+
+    if ( infoA.type == ET_DIR )
+    {
+        compareTrees(a, b);
+    }
+    else
+    {
+        listAll = cmd.options.all;
+
+        progress.hitsQty = QN_RANGES;
+        progress.overall.items.estimate = 2;
+
+        if ( infoA.size == infoB.size || listAll )
+        {
+            progress.overall.units.estimate = 2 * (infoA.size < infoB.size ? infoA.size : infoB.size);
+        }
+
+        r = compareFiles(a, b, infoA.size, infoB.size);
+
+        progress.overall.items.complete = 2;
+        progress.hits = ranges;
+    }
+
+    progress.status = PS_FINAL;
+    outP(progress);
+
+    for ( Size s = 0; s < 2; s++ )
+    {
+        for ( Size k = 0; k < CMP_SLOTS; k++ ) bufFree(&sides[s].bufs[k], bufSize);
+    }
+
+    if ( infoA.type == ET_DIR ) reportTrees();
+    else report(r, infoA.size, infoB.size);
+}
+
+static void compareTrees(const char* a, const char* b)
+{
+    char        pathA[UPATH_MAX + 1];
+    char        pathB[UPATH_MAX + 1];
+    Int64       est;
+    Size        n;
+
+    trees[0].root = a;
+    trees[1].root = b;
+
+    for ( Size s = 0; s < 2; s++ )
+    {
+        TreeSide& t = trees[s];
+
+        // entry paths are the root (less trailing separators) and a separator
+
+        n = strlen(t.root);
+        while ( n > 1 && ( t.root[n-1] == '/' || t.root[n-1] == PATH_SEP ) ) n--;
+
+        t.skip = ( t.root[n-1] == '/' || t.root[n-1] == PATH_SEP ) ? n : n + 1;
+
+        t.walker.configure();
+        t.walker.setFields(FF_SIZE | FF_MTIME);
+    }
+
+    trees[1].thread.start(walkTarget, &trees[1]);
+    trees[0].walker.walk(a, visit, &trees[0], poll);
+    trees[1].thread.join();
+
+    for ( Size s = 0; s < 2; s++ )
+    {
+        for ( Size j = 0; j < trees[s].walker.failures(); j++ )
+        {
+            outP();
+            oufW("cannot read: %s", trees[s].walker.failure(j));
+            errors++;
+        }
+
+        sorting = &trees[s];
+        if ( trees[s].recCount > 1 ) qsort(trees[s].recs, trees[s].recCount, sizeof(TreeRec), recCmp);
+    }
+
+    join();
+
+    // content is compared in path order once metadata has been settled
+
+    est = 0;
+
+    for ( Size i = 0; i < diffCount; i++ )
+    {
+        if ( diffs[i].kind == DIF_CHECK ) est += 2 * trees[0].recs[diffs[i].a].size;
+    }
+
+    progress.overall.units.estimate = est;
+    progress.overall.units.complete = 0;
+    progress.overall.items.estimate = (Int64) diffCount;
+    progress.overall.items.complete = 0;
+    progress.status = PS_NORMAL;
+
+    for ( Size i = 0; i < diffCount; i++ )
+    {
+        TreeDiff& d = diffs[i];
+
+        if ( d.kind == DIF_CHECK )
+        {
+            const TreeRec& ra = trees[0].recs[d.a];
+            const TreeRec& rb = trees[1].recs[d.b];
+
+            strncpyz(pathA, ra.path, UPATH_MAX);
+            strncpyz(pathB, rb.path, UPATH_MAX);
+
+            progress.snip = pathA;
+
+            first = -1;
+            ranges = 0;
+
+            if ( compareFiles(pathA, pathB, ra.size, rb.size) == CMP_DIFF ) d.kind = DIF_CONTENT;
+
+            checked++;
+        }
+
+        if ( d.kind != DIF_CHECK )
+        {
+            const TreeSide& t = d.a != SIZE_VAL_MAX ? trees[0] : trees[1];
+            const TreeRec&  r = t.recs[d.a != SIZE_VAL_MAX ? d.a : d.b];
+
+            conflict(d.kind, r.path + t.skip);
+        }
+
+        progress.overall.items.complete++;
+    }
+
+    for ( Size s = 0; s < 2; s++ )
+    {
+        TreeSide& t = trees[s];
+
+        if ( t.recs != 0 ) memFree(&t.recs, t.recCap * sizeof(TreeRec));
+        t.text.release();
+
+        t.recCount = 0;
+        t.recCap = 0;
+    }
+
+    if ( diffs != 0 ) memFree(&diffs, diffCap * sizeof(TreeDiff));
+
+    diffCount = 0;
+    diffCap = 0;
+}
+
+static void walkTarget(void* arg)
+{
+    TreeSide* t = (TreeSide*) arg;
+
+    // channels are not thread-safe so only the source walk polls
+
+    t->walker.walk(t->root, visit, t, 0);
+}
+
+static bool visit(const WalkEntry& entry, Size worker, void* arg)
+{
+    TreeSide*   t = (TreeSide*) arg;
+    Size        cap;
+
+    (void) worker;
+
+    if ( entry.depth == 0 ) return true;
+
+    walkMutex.lock();
+
+    if ( t->recCount == t->recCap )
+    {
+        cap = t->recCap == 0 ? 1024 : t->recCap * 2;
+
+        if ( t->recs == 0 ) memAlloc(&t->recs, cap * sizeof(TreeRec));
+        else memRealloc(&t->recs, cap * sizeof(TreeRec), t->recCap * sizeof(TreeRec));
+
+        t->recCap = cap;
+    }
+
+    TreeRec& r = t->recs[t->recCount++];
+
+    r.path = t->text.strDup(entry.path, entry.len);
+    r.type = entry.info.type;
+    r.size = entry.info.type == ET_FILE ? entry.info.size : 0;
+    r.mtime = entry.info.mtime;
+
+    progress.overall.items.complete++;
+
+    walkMutex.unlock();
+
+    return true;
+}
+
+static void poll(void* arg)
+{
+    Progress p;
+
+    (void) arg;
+
+    walkMutex.lock();
+    p = progress;
+    walkMutex.unlock();
+
+    outP(p);
+    progress.status = PS_NORMAL;
+}
+
+// Pairs up the sorted entries of both trees. Once a directory is found on
+// one side only (or as a directory on one side only), nothing beneath it is
+// reported since its children follow it directly in the sort order.
+
+static void join()
+{
+    const char* skip[2] = { 0, 0 };     // unmatched directory on each side
+    Size        i, j;
+    int         c;
+
+    TreeSide& ta = trees[0];
+    TreeSide& tb = trees[1];
+
+    i = 0;
+    j = 0;
+
+    while ( i < ta.recCount || j < tb.recCount )
+    {
+        const char* ra = i < ta.recCount ? ta.recs[i].path + ta.skip : 0;
+        const char* rb = j < tb.recCount ? tb.recs[j].path + tb.skip : 0;
+
+        if ( ra == 0 ) c = 1;
+        else if ( rb == 0 ) c = -1;
+        else c = pathCmp(ra, rb);
+
+        if ( c < 0 )
+        {
+            if ( skip[0] == 0 || !isUnder(ra, skip[0]) )
+            {
+                addDiff(i, SIZE_VAL_MAX, DIF_MISSING);
+                if ( ta.recs[i].type == ET_DIR ) skip[0] = ra;
+            }
+
+            i++;
+            continue;
+        }
+
+        if ( c > 0 )
+        {
+            if ( skip[1] == 0 || !isUnder(rb, skip[1]) )
+            {
+                addDiff(SIZE_VAL_MAX, j, DIF_EXTRA);
+                if ( tb.recs[j].type == ET_DIR ) skip[1] = rb;
+            }
+
+            j++;
+            continue;
+        }
+
+        const TreeRec& a = ta.recs[i];
+        const TreeRec& b = tb.recs[j];
+
+        if ( a.type != b.type )
+        {
+            addDiff(i, j, DIF_TYPE);
+            if ( a.type == ET_DIR ) skip[0] = ra;
+            if ( b.type == ET_DIR ) skip[1] = rb;
+        }
+        else if ( a.type == ET_FILE )
+        {
+            if ( a.size != b.size ) addDiff(i, j, DIF_SIZE);
+            else if ( a.mtime != b.mtime || cmd.options.verify ) addDiff(i, j, DIF_CHECK);
+        }
+
+        i++;
+        j++;
+    }
+}
+
+static void addDiff(Size a, Size b, DiffKind kind)
+{
+    Size cap;
+
+    if ( diffCount == diffCap )
+    {
+        cap = diffCap == 0 ? 256 : diffCap * 2;
+
+        if ( diffs == 0 ) memAlloc(&diffs, cap * sizeof(TreeDiff));
+        else memRealloc(&diffs, cap * sizeof(TreeDiff), diffCap * sizeof(TreeDiff));
+
+        diffCap = cap;
+    }
+
+    diffs[diffCount].a = a;
+    diffs[diffCount].b = b;
+    diffs[diffCount].kind = kind;
+    diffCount++;
+}
+
+static void conflict(DiffKind kind, const char* rel)
+{
+    const char* const kinds[] = { "missing", "extra", "type", "size", "content" };
+
+    conflicts++;
+    progress.hits++;
+
+    if ( cmd.options.rawReporting )
+    {
+        oufR("%s %s", kinds[kind], rel);
+    }
+    else
+    {
+        outP();
+        oufR("%-8s %s", kinds[kind], rel);
+    }
+}
+
+static int recCmp(const void* a, const void* b)
+{
+    Size skip = sorting->skip;
+
+    return pathCmp(((const TreeRec*) a)->path + skip, ((const TreeRec*) b)->path + skip);
+}
+
+// Orders paths as strcmp() does except that separators come before any other
+// character, so that the entries beneath a directory directly follow it.
+
+static int pathCmp(const char* a, const char* b)
+{
+    int x, y;
+
+    for ( ;; a++, b++ )
+    {
+        x = (Uint8) *a;
+        y = (Uint8) *b;
+
+        if ( x == '/' || x == PATH_SEP ) x = 1;
+        if ( y == '/' || y == PATH_SEP ) y = 1;
+
+        if ( x != y || x == 0 ) return x - y;
+    }
+}
+
+static bool isUnder(const char* rel, const char* dir)
+{
+    Size n = strlen(dir);
+
+    return strncmp(rel, dir, n) == 0 && ( rel[n] == '/' || rel[n] == PATH_SEP );
+}
+
+// Compares the content of two files, listing differing ranges as they are
+// found (all of them with --all, otherwise just the first).
+
+static CmpResult compareFiles(const char* a, const char* b, Int64 sizeA, Int64 sizeB)
+{
+    Int64   size, pos, start, done;
+    Size    k, i, j, n;
+    bool    inDiff, failed;
+
+    if ( sizeA != sizeB && !listAll ) return CMP_SIZE;
+
+    size = sizeA < sizeB ? sizeA : sizeB;
+
+    sides[0].path = a;
+    sides[1].path = b;
+
+    for ( Size s = 0; s < 2; s++ )
+    {
+        CmpSide& side = sides[s];
+
+        side.file = fileOpen(side.path, "rb");
+        side.left = size;
+        side.failed = false;
+
+        for ( k = 0; k < CMP_SLOTS; k++ ) side.full[k] = false;
+
+        if ( side.file == 0 )
+        {
+            outP();
+            oufW("cannot read: %s", side.path);
+            errors++;
+
+            if ( s == 1 ) fileClose(sides[0].file);
+            return CMP_FAIL;
+        }
+    }
+
+    stop = false;
+
+    sides[0].thread.start(fill, &sides[0]);
+    sides[1].thread.start(fill, &sides[1]);
+
+    done = progress.overall.units.complete;
+
+    progress.current.units.estimate = size;
+    progress.current.units.complete = 0;
+
+    pos = 0;
+    start = 0;
+    inDiff = false;
+    failed = false;
+
+    for ( k = 0; pos < size; k = (k + 1) % CMP_SLOTS )
+    {
+        mutex.lock();
+        while ( !sides[0].full[k] || !sides[1].full[k] ) cond.wait(mutex);
+        mutex.unlock();
+
+        if ( sides[0].failed || sides[1].failed )
+        {
+            failed = true;
+            break;
+        }
+
+        const Uint8* p = sides[0].bufs[k];
+        const Uint8* q = sides[1].bufs[k];
+
+        n = sides[0].lens[k];
+        ASSERT(n == sides[1].lens[k]);
+
+        // alternate between runs of equal and differing bytes
+
+        for ( i = 0; i < n; i = j )
+        {
+            if ( !inDiff )
+            {
+                j = i + skipSame(p + i, q + i, n - i);
+                if ( j == n ) break;
+
+                start = pos + (Int64) j;
+                inDiff = true;
+
+                if ( !listAll ) break;
+            }
+            else
+            {
+                j = i + skipDiff(p + i, q + i, n - i);
+                if ( j == n ) break;
+
+                range(start, pos + (Int64) j - start);
+                inDiff = false;
+            }
+        }
+
+        pos += (Int64) n;
+
+        mutex.lock();
+        sides[0].full[k] = false;
+        sides[1].full[k] = false;
+        cond.broadcast();
+        mutex.unlock();
+
+        progress.current.units.complete = pos;
+        progress.overall.units.complete = done + 2 * pos;
+        outP(progress);
+        progress.status = PS_NORMAL;
+
+        if ( inDiff && !listAll ) break;
+    }
+
+    // readers may be waiting for buffers which will never be compared
+
+    mutex.lock();
+    stop = true;
+    cond.broadcast();
+    mutex.unlock();
+
+    sides[0].thread.join();
+    sides[1].thread.join();
+
+    fileClose(sides[0].file);
+    fileClose(sides[1].file);
+
+    if ( failed )
+    {
+        for ( Size s = 0; s < 2; s++ )
+        {
+            if ( !sides[s].failed ) continue;
+
+            outP();
+            oufW("cannot read: %s", sides[s].path);
+            errors++;
+        }
+
+        return CMP_FAIL;
+    }
+
+    progress.overall.units.complete = done + 2 * size;
+
+    if ( inDiff ) range(start, (listAll ? size : start + 1) - start);
+
+    if ( sizeA != sizeB )
+    {
+        range(size, (sizeA > sizeB ? sizeA : sizeB) - size);
+        return CMP_SIZE;
+    }
+
+    return ranges == 0 ? CMP_SAME : CMP_DIFF;
+}
+
+// Reader thread: fills each buffer in turn as soon as it has been compared.
+
+static void fill(void* arg)
+{
+    CmpSide*    side = (CmpSide*) arg;
+    Size        k, n;
+    bool        ok;
+
+    for ( k = 0; side->left > 0; k = (k + 1) % CMP_SLOTS )
+    {
+        mutex.lock();
+        while ( side->full[k] && !stop ) cond.wait(mutex);
+        ok = !stop;
+        mutex.unlock();
+
+        if ( !ok ) return;
+
+        n = side->left > (Int64) bufSize ? bufSize : (Size) side->left;
+
+        // a file which shrinks while being read is a read failure
+
+        ok = fileRead(side->bufs[k], 1, n, side->file) == n;
+
+        mutex.lock();
+        side->lens[k] = ok ? n : 0;
+        side->failed = !ok;
+        side->full[k] = true;
+        cond.broadcast();
+        mutex.unlock();
+
+        if ( !ok ) return;
+
+        side->left -= (Int64) n;
+    }
+}
+
+// Without --all only the first difference is known, so its range is given
+// as a single byte.
+
+static void range(Int64 offset, Int64 len)
+{
+    char    s[FMT_NUM_MAX + 1];
+    int     w;
+
+    if ( first < 0 ) first = offset;
+
+    ranges++;
+    differ += len;
+
+    if ( !listAll ) return;
+
+    progress.hits++;
+
+    if ( cmd.options.rawReporting )
+    {
+        oufR(F64d() " " F64d(), offset, len);
+    }
+    else
+    {
+        w = format(s, FMT_NUM_MAX, FS_AUTO, QN_BYTES, len);
+        ASSERT_ALWAYS(w >= 0);
+
+        outP();
+        oufR("    " F64x(08) "  %s", offset, s);
+    }
+}
+
+static void report(CmpResult r, Int64 sizeA, Int64 sizeB)
+{
+    char    s[FMT_NUM_MAX + 1];
+    char    t[FMT_NUM_MAX + 1];
+    int     w;
+
+    const char* const results[] = { "identical", "different", "sizes differ", "unknown" };
+
+    if ( cmd.options.rawReporting )
+    {
+        // without --all, just the first difference (-1 if sizes differ)
+
+        if ( listAll ) return;
+
+        if ( r == CMP_SIZE ) outR("-1");
+        else if ( first >= 0 ) oufR(F64d(), first);
+
+        return;
+    }
+
+    if ( listAll && ranges != 0 ) outR();
+
+    oufR("result   : %s", results[r]);
+
+    if ( sizeA != sizeB )
+    {
+        w = format(s, FMT_NUM_MAX, FS_AUTO, QN_BYTES, sizeA);
+        ASSERT_ALWAYS(w >= 0);
+        w = format(t, FMT_NUM_MAX, FS_AUTO, QN_BYTES, sizeB);
+        ASSERT_ALWAYS(w >= 0);
+        oufR("sizes    : %s / %s", s, t);
+    }
+
+    if ( first >= 0 ) oufR("first    : " F64x(08), first);
+
+    if ( listAll )
+    {
+        w = format(s, FMT_NUM_MAX, FS_AUTO, QN_RANGES, ranges);
+        ASSERT_ALWAYS(w >= 0);
+        oufR("ranges   : %s", s);
+
+        w = format(s, FMT_NUM_MAX, FS_AUTO, QN_BYTES, differ);
+        ASSERT_ALWAYS(w >= 0);
+        oufR("differ   : %s", s);
+    }
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ERRORS, errors);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("errors   : %s", s);
+
+    outR();
+}
+
+static void reportTrees()
+{
+    char    s[FMT_NUM_MAX + 1];
+    int     w;
+
+    if ( cmd.options.rawReporting ) return;
+
+    if ( conflicts != 0 ) outR();
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_CONFLICTS, conflicts);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("conflicts : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_FILES, checked);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("checked   : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ERRORS, errors);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("errors    : %s", s);
+
+    outR();
+}
+
+// EOF
@@ -0,0 +1,12 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined COMPARE_H
+
+    #define COMPARE_H
+
+    extern void compare();
+
+#endif // COMPARE_H
+
+// EOF
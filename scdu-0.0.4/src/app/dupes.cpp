@@ -0,0 +1,765 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "../core/core.h"
+#include "../alg/hash.h"
+#include "../alg/match.h"
+#include "../ffs/cache.h"
+#include "../ffs/paths.h"
+#include "../ffs/walk.h"
+
+#include "dupes.h"
+
+// Duplicates are found in stages, each of which reads only as much content
+// as is needed to split the surviving candidates any further:
+//
+//  1. WALK:   collect regular files and group them by size (no content read)
+//  2. PREFIX: hash the first and last PREFIX_SIZE bytes of each candidate
+//             (the entire content when the file is no bigger than that)
+//  3. FULL:   hash the entire content of candidates still sharing a group
+//  4. VERIFY: optionally compare content byte-by-byte with the group leader
+//
+// After each stage, candidates which no longer share a group with any other
+// file are dropped so the record array shrinks as the scan progresses.
+// With a scan cache, digests from previous runs are reused for files whose
+// identity and stamp (size, mtime, ctime) are unchanged.
+// Records are kept in one flat array and paths in a PathStore, where the
+// directories and names they share are held once, which keeps memory
+// compact when there are millions of files. A path is rebuilt into a
+// local buffer whenever a file is opened or reported.
+
+const Size PREFIX_SIZE = 4096;
+const Size WHOLE_SIZE = 2 * PREFIX_SIZE;
+const Size POLL_MSECS = 10;
+
+const Size REC_OK   = SIZE_VAL_MAX;         // record still a candidate
+const Size REC_DROP = SIZE_VAL_MAX - 1;     // content differs from leader
+const Size REC_FAIL = SIZE_VAL_MAX - 2;     // file could not be read
+
+enum Stage
+{
+    STG_PREFIX = 0,
+    STG_FULL,
+    STG_VERIFY
+};
+
+struct DupRec
+{
+    Int64   size;                       // content size in bytes
+    Uint64  hash;                       // prefix hash, then full hash
+    Size    path;                       // node of path in store
+    Size    mark;                       // REC_* state or leader index
+    Size    key;                        // index of cache key (if caching)
+};
+
+struct DupKey
+{
+    Uint64  dev;
+    Uint64  ino;
+    Int64   mtime;
+    Int64   ctime;
+};
+
+struct Job
+{
+    Stage   stage;
+    Size    next;                       // next record to claim (atomic)
+    Size    done;                       // records processed (atomic)
+    Int64   bytes;                      // bytes read so far (atomic)
+};
+
+struct Worker
+{
+    Thread  thread;
+    Uint8*  buf;
+};
+
+static DupRec*  recs = 0;
+static Size     recCount = 0;
+static Size     recCap = 0;
+
+static PathStore paths;
+
+static DupKey*  keys = 0;
+static Size     keyCount = 0;
+static Size     keyCap = 0;
+
+static ScanCache cache;
+static Size     cached = 0;         // files found in cache (atomic)
+
+static Worker   crew[THREADS_MAX];
+static Size     crewSize = 0;
+static Size     bufSize = 0;
+
+static Job      job;
+static Int64    errors = 0;
+
+static Walker   walker;
+static Mutex    mutex;              // guards records during walk
+
+static Progress progress;
+
+static void addPath(StrView path, const FileInfo& info);
+static const char* recPath(const DupRec& rec, char* buf);
+static bool visit(const WalkEntry& entry, Size worker, void* arg);
+static void poll(void* arg);
+static void runStage(Stage stage, const char* snip);
+static void work(void* arg);
+static bool hashPrefix(DupRec& rec, Uint8* buf, Int64& bytes);
+static bool hashFull(DupRec& rec, Uint8* buf, Int64& bytes);
+static bool verify(const DupRec& rec, const DupRec& leader, Uint8* buf, Int64& bytes, Size& mark);
+static bool reuse(DupRec& rec, Int64& bytes);
+static void remember(Stage stage);
+static void keyInfo(const DupRec& rec, FileInfo& info);
+static void prune();
+static void report();
+static int compare(const void* a, const void* b);
+
+void dupes()
+{
+    FileInfo    info;
+
+    outA("finding duplicates");
+
+    progress.unitQty = QN_BYTES;
+    progress.itemQty = QN_FILES;
+    progress.hitsQty = QN_FILES;
+    progress.hits = 0;
+    progress.snip = 0;
+    progress.overall.units.estimate = 0;
+    progress.overall.units.complete = 0;
+    progress.overall.items.estimate = 0;
+    progress.overall.items.complete = 0;
+    progress.current.units.estimate = 0;
+    progress.current.units.complete = 0;
+    progress.status = PS_INIT;
+
+    outP(progress);
+
+    if ( cmd.options.scanCache.len() != 0 )
+    {
+        if ( !cache.open(cmd.options.scanCache.cb()) )
+        {
+            oufW("ignoring unusable scan cache: %s", cmd.options.scanCache.cb());
+        }
+    }
+
+    walker.configure();
+    walker.setFields(cache.isOpen() ? FF_SIZE | FF_MTIME | FF_CTIME | FF_ID : FF_SIZE);
+
+    for ( Size i = 0; i < cmd.params.count; i++ )
+    {
+        const char* p = cmd.params[i].cb();
+
+        if ( fileInfo(p, info) < 0 ) xer(XE_CMDPRM, p);
+        if ( info.type != ET_FILE && info.type != ET_DIR ) xer(XE_CMDPRM, p);
+
+        progress.snip = p;
+        walker.walk(p, visit, 0, poll);
+
+        for ( Size j = 0; j < walker.failures(); j++ )
+        {
+            outP();
+            oufW("cannot read: %s", walker.failure(j));
+            errors++;
+        }
+    }
+
+    progress.status = PS_FINAL;
+    outP(progress);
+
+    // files of unique size cannot have duplicates
+
+    if ( recCount > 1 ) qsort(recs, recCount, sizeof(DupRec), compare);
+    prune();
+
+    crewSize = cmd.env.threads;
+    bufSize = cmd.options.bufferSize * cmd.env.chunkSize;
+    if ( bufSize < WHOLE_SIZE ) bufSize = WHOLE_SIZE;
+
+    runStage(STG_PREFIX, "hashing prefixes");
+    runStage(STG_FULL, "hashing content");
+
+    if ( cmd.options.verify )
+    {
+        runStage(STG_VERIFY, "verifying content");
+    }
+
+    report();
+
+    if ( cache.isOpen() && !cache.save() )
+    {
+        oufW("cannot save scan cache: %s", cmd.options.scanCache.cb());
+    }
+
+    if ( recs != 0 ) memFree(&recs, recCap * sizeof(DupRec));
+    paths.release();
+    if ( keys != 0 ) memFree(&keys, keyCap * sizeof(DupKey));
+
+    recCount = 0;
+    recCap = 0;
+    keyCount = 0;
+    keyCap = 0;
+}
+
+static void addPath(StrView path, const FileInfo& info)
+{
+    Size cap;
+
+    if ( recCount == recCap )
+    {
+        cap = recCap == 0 ? 1024 : recCap * 2;
+
+        if ( recs == 0 ) memAlloc(&recs, cap * sizeof(DupRec));
+        else memRealloc(&recs, cap * sizeof(DupRec), recCap * sizeof(DupRec));
+
+        recCap = cap;
+    }
+
+    DupRec& rec = recs[recCount++];
+
+    rec.size = info.size;
+    rec.hash = 0;
+    rec.path = paths.add(path);
+    rec.mark = REC_OK;
+    rec.key = SIZE_VAL_MAX;
+
+    if ( cache.isOpen() )
+    {
+        if ( keyCount == keyCap )
+        {
+            cap = keyCap == 0 ? 1024 : keyCap * 2;
+
+            if ( keys == 0 ) memAlloc(&keys, cap * sizeof(DupKey));
+            else memRealloc(&keys, cap * sizeof(DupKey), keyCap * sizeof(DupKey));
+
+            keyCap = cap;
+        }
+
+        DupKey& k = keys[keyCount];
+
+        k.dev = info.dev;
+        k.ino = info.ino;
+        k.mtime = info.mtime;
+        k.ctime = info.ctime;
+
+        rec.key = keyCount++;
+    }
+
+    progress.overall.items.complete++;
+    progress.overall.units.complete += info.size;
+}
+
+// walked paths are never longer than UPATH_MAX
+
+static const char* recPath(const DupRec& rec, char* buf)
+{
+    int w = paths.path(rec.path, buf, UPATH_MAX);
+
+    ASSERT_ALWAYS(w >= 0);
+
+    return buf;
+}
+
+static bool visit(const WalkEntry& entry, Size worker, void* arg)
+{
+    (void) worker;
+    (void) arg;
+
+    // links and devices are never followed
+
+    if ( entry.info.type == ET_FILE && entry.info.size > 0 )
+    {
+        mutex.lock();
+        addPath(StrView(entry.path, entry.len), entry.info);
+        mutex.unlock();
+    }
+
+    return true;
+}
+
+static void poll(void* arg)
+{
+    Progress p;
+
+    (void) arg;
+
+    mutex.lock();
+    p = progress;
+    mutex.unlock();
+
+    outP(p);
+    progress.status = PS_NORMAL;
+}
+
+static void runStage(Stage stage, const char* snip)
+{
+    char    p[UPATH_MAX + 1];
+    Size    n;
+    Int64   est;
+
+    // estimate bytes to be read so that progress is meaningful
+
+    est = 0;
+
+    for ( Size i = 0; i < recCount; i++ )
+    {
+        const DupRec& rec = recs[i];
+
+        switch ( stage )
+        {
+            case STG_PREFIX:
+                est += rec.size > (Int64) WHOLE_SIZE ? (Int64) WHOLE_SIZE : rec.size;
+                break;
+
+            case STG_FULL:
+                if ( rec.size > (Int64) WHOLE_SIZE ) est += rec.size;
+                break;
+
+            case STG_VERIFY:
+                if ( rec.mark != i ) est += 2 * rec.size;
+                break;
+        }
+    }
+
+    if ( est == 0 ) return;
+
+    job.stage = stage;
+    job.next = 0;
+    job.done = 0;
+    job.bytes = 0;
+
+    progress.snip = snip;
+    progress.hits = (Int64) recCount;
+    progress.overall.units.estimate = est;
+    progress.overall.units.complete = 0;
+    progress.overall.items.estimate = (Int64) recCount;
+    progress.overall.items.complete = 0;
+    progress.status = PS_INIT;
+
+    outP(progress);
+
+    n = crewSize < recCount ? crewSize : recCount;
+
+    for ( Size i = 0; i < n; i++ )
+    {
+        crew[i].thread.start(work, &crew[i]);
+    }
+
+    // channels are not thread-safe so progress is only reported here
+
+    progress.status = PS_NORMAL;
+
+    while ( atomicGet(&job.done) < recCount )
+    {
+        progress.overall.units.complete = atomicGet(&job.bytes);
+        progress.overall.items.complete = (Int64) atomicGet(&job.done);
+        outP(progress);
+        milliSleep(POLL_MSECS);
+    }
+
+    for ( Size i = 0; i < n; i++ )
+    {
+        crew[i].thread.join();
+    }
+
+    progress.overall.units.complete = job.bytes;
+    progress.overall.items.complete = (Int64) job.done;
+    progress.status = PS_FINAL;
+    outP(progress);
+
+    for ( Size i = 0; i < recCount; i++ )
+    {
+        if ( recs[i].mark == REC_FAIL )
+        {
+            oufW("cannot read: %s", recPath(recs[i], p));
+            errors++;
+        }
+    }
+
+    if ( stage != STG_VERIFY )
+    {
+        if ( cache.isOpen() ) remember(stage);
+
+        if ( recCount > 1 ) qsort(recs, recCount, sizeof(DupRec), compare);
+    }
+
+    prune();
+}
+
+static void work(void* arg)
+{
+    Worker* w = (Worker*) arg;
+    Size    i;
+    Int64   bytes;
+    bool    ok;
+
+    // each worker maps its own buffer so it is near (see --buffer-pages)
+
+    bufAlloc(&w->buf, bufSize);
+
+    while ( (i = atomicAdd(&job.next, 1) - 1) < recCount )
+    {
+        DupRec& rec = recs[i];
+
+        bytes = 0;
+
+        if ( reuse(rec, bytes) )
+        {
+            atomicAdd(&job.bytes, bytes);
+            atomicAdd(&job.done, 1);
+            continue;
+        }
+
+        switch ( job.stage )
+        {
+            case STG_PREFIX:
+                ok = hashPrefix(rec, w->buf, bytes);
+                break;
+
+            case STG_FULL:
+                ok = rec.size <= (Int64) WHOLE_SIZE || hashFull(rec, w->buf, bytes);
+                break;
+
+            case STG_VERIFY:
+                ok = rec.mark == i || verify(rec, recs[rec.mark], w->buf, bytes, rec.mark);
+                break;
+
+            default:
+                ok = false;
+        }
+
+        if ( !ok && rec.mark != REC_DROP ) rec.mark = REC_FAIL;
+
+        atomicAdd(&job.bytes, bytes);
+        atomicAdd(&job.done, 1);
+    }
+
+    bufFree(&w->buf, bufSize);
+}
+
+static bool hashPrefix(DupRec& rec, Uint8* buf, Int64& bytes)
+{
+    char    p[UPATH_MAX + 1];
+    File*   f;
+    Size    n;
+    Hash64  h;
+
+    f = fileOpen(recPath(rec, p), "rb");
+    if ( f == 0 ) return false;
+
+    if ( rec.size <= (Int64) WHOLE_SIZE )
+    {
+        // small files are hashed in full so they skip the FULL stage
+
+        n = (Size) rec.size;
+
+        if ( fileRead(buf, 1, n, f) != n ) { fileClose(f); return false; }
+
+        h.add(buf, n);
+    }
+    else
+    {
+        if ( fileRead(buf, 1, PREFIX_SIZE, f) != PREFIX_SIZE ) { fileClose(f); return false; }
+
+        if ( fileSeek(f, rec.size - (Int64) PREFIX_SIZE, SEEK_SET) < 0 ) { fileClose(f); return false; }
+
+        if ( fileRead(buf + PREFIX_SIZE, 1, PREFIX_SIZE, f) != PREFIX_SIZE ) { fileClose(f); return false; }
+
+        n = WHOLE_SIZE;
+        h.add(buf, n);
+    }
+
+    fileClose(f);
+
+    rec.hash = h.value();
+    bytes = (Int64) n;
+
+    return true;
+}
+
+static bool hashFull(DupRec& rec, Uint8* buf, Int64& bytes)
+{
+    char    p[UPATH_MAX + 1];
+    File*   f;
+    Int64   left;
+    Size    n;
+    Hash64  h;
+
+    f = fileOpen(recPath(rec, p), "rb");
+    if ( f == 0 ) return false;
+
+    left = rec.size;
+
+    while ( left > 0 )
+    {
+        n = left > (Int64) bufSize ? bufSize : (Size) left;
+
+        if ( fileRead(buf, 1, n, f) != n ) { fileClose(f); return false; }
+
+        h.add(buf, n);
+        left -= n;
+        atomicAdd(&job.bytes, (Int64) n);
+    }
+
+    fileClose(f);
+
+    rec.hash = h.value();
+    bytes = 0;  // already accounted for incrementally
+
+    return true;
+}
+
+static bool verify(const DupRec& rec, const DupRec& leader, Uint8* buf, Int64& bytes, Size& mark)
+{
+    char    p[UPATH_MAX + 1];
+    File*   f;
+    File*   g;
+    Int64   left;
+    Size    n, half;
+    bool    same;
+
+    ASSERT(rec.size == leader.size);
+
+    f = fileOpen(recPath(rec, p), "rb");
+    if ( f == 0 ) return false;
+
+    g = fileOpen(recPath(leader, p), "rb");
+    if ( g == 0 ) { fileClose(f); return false; }
+
+    half = bufSize / 2;
+    left = rec.size;
+    same = true;
+
+    while ( left > 0 && same )
+    {
+        n = left > (Int64) half ? half : (Size) left;
+
+        if ( fileRead(buf, 1, n, f) != n || fileRead(buf + half, 1, n, g) != n )
+        {
+            fileClose(f);
+            fileClose(g);
+            return false;
+        }
+
+        same = memcmp(buf, buf + half, n) == 0;
+        if ( !same ) mark = REC_DROP;
+        left -= n;
+        atomicAdd(&job.bytes, (Int64) (2 * n));
+    }
+
+    fileClose(f);
+    fileClose(g);
+
+    bytes = 0;
+
+    return same;    // false here means a genuine 64-bit hash collision
+}
+
+static bool reuse(DupRec& rec, Int64& bytes)
+{
+    FileInfo    info;
+    CacheRec    cr;
+
+    if ( rec.key == SIZE_VAL_MAX || cmd.options.rehash ) return false;
+
+    keyInfo(rec, info);
+
+    if ( !cache.find(info, cr) ) return false;
+
+    // cache hits count towards progress as if content had been read
+
+    switch ( job.stage )
+    {
+        case STG_PREFIX:
+            if ( !(cr.flags & CF_PREFIX) ) return false;
+            rec.hash = cr.prefix;
+            bytes = rec.size > (Int64) WHOLE_SIZE ? (Int64) WHOLE_SIZE : rec.size;
+            break;
+
+        case STG_FULL:
+            if ( rec.size <= (Int64) WHOLE_SIZE ) return false;
+            if ( !(cr.flags & CF_DIGEST) ) return false;
+            rec.hash = cr.digest;
+            bytes = rec.size;
+            break;
+
+        default:
+            return false;   // verification always reads content
+    }
+
+    if ( job.stage == STG_PREFIX ) atomicAdd(&cached, 1);
+    return true;
+}
+
+static void remember(Stage stage)
+{
+    FileInfo info;
+
+    // small files are hashed whole by the prefix stage only
+
+    for ( Size i = 0; i < recCount; i++ )
+    {
+        const DupRec& rec = recs[i];
+
+        if ( rec.key == SIZE_VAL_MAX || rec.mark == REC_FAIL ) continue;
+
+        keyInfo(rec, info);
+
+        if ( stage == STG_PREFIX )
+        {
+            cache.put(info, CF_PREFIX, rec.hash, 0);
+        }
+        else if ( rec.size > (Int64) WHOLE_SIZE )
+        {
+            cache.put(info, CF_DIGEST, 0, rec.hash);
+        }
+    }
+}
+
+static void keyInfo(const DupRec& rec, FileInfo& info)
+{
+    const DupKey& k = keys[rec.key];
+
+    info.type = ET_FILE;
+    info.size = rec.size;
+    info.alloc = 0;
+    info.mtime = k.mtime;
+    info.ctime = k.ctime;
+    info.dev = k.dev;
+    info.ino = k.ino;
+}
+
+static void prune()
+{
+    Size i, j, k, n;
+
+    // discard records which failed or were dropped by the last stage
+
+    n = 0;
+
+    for ( i = 0; i < recCount; i++ )
+    {
+        if ( recs[i].mark == REC_FAIL || recs[i].mark == REC_DROP ) continue;
+        recs[n++] = recs[i];
+    }
+
+    recCount = n;
+
+    // keep runs of two or more records with the same size and hash
+
+    n = 0;
+    i = 0;
+
+    while ( i < recCount )
+    {
+        j = i + 1;
+
+        while ( j < recCount &&
+                recs[j].size == recs[i].size &&
+                recs[j].hash == recs[i].hash )
+        {
+            j++;
+        }
+
+        if ( j - i >= 2 )
+        {
+            for ( k = i; k < j; k++ )
+            {
+                recs[n] = recs[k];
+                recs[n].mark = n - (k - i);     // index of group leader
+                n++;
+            }
+        }
+
+        i = j;
+    }
+
+    recCount = n;
+}
+
+static void report()
+{
+    char        s[FMT_NUM_MAX + 1];
+    char        c[FMT_NUM_MAX + 1];
+    char        p[UPATH_MAX + 1];
+    Size        i, j;
+    Int64       files, bytes;
+    int         w;
+
+    const bool  rr = cmd.options.rawReporting;
+
+    files = 0;
+    bytes = 0;
+
+    for ( i = 0; i < recCount; i = j )
+    {
+        j = i + 1;
+        while ( j < recCount && recs[j].mark == i ) j++;
+
+        files += (Int64) (j - i - 1);
+        bytes += (Int64) (j - i - 1) * recs[i].size;
+
+        if ( !rr )
+        {
+            w = format(s, FMT_NUM_MAX, FS_AUTO, QN_BYTES, recs[i].size);
+            ASSERT_ALWAYS(w >= 0);
+            w = format(c, FMT_NUM_MAX, FS_AUTO, QN_FILES, (Int64) (j - i));
+            ASSERT_ALWAYS(w >= 0);
+            oufR("%s x %s", s, c);
+        }
+
+        for ( Size k = i; k < j; k++ )
+        {
+            if ( rr ) outR(recPath(recs[k], p));
+            else oufR("    %s", recPath(recs[k], p));
+        }
+
+        outR();
+    }
+
+    if ( rr ) return;
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_FILES, files);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("duplicates  : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_BYTES, bytes);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("reclaimable : %s", s);
+
+    if ( cache.isOpen() )
+    {
+        w = format(s, FMT_NUM_MAX, FS_AUTO, QN_FILES, (Int64) cached);
+        ASSERT_ALWAYS(w >= 0);
+        oufR("cached      : %s", s);
+    }
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ERRORS, errors);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("errors      : %s", s);
+
+    outR();
+}
+
+static int compare(const void* a, const void* b)
+{
+    const DupRec* x = (const DupRec*) a;
+    const DupRec* y = (const DupRec*) b;
+
+    // biggest files first since they matter most when reclaiming space
+
+    if ( x->size != y->size ) return x->size > y->size ? -1 : 1;
+    if ( x->hash != y->hash ) return x->hash < y->hash ? -1 : 1;
+
+    // path nodes are numbered in scan order
+
+    if ( x->path != y->path ) return x->path < y->path ? -1 : 1;
+
+    return 0;
+}
+
+// EOF
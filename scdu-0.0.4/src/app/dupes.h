@@ -0,0 +1,12 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined DUPES_H
+
+    #define DUPES_H
+
+    extern void dupes();
+
+#endif // DUPES_H
+
+// EOF
@@ -0,0 +1,402 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "../core/core.h"
+#include "../alg/match.h"
+#include "../alg/scan.h"
+#include "../ffs/file.h"
+#include "../ffs/walk.h"
+
+#include "find.h"
+
+// Sources are walked first to collect regular files, which are then searched
+// one at a time in path order so that results come out in a stable order
+// however many threads took part in the walk. Each file is streamed through
+// the reader buffer by buffer and the finder carries any part-matched bytes
+// across buffer boundaries itself, so content is never copied or re-read.
+//
+// With a pattern list, all patterns are compiled into a single MultiFinder
+// (an Aho-Corasick automaton) so each file is still read and scanned once,
+// however many patterns there are.
+
+const Size FIND_LINE_MAX = 4 * FIND_ITEMS_MAX;  // longest pattern list line
+
+struct FindPat
+{
+    const char* text;                   // pattern (within text)
+    Int64       line;                   // line number in pattern list
+};
+
+static Arena    text;                   // paths and patterns (which never move)
+static const char** paths = 0;          // each path in text
+static Size     pathCount = 0;
+static Size     pathCap = 0;
+
+static FindPat* pats = 0;               // patterns from pattern list
+static Size     patCount = 0;
+static Size     patCap = 0;
+
+static Finder   finder;
+static MultiFinder multi;
+static bool     listed = false;         // searching for pattern list
+static Walker   walker;
+static Mutex    mutex;                  // guards paths during walk
+
+static const char* current = 0;         // path being searched
+static Int64    fileHits = 0;
+static Int64    files = 0;              // files with matches
+static Int64    errors = 0;
+
+static Progress progress;
+
+static void loadList(const char* path);
+static void addPattern(const char* pat, Int64 line);
+static void addPath(const char* path, Size len, Int64 size);
+static bool visit(const WalkEntry& entry, Size worker, void* arg);
+static void poll(void* arg);
+static void search(FileReader& reader, const char* path);
+static void hit(Int64 offset, Size pattern, void* arg);
+static void report();
+static int compare(const void* a, const void* b);
+
+void find()
+{
+    FileReader  reader;                 // not static: xer() must not destroy it
+    FileInfo    info;
+    Size        first;
+
+    ASSERT(cmd.params.count >= 1);
+
+    listed = cmd.options.patternList.len() != 0;
+
+    if ( listed )
+    {
+        loadList(cmd.options.patternList.cb());
+        first = 0;
+    }
+    else
+    {
+        const char* pat = cmd.params[0].cb();
+
+        if ( cmd.params.count < 2 ) xer(XE_CMD, "no source given");
+        if ( !finder.compile(pat, cmd.options.hex) ) xer(XE_CMDPRM, pat);
+        first = 1;
+    }
+
+    outA("finding pattern");
+
+    progress.unitQty = QN_BYTES;
+    progress.itemQty = QN_FILES;
+    progress.hitsQty = QN_MATCHES;
+    progress.hits = 0;
+    progress.snip = 0;
+    progress.overall.units.estimate = 0;
+    progress.overall.units.complete = 0;
+    progress.overall.items.estimate = 0;
+    progress.overall.items.complete = 0;
+    progress.current.units.estimate = 0;
+    progress.current.units.complete = 0;
+    progress.status = PS_INIT;
+
+    outP(progress);
+
+    walker.configure();
+    walker.setFields(FF_SIZE);
+
+    for ( Size i = first; i < cmd.params.count; i++ )
+    {
+        const char* p = cmd.params[i].cb();
+
+        if ( fileInfo(p, info) < 0 ) xer(XE_CMDPRM, p);
+        if ( info.type != ET_FILE && info.type != ET_DIR ) xer(XE_CMDPRM, p);
+
+        progress.snip = p;
+        walker.walk(p, visit, 0, poll);
+
+        for ( Size j = 0; j < walker.failures(); j++ )
+        {
+            outP();
+            oufW("cannot read: %s", walker.failure(j));
+            errors++;
+        }
+    }
+
+    if ( pathCount > 1 ) qsort(paths, pathCount, sizeof(const char*), compare);
+
+    progress.overall.items.estimate = progress.overall.items.complete;
+    progress.overall.items.complete = 0;
+    progress.overall.units.estimate = progress.overall.units.complete;
+    progress.overall.units.complete = 0;
+
+    reader.reserve(cmd.options.bufferSize);
+
+    for ( Size i = 0; i < pathCount; i++ )
+    {
+        search(reader, paths[i]);
+    }
+
+    reader.release();
+
+    progress.status = PS_FINAL;
+    outP(progress);
+
+    report();
+
+    if ( paths != 0 ) memFree(&paths, pathCap * sizeof(const char*));
+    if ( pats != 0 ) memFree(&pats, patCap * sizeof(FindPat));
+
+    multi.release();
+    text.release();
+
+    pathCount = 0;
+    pathCap = 0;
+    patCount = 0;
+    patCap = 0;
+}
+
+// Patterns are listed one per line, either as literal text or as hex (with
+// the hex option). Blank lines and lines starting with '#' are ignored.
+
+static void loadList(const char* path)
+{
+    char        entry[FIND_LINE_MAX + 2];
+    File*       file;
+    Size        n;
+    Int64       line;
+
+    file = fileOpen(path, "r");
+    if ( file == 0 ) xer(XE_CMDPRM, path);
+
+    line = 0;
+
+    while ( fileGetS(entry, sizeof(entry), file) != 0 )
+    {
+        line++;
+
+        n = strlen(entry);
+
+        if ( n == sizeof(entry) - 1 && entry[n - 1] != '\n' )
+        {
+            fileClose(file);
+            xer(XE_PATLIST, path, (int) line);
+        }
+
+        while ( n != 0 && (entry[n - 1] == '\n' || entry[n - 1] == '\r') ) entry[--n] = 0;
+
+        if ( n == 0 || entry[0] == '#' ) continue;
+
+        if ( !multi.add(entry, cmd.options.hex) )
+        {
+            fileClose(file);
+            xer(XE_PATLIST, path, (int) line);
+        }
+
+        addPattern(entry, line);
+    }
+
+    fileClose(file);
+
+    if ( patCount == 0 ) xer(XE_CMD, "empty pattern list");
+
+    multi.compile();
+}
+
+static void addPattern(const char* pat, Int64 line)
+{
+    Size cap;
+
+    if ( patCount == patCap )
+    {
+        cap = patCap == 0 ? 256 : patCap * 2;
+
+        if ( pats == 0 ) memAlloc(&pats, cap * sizeof(FindPat));
+        else memRealloc(&pats, cap * sizeof(FindPat), patCap * sizeof(FindPat));
+
+        patCap = cap;
+    }
+
+    pats[patCount].text = text.strDup(pat, strlen(pat));
+    pats[patCount].line = line;
+    patCount++;
+}
+
+static void addPath(const char* path, Size len, Int64 size)
+{
+    Size cap;
+
+    if ( pathCount == pathCap )
+    {
+        cap = pathCap == 0 ? 1024 : pathCap * 2;
+
+        if ( paths == 0 ) memAlloc(&paths, cap * sizeof(const char*));
+        else memRealloc(&paths, cap * sizeof(const char*), pathCap * sizeof(const char*));
+
+        pathCap = cap;
+    }
+
+    paths[pathCount++] = text.strDup(path, len);
+
+    progress.overall.items.complete++;
+    progress.overall.units.complete += size;
+}
+
+static bool visit(const WalkEntry& entry, Size worker, void* arg)
+{
+    (void) worker;
+    (void) arg;
+
+    // links and devices are never followed
+
+    if ( entry.info.type == ET_FILE )
+    {
+        mutex.lock();
+        addPath(entry.path, entry.len, entry.info.size);
+        mutex.unlock();
+    }
+
+    return true;
+}
+
+static void poll(void* arg)
+{
+    Progress p;
+
+    (void) arg;
+
+    mutex.lock();
+    p = progress;
+    mutex.unlock();
+
+    outP(p);
+    progress.status = PS_NORMAL;
+}
+
+static void search(FileReader& reader, const char* path)
+{
+    Int64   done, size;
+    Size    n;
+
+    reader.open(path);
+
+    if ( fen )
+    {
+        outP();
+        oufW("cannot read: %s", path);
+        errors++;
+        return;
+    }
+
+    size = reader.size();
+    done = progress.overall.units.complete;
+
+    current = path;
+    fileHits = 0;
+
+    if ( listed ) multi.reset();
+    else finder.reset();
+
+    progress.snip = path;
+    progress.current.units.estimate = size;
+    progress.current.units.complete = 0;
+
+    while ( reader.pos() < size )
+    {
+        reader.fill();
+
+        if ( fen )
+        {
+            outP();
+            oufW("cannot read: %s", path);
+            errors++;
+            break;
+        }
+
+        n = reader.len();
+
+        // a file which shrinks while being read simply ends early
+
+        if ( n == 0 ) break;
+
+        if ( listed ) multi.feed(reader.data(), n, false, hit, 0);
+        else finder.feed(reader.data(), n, reader.pos() + (Int64) n >= size, hit, 0);
+        reader.drop(n);
+
+        progress.current.units.complete = reader.pos();
+        progress.overall.units.complete = done + reader.pos();
+        outP(progress);
+        progress.status = PS_NORMAL;
+    }
+
+    // resolve any starts still open if the file ended early
+
+    if ( !listed && reader.pos() < size ) finder.feed(0, 0, true, hit, 0);
+
+    reader.close();
+
+    if ( fileHits != 0 ) files++;
+
+    progress.overall.units.complete = done + size;
+    progress.overall.items.complete++;
+
+    if ( fileHits != 0 && !cmd.options.rawReporting ) outR();
+}
+
+static void hit(Int64 offset, Size pattern, void* arg)
+{
+    (void) arg;
+
+    if ( cmd.options.rawReporting )
+    {
+        if ( listed ) oufR(F64d() " " F64d() " %s", offset, pats[pattern].line, current);
+        else oufR(F64d() " %s", offset, current);
+    }
+    else
+    {
+        if ( fileHits == 0 ) outR(current);
+
+        if ( listed ) oufR("    " F64x(08) "  %s", offset, pats[pattern].text);
+        else oufR("    " F64x(08), offset);
+    }
+
+    fileHits++;
+    progress.hits++;
+}
+
+static void report()
+{
+    char    s[FMT_NUM_MAX + 1];
+    int     w;
+
+    if ( cmd.options.rawReporting ) return;
+
+    if ( listed )
+    {
+        w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ITEMS, (Int64) patCount);
+        ASSERT_ALWAYS(w >= 0);
+        oufR("patterns : %s (%s automaton)", s, multi.isDense() ? "dense" : "compact");
+    }
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_MATCHES, progress.hits);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("matches  : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_FILES, files);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("files    : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ERRORS, errors);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("errors   : %s", s);
+
+    outR();
+}
+
+static int compare(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+// EOF
@@ -0,0 +1,12 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined FIND_H
+
+    #define FIND_H
+
+    extern void find();
+
+#endif // FIND_H
+
+// EOF
@@ -1,13 +1,727 @@
 // Copyright 2015-2016 RVJ Callanan.
 // Released under the GNU General Public License (Version 3).
 
+#include <string.h>
+#include <stdlib.h>
+
 #include "../core/core.h"
+#include "../alg/hash.h"
+#include "../alg/match.h"
+#include "../ffs/walk.h"
+#include "../ffs/magic.h"
 
 #include "info.h"
 
+// Usage is gathered by a Walker whose workers each keep private tallies:
+// one for the whole tree, one per top-level directory and a heap of the
+// largest files seen. Nothing is shared while the walk is in progress
+// (apart from the top-level directory table which is complete before any
+// worker needs it) and the tallies are merged once the walk is over.
+// With the types option, each worker also reads the first few bytes of
+// every file it visits to identify its type (see ffs/magic).
+
+const Size CACHE_LINE = 64;
+
+struct Tally
+{
+    Int64   files;
+    Int64   dirs;
+    Int64   links;
+    Int64   others;
+    Int64   apparent;                   // sum of content sizes
+    Int64   allocated;                  // sum of space on disk
+};
+
+struct Kind
+{
+    Int64   files;
+    Int64   bytes;
+};
+
+struct Big
+{
+    Int64   size;
+    char*   path;
+    Size    len;
+};
+
+struct Crew
+{
+    Tally   total;
+    Tally*  tops;                       // tally per top-level directory
+    Size    topCount;
+    Size    lastTop;                    // most recent lookup (usually a hit)
+    Big*    bigs;                       // min-heap of largest files
+    Size    bigCount;
+    Kind    kinds[MN_COUNT];            // tally per detected file type
+    Int64   unread;                     // files whose type is unknown
+    Uint8   head[MAGIC_HEAD_MAX];       // content prefix for type detection
+    Uint8   pad[CACHE_LINE];            // keep crews off each other's lines
+};
+
+struct Top
+{
+    Size    name;                       // offset in name arena
+    Size    len;
+    Int64   alloc;                      // allocation of directory itself
+    Tally   sum;                        // merged from crews after walk
+};
+
+static Crew     crew[THREADS_MAX];
+static Walker   walker;
+static Magic    magic;
+static Size     base = 0;               // offset of top-level names in paths
+static Size     bigMax = 0;
+
+static Top*     tops = 0;
+static Size     topCount = 0;
+static Size     topCap = 0;
+static char*    names = 0;
+static Size     nameLen = 0;
+static Size     nameCap = 0;
+static Size*    slots = 0;              // open-addressed hash of top indices
+static Size     slotCap = 0;
+
+static const Kind* sortKinds = 0;     // context for compareKind
+
+static Progress progress;
+
+static bool visit(const WalkEntry& entry, Size worker, void* arg);
+static void poll(void* arg);
+static void tally(Tally& t, const FileInfo& info);
+static void addTop(const char* name, Size len, Int64 alloc);
+static Size findTop(const char* name, Size len);
+static void addBig(Crew& c, const WalkEntry& entry);
+static void merge(Tally& to, const Tally& from);
+static void report(const char* root, const Tally& total, Big* bigs, Size count);
+static void reportKinds(const Kind* kinds, Int64 unread);
+static void release();
+static int compareBig(const void* a, const void* b);
+static int compareTop(const void* a, const void* b);
+static int compareKind(const void* a, const void* b);
+
 void info()
 {
-    outR("action not yet implemented");
+    FileInfo    fi;
+    Tally       total;
+    Kind        kinds[MN_COUNT];
+    Int64       unread;
+    Big*        bigs;
+    Size        count, n;
+
+    ASSERT(cmd.params.count == 1);
+
+    const char* root = cmd.params[0].cb();
+
+    outA("gathering information");
+
+    if ( fileInfo(root, fi, FF_ALLOC) < 0 ) xer(XE_CMDPRM, root);
+
+    // top-level names start where the walker appends them to the root
+
+    n = strlen(root);
+    while ( n > 1 && ( root[n-1] == '/' || root[n-1] == PATH_SEP ) ) n--;
+
+    base = n;
+    if ( root[n-1] != '/' && root[n-1] != PATH_SEP ) base++;
+
+    bigMax = cmd.options.top;
+
+    for ( Size i = 0; i < THREADS_MAX; i++ )
+    {
+        Crew& c = crew[i];
+
+        memset(&c.total, 0, sizeof(Tally));
+        c.tops = 0;
+        c.topCount = 0;
+        c.lastTop = SIZE_VAL_MAX;
+        c.bigs = 0;
+        c.bigCount = 0;
+        memset(c.kinds, 0, sizeof(c.kinds));
+        c.unread = 0;
+    }
+
+    if ( cmd.options.types ) magic.compile();
+
+    progress.unitQty = QN_BYTES;
+    progress.itemQty = QN_FILES;
+    progress.hitsQty = QN_DIRS;
+    progress.hits = 0;
+    progress.snip = root;
+    progress.overall.units.estimate = 0;
+    progress.overall.units.complete = 0;
+    progress.overall.items.estimate = 0;
+    progress.overall.items.complete = 0;
+    progress.current.units.estimate = 0;
+    progress.current.units.complete = 0;
+    progress.status = PS_INIT;
+
+    walker.configure();
+    walker.setFields(FF_SIZE | FF_ALLOC);
+    walker.walk(root, visit, 0, poll);
+
+    progress.status = PS_FINAL;
+    outP(progress);
+
+    for ( Size i = 0; i < walker.failures(); i++ )
+    {
+        oufW("cannot read: %s", walker.failure(i));
+    }
+
+    // merge crews (threads() is zero when the root is not a directory)
+
+    memset(&total, 0, sizeof(Tally));
+    memset(kinds, 0, sizeof(kinds));
+
+    unread = 0;
+    count = 0;
+    n = walker.threads() == 0 ? 1 : walker.threads();
+
+    for ( Size i = 0; i < n; i++ )
+    {
+        Crew& c = crew[i];
+
+        merge(total, c.total);
+
+        for ( Size j = 0; j < c.topCount; j++ )
+        {
+            merge(tops[j].sum, c.tops[j]);
+        }
+
+        count += c.bigCount;
+
+        for ( Size j = 0; j < MN_COUNT; j++ )
+        {
+            kinds[j].files += c.kinds[j].files;
+            kinds[j].bytes += c.kinds[j].bytes;
+        }
+
+        unread += c.unread;
+    }
+
+    bigs = 0;
+
+    if ( count != 0 )
+    {
+        memAlloc(&bigs, count * sizeof(Big));
+
+        count = 0;
+
+        for ( Size i = 0; i < n; i++ )
+        {
+            Crew& c = crew[i];
+
+            if ( c.bigCount != 0 ) memcpy(bigs + count, c.bigs, c.bigCount * sizeof(Big));
+            count += c.bigCount;
+        }
+
+        if ( count > 1 ) qsort(bigs, count, sizeof(Big), compareBig);
+    }
+
+    for ( Size i = 0; i < topCount; i++ )
+    {
+        tops[i].sum.allocated += tops[i].alloc;
+    }
+
+    // a root directory is not visited itself but takes up space like du
+
+    if ( fi.type == ET_DIR ) total.allocated += fi.alloc;
+
+    if ( topCount > 1 ) qsort(tops, topCount, sizeof(Top), compareTop);
+
+    report(root, total, bigs, count);
+
+    if ( cmd.options.types ) reportKinds(kinds, unread);
+
+    for ( Size i = 0; i < count; i++ )
+    {
+        memFree(&bigs[i].path, bigs[i].len + 1);
+    }
+
+    if ( bigs != 0 ) memFree(&bigs, count * sizeof(Big));
+
+    release();
+}
+
+static bool visit(const WalkEntry& entry, Size worker, void* arg)
+{
+    Crew&       c = crew[worker];
+    const char* name;
+    const char* end;
+    Size        len, t;
+    MagicNum    num;
+
+    (void) arg;
+
+    tally(c.total, entry.info);
+
+    if ( entry.info.type == ET_FILE )
+    {
+        if ( bigMax != 0 ) addBig(c, entry);
+
+        if ( cmd.options.types )
+        {
+            if ( magic.identify(entry.path, entry.info.size, c.head, num) )
+            {
+                c.kinds[num].files++;
+                c.kinds[num].bytes += entry.info.size;
+            }
+            else
+            {
+                c.unread++;
+            }
+        }
+    }
+
+    // the root listing (depth 1) completes before any deeper directory is
+    // queued, so the table of top-level directories is built by one worker
+    // and is only ever read once other workers are involved
+
+    if ( entry.depth < 2 )
+    {
+        if ( entry.depth == 1 && entry.info.type == ET_DIR )
+        {
+            addTop(entry.name, entry.len - base, entry.info.alloc);
+        }
+
+        return true;
+    }
+
+    name = entry.path + base;
+    end = (const char*) memchr(name, PATH_SEP, entry.len - base);
+    len = end == 0 ? entry.len - base : (Size) (end - name);
+
+    t = c.lastTop;
+
+    if ( t == SIZE_VAL_MAX || tops[t].len != len || memcmp(names + tops[t].name, name, len) != 0 )
+    {
+        t = findTop(name, len);
+        c.lastTop = t;
+    }
+
+    if ( c.tops == 0 )
+    {
+        c.topCount = topCount;
+        memAlloc(&c.tops, topCount * sizeof(Tally));
+        memset(c.tops, 0, topCount * sizeof(Tally));
+    }
+
+    ASSERT(t < c.topCount);
+
+    tally(c.tops[t], entry.info);
+
+    return true;
+}
+
+static void poll(void* arg)
+{
+    (void) arg;
+
+    progress.overall.items.complete = (Int64) walker.entries();
+    progress.hits = (Int64) walker.dirs();
+
+    outP(progress);
+    progress.status = PS_NORMAL;
+}
+
+static void tally(Tally& t, const FileInfo& info)
+{
+    switch ( info.type )
+    {
+        case ET_FILE:   t.files++;  break;
+        case ET_DIR:    t.dirs++;   break;
+        case ET_LINK:   t.links++;  break;
+        default:        t.others++; break;
+    }
+
+    t.apparent += info.size;
+    t.allocated += info.alloc;
+}
+
+static void addTop(const char* name, Size len, Int64 alloc)
+{
+    Size    cap, h, mask;
+    Size*   old;
+    Size    oldCap;
+
+    if ( topCount == topCap )
+    {
+        cap = topCap == 0 ? 64 : topCap * 2;
+
+        if ( tops == 0 ) memAlloc(&tops, cap * sizeof(Top));
+        else memRealloc(&tops, cap * sizeof(Top), topCap * sizeof(Top));
+
+        topCap = cap;
+    }
+
+    if ( nameLen + len + 1 > nameCap )
+    {
+        cap = nameCap == 0 ? 4096 : nameCap * 2;
+        while ( nameLen + len + 1 > cap ) cap *= 2;
+
+        if ( names == 0 ) memAlloc(&names, cap);
+        else memRealloc(&names, cap, nameCap);
+
+        nameCap = cap;
+    }
+
+    Top& t = tops[topCount];
+
+    t.name = nameLen;
+    t.len = len;
+    t.alloc = alloc;
+    memset(&t.sum, 0, sizeof(Tally));
+
+    memcpy(names + nameLen, name, len);
+    names[nameLen + len] = 0;
+    nameLen += len + 1;
+
+    topCount++;
+
+    // keep the hash table at most half full
+
+    if ( topCount * 2 > slotCap )
+    {
+        old = slots;
+        oldCap = slotCap;
+
+        slotCap = slotCap == 0 ? 128 : slotCap * 2;
+        slots = 0;
+        memAlloc(&slots, slotCap * sizeof(Size));
+
+        for ( Size i = 0; i < slotCap; i++ ) slots[i] = SIZE_VAL_MAX;
+
+        mask = slotCap - 1;
+
+        for ( Size i = 0; i < topCount; i++ )
+        {
+            h = (Size) hash64(names + tops[i].name, tops[i].len) & mask;
+            while ( slots[h] != SIZE_VAL_MAX ) h = (h + 1) & mask;
+            slots[h] = i;
+        }
+
+        if ( old != 0 ) memFree(&old, oldCap * sizeof(Size));
+    }
+    else
+    {
+        mask = slotCap - 1;
+
+        h = (Size) hash64(name, len) & mask;
+        while ( slots[h] != SIZE_VAL_MAX ) h = (h + 1) & mask;
+        slots[h] = topCount - 1;
+    }
+}
+
+static Size findTop(const char* name, Size len)
+{
+    Size h, i, mask;
+
+    mask = slotCap - 1;
+    h = (Size) hash64(name, len) & mask;
+
+    while ( (i = slots[h]) != SIZE_VAL_MAX )
+    {
+        if ( tops[i].len == len && memcmp(names + tops[i].name, name, len) == 0 )
+        {
+            return i;
+        }
+
+        h = (h + 1) & mask;
+    }
+
+    ASSERT(false);  // every path below the root starts with a known top
+    return 0;
+}
+
+static void addBig(Crew& c, const WalkEntry& entry)
+{
+    Big     b;
+    Size    i, j, k;
+
+    if ( c.bigs == 0 ) memAlloc(&c.bigs, bigMax * sizeof(Big));
+
+    if ( c.bigCount == bigMax )
+    {
+        if ( entry.info.size <= c.bigs[0].size ) return;
+
+        // evict smallest (root of min-heap)
+
+        memFree(&c.bigs[0].path, c.bigs[0].len + 1);
+        c.bigs[0] = c.bigs[--c.bigCount];
+
+        i = 0;
+
+        while ( true )
+        {
+            j = 2 * i + 1;
+            k = i;
+
+            if ( j < c.bigCount && c.bigs[j].size < c.bigs[k].size ) k = j;
+            if ( j + 1 < c.bigCount && c.bigs[j+1].size < c.bigs[k].size ) k = j + 1;
+            if ( k == i ) break;
+
+            b = c.bigs[i];
+            c.bigs[i] = c.bigs[k];
+            c.bigs[k] = b;
+            i = k;
+        }
+    }
+
+    b.size = entry.info.size;
+    b.len = entry.len;
+    b.path = 0;
+    memAlloc(&b.path, b.len + 1);
+    memcpy(b.path, entry.path, b.len + 1);
+
+    i = c.bigCount++;
+
+    while ( i > 0 && c.bigs[(i - 1) / 2].size > b.size )
+    {
+        c.bigs[i] = c.bigs[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    c.bigs[i] = b;
+}
+
+static void merge(Tally& to, const Tally& from)
+{
+    to.files += from.files;
+    to.dirs += from.dirs;
+    to.links += from.links;
+    to.others += from.others;
+    to.apparent += from.apparent;
+    to.allocated += from.allocated;
+}
+
+static void report(const char* root, const Tally& total, Big* bigs, Size count)
+{
+    char        a[FMT_NUM_MAX + 1];
+    char        b[FMT_NUM_MAX + 1];
+    char        c[FMT_NUM_MAX + 1];
+    int         w;
+
+    const bool  rr = cmd.options.rawReporting;
+    const FmtSpec fs = rr ? FS_BR : FS_AUTO;
+
+    if ( count > bigMax ) count = bigMax;
+
+    if ( rr )
+    {
+        // bare data: totals, then largest files, then top-level directories
+
+        oufR(   F64d() " " F64d() " " F64d() " " F64d() " " F64d() " " F64d(),
+                total.apparent, total.allocated, total.files,
+                total.dirs, total.links, total.others );
+
+        outR();
+
+        for ( Size i = 0; i < count; i++ )
+        {
+            oufR(F64d() " %s", bigs[i].size, bigs[i].path);
+        }
+
+        outR();
+
+        for ( Size i = 0; i < topCount; i++ )
+        {
+            const Top& t = tops[i];
+
+            oufR(   F64d() " " F64d() " " F64d() " %s",
+                    t.sum.apparent, t.sum.allocated, t.sum.files, names + t.name );
+        }
+
+        return;
+    }
+
+    oufR("path        : %s", root);
+
+    w = format(a, FMT_NUM_MAX, fs, QN_BYTES, total.apparent);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("apparent    : %s", a);
+
+    w = format(a, FMT_NUM_MAX, fs, QN_BYTES, total.allocated);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("allocated   : %s", a);
+
+    w = format(a, FMT_NUM_MAX, fs, QN_FILES, total.files);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("files       : %s", a);
+
+    w = format(a, FMT_NUM_MAX, fs, QN_DIRS, total.dirs);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("directories : %s", a);
+
+    w = format(a, FMT_NUM_MAX, fs, QN_LINKS, total.links);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("links       : %s", a);
+
+    w = format(a, FMT_NUM_MAX, fs, QN_ITEMS, total.others);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("others      : %s", a);
+
+    w = format(a, FMT_NUM_MAX, fs, QN_ERRORS, (Int64) walker.failures());
+    ASSERT_ALWAYS(w >= 0);
+    oufR("errors      : %s", a);
+
+    outR();
+
+    if ( count != 0 )
+    {
+        outR("largest files:");
+        outR();
+
+        for ( Size i = 0; i < count; i++ )
+        {
+            w = format(a, FMT_NUM_MAX, fs, QN_BYTES, bigs[i].size);
+            ASSERT_ALWAYS(w >= 0);
+            oufR("    %10s  %s", a, bigs[i].path);
+        }
+
+        outR();
+    }
+
+    if ( topCount != 0 )
+    {
+        outR("directories:  (apparent, allocated, files)");
+        outR();
+
+        for ( Size i = 0; i < topCount; i++ )
+        {
+            const Top& t = tops[i];
+
+            w = format(a, FMT_NUM_MAX, fs, QN_BYTES, t.sum.apparent);
+            ASSERT_ALWAYS(w >= 0);
+            w = format(b, FMT_NUM_MAX, fs, QN_BYTES, t.sum.allocated);
+            ASSERT_ALWAYS(w >= 0);
+            w = format(c, FMT_NUM_MAX, FS_B, QN_FILES, t.sum.files);
+            ASSERT_ALWAYS(w >= 0);
+
+            oufR("    %10s  %10s  %12s  %s", a, b, c, names + t.name);
+        }
+
+        outR();
+    }
+}
+
+static void reportKinds(const Kind* kinds, Int64 unread)
+{
+    char        a[FMT_NUM_MAX + 1];
+    char        b[FMT_NUM_MAX + 1];
+    Size        order[MN_COUNT];
+    Size        n;
+    int         w;
+
+    const bool  rr = cmd.options.rawReporting;
+    const FmtSpec fs = rr ? FS_BR : FS_AUTO;
+
+    // list types present, most files first
+
+    n = 0;
+
+    for ( Size i = 0; i < MN_COUNT; i++ )
+    {
+        if ( kinds[i].files != 0 ) order[n++] = i;
+    }
+
+    sortKinds = kinds;
+    qsort(order, n, sizeof(Size), compareKind);
+
+    if ( rr )
+    {
+        outR();
+
+        for ( Size i = 0; i < n; i++ )
+        {
+            const Kind& k = kinds[order[i]];
+
+            oufR(F64d() " " F64d() " %s", k.files, k.bytes, magicDefs[order[i]].name);
+        }
+
+        oufR(F64d() " unreadable", unread);
+        return;
+    }
+
+    outR("types:  (files, apparent)");
+    outR();
+
+    for ( Size i = 0; i < n; i++ )
+    {
+        const Kind& k = kinds[order[i]];
+
+        w = format(a, FMT_NUM_MAX, FS_B, QN_FILES, k.files);
+        ASSERT_ALWAYS(w >= 0);
+        w = format(b, FMT_NUM_MAX, fs, QN_BYTES, k.bytes);
+        ASSERT_ALWAYS(w >= 0);
+
+        oufR("    %12s  %10s  %-8s %s", a, b, magicDefs[order[i]].name, magicDefs[order[i]].desc);
+    }
+
+    if ( unread != 0 )
+    {
+        w = format(a, FMT_NUM_MAX, FS_B, QN_FILES, unread);
+        ASSERT_ALWAYS(w >= 0);
+
+        oufR("    %12s  %10s  %-8s %s", a, "", "-", "could not be read");
+    }
+
+    outR();
+}
+
+static void release()
+{
+    for ( Size i = 0; i < THREADS_MAX; i++ )
+    {
+        Crew& c = crew[i];
+
+        if ( c.tops != 0 ) memFree(&c.tops, c.topCount * sizeof(Tally));
+        if ( c.bigs != 0 ) memFree(&c.bigs, bigMax * sizeof(Big));
+
+        c.topCount = 0;
+        c.bigCount = 0;
+    }
+
+    if ( tops != 0 ) memFree(&tops, topCap * sizeof(Top));
+    if ( names != 0 ) memFree(&names, nameCap);
+    if ( slots != 0 ) memFree(&slots, slotCap * sizeof(Size));
+
+    magic.release();
+
+    topCount = 0;
+    topCap = 0;
+    nameLen = 0;
+    nameCap = 0;
+    slotCap = 0;
+}
+
+static int compareBig(const void* a, const void* b)
+{
+    const Big* x = (const Big*) a;
+    const Big* y = (const Big*) b;
+
+    if ( x->size != y->size ) return x->size > y->size ? -1 : 1;
+
+    return strcmp(x->path, y->path);
+}
+
+static int compareKind(const void* a, const void* b)
+{
+    const Kind& x = sortKinds[*(const Size*) a];
+    const Kind& y = sortKinds[*(const Size*) b];
+
+    if ( x.files != y.files ) return x.files > y.files ? -1 : 1;
+
+    return *(const Size*) a < *(const Size*) b ? -1 : 1;
+}
+
+static int compareTop(const void* a, const void* b)
+{
+    const Top* x = (const Top*) a;
+    const Top* y = (const Top*) b;
+
+    if ( x->sum.allocated != y->sum.allocated ) return x->sum.allocated > y->sum.allocated ? -1 : 1;
+
+    return strcmp(names + x->name, names + y->name);
 }
 
-// EOF
\ No newline at end of file
+// EOF
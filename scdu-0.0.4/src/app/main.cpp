@@ -6,10 +6,15 @@
 
 #include "../core/core.h"
 
+#include "bench.h"
+#include "compare.h"
 #include "copy.h"
+#include "dupes.h"
+#include "find.h"
 #include "help.h"
 #include "info.h"
 #include "show.h"
+#include "sync.h"
 #include "view.h"
 
 static bool success = false;
@@ -20,6 +25,8 @@ static void preamble();
 static void postamble();
 static void recap();
 static void summarise();
+static void buffers();
+static void profile();
 
 static Timer timer;
 
@@ -33,9 +40,19 @@ int main(int argc, char* argv[])
     cmd.init(argc, argv);
     if ( cen ) xer(XE_CMD, cem);
 
+    allocsProfile(cmd.options.summaryStats.P);
+    bufsConfigure(  ( cmd.options.bufferPages.H ? PG_HUGE : 0 ) |
+                    ( cmd.options.bufferPages.L ? PG_LOCAL : 0 ),
+                    cmd.options.summaryStats.B );
+
     openChannels();
     preamble();
 
+    if ( cmd.options.bufferPages.H && !hugePagesAllowed() )
+    {
+        oufW("huge pages need the \"lock pages in memory\" privilege");
+    }
+
     if ( cmd.recap )
     {
         recap();
@@ -44,11 +61,18 @@ int main(int argc, char* argv[])
     {
         switch ( cmd.action.num )
         {
+            case ACT_COMPARE: compare(); break;
             case ACT_COPY: copy(); break;
+            case ACT_DUPES: dupes(); break;
+            case ACT_FIND: find(); break;
             case ACT_HELP: help(); break;
             case ACT_INFO: info(); break;
             case ACT_SHOW: show(); break;
+            case ACT_SYNC: sync(); break;
             case ACT_VIEW: view(); break;
+            #if defined SCDU_MODE_DEBUG
+                case ACT_BENCH: bench(); break;
+            #endif
 
             default: ASSERT(false);
         }
@@ -202,6 +226,8 @@ static void summarise()
 
     if ( ss.A )
     {
+        const Allocs allocs = allocsTotal();
+
         spec = rr ? FS_BR : FS_FR;
         fmt  = rr ? "%s"  : "core allocs (cur) : %s";
         w = format(s, FMT_MAX, spec, QN_BYTES, Int64(allocs.cur));
@@ -215,6 +241,11 @@ static void summarise()
         oufS(fmt, s);
     }
 
+    if ( ss.B )
+    {
+        buffers();
+    }
+
     if ( ss.D )
     {
         spec = rr ? FS_BR : FS_F;
@@ -224,7 +255,102 @@ static void summarise()
         oufS(fmt, s);
     }
 
+    if ( ss.P )
+    {
+        profile();
+    }
+
     outS();
 }
 
+// I/O buffers mapped from the OS (see --buffer-pages) with the bytes of those
+// which got huge pages, the largest page size obtained and the NUMA nodes
+// their memory came from
+
+static void buffers()
+{
+    char        c[FMT_MAX + 1];
+    char        b[FMT_MAX + 1];
+    char        h[FMT_MAX + 1];
+    char        p[FMT_MAX + 1];
+    char        n[FMT_MAX + 1];
+    Size        len;
+    int         w;
+
+    const bool  rr = cmd.options.rawReporting;
+    const FmtSpec spec = rr ? FS_BR : FS_FR;
+    const BufStats stats = bufsTotal();
+
+    w = format(c, FMT_MAX, spec, QN_ITEMS, Int64(stats.count));
+    ASSERT_ALWAYS(w >= 0);
+    w = format(b, FMT_MAX, spec, QN_BYTES, Int64(stats.bytes));
+    ASSERT_ALWAYS(w >= 0);
+    w = format(h, FMT_MAX, spec, QN_BYTES, Int64(stats.huge));
+    ASSERT_ALWAYS(w >= 0);
+    w = format(p, FMT_MAX, spec, QN_BYTES, Int64(stats.page));
+    ASSERT_ALWAYS(w >= 0);
+
+    len = 0;
+    n[0] = 0;
+
+    for ( int i = 0; i < 64; i++ )
+    {
+        if ( ( stats.nodes & (Uint64) 1 << i ) == 0 ) continue;
+
+        w = snprintfz(n + len, FMT_MAX - len, len == 0 ? "%d" : ",%d", i);
+        if ( w < 0 || (Size) w >= FMT_MAX - len ) break;
+
+        len += (Size) w;
+    }
+
+    if ( len == 0 ) strcpy(n, "-");
+
+    if ( rr )
+    {
+        oufS("%s %s %s %s %s", c, b, h, p, n);
+    }
+    else
+    {
+        oufS("io buffers        : %s : %s", c, b);
+        oufS("io buffers (huge) : %s", h);
+        oufS("io buffer pages   : %s", p);
+        oufS("io buffer nodes   : %s", n);
+    }
+}
+
+// lists the call sites which allocated most bytes (see --top) with the
+// number of allocations made there, bytes allocated and peak bytes held
+
+static void profile()
+{
+    static AllocSite top[ALLOC_SITES_MAX];
+    char        c[FMT_MAX + 1];
+    char        b[FMT_MAX + 1];
+    char        p[FMT_MAX + 1];
+    Size        n;
+    int         w;
+
+    const bool  rr = cmd.options.rawReporting;
+    const FmtSpec spec = rr ? FS_BR : FS_FR;
+
+    n = allocsProfileTop(top, cmd.options.top);
+
+    for ( Size i = 0; i < n; i++ )
+    {
+        const AllocSite& site = top[i];
+
+        w = format(c, FMT_MAX, spec, QN_ITEMS, site.count);
+        ASSERT_ALWAYS(w >= 0);
+        w = format(b, FMT_MAX, spec, QN_BYTES, site.bytes);
+        ASSERT_ALWAYS(w >= 0);
+        w = format(p, FMT_MAX, spec, QN_BYTES, site.peak);
+        ASSERT_ALWAYS(w >= 0);
+
+        if ( rr ) oufS("%s %s %s %s:%d %s", c, b, p, site.file, site.line, site.func);
+        else oufS("alloc site        : %s : %s : %s peak : %s:%d %s", c, b, p, site.file, site.line, site.func);
+    }
+
+    allocsProfile(false);
+}
+
 // EOF
\ No newline at end of file
@@ -0,0 +1,679 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+
+#include "../core/core.h"
+#include "../alg/match.h"
+#include "../alg/scan.h"
+#include "../ffs/walk.h"
+
+#include "sync.h"
+
+// The source is walked and each file is checked against its counterpart in
+// the destination as soon as the walker finds it. Files which need copying
+// are planned onto a bounded queue from which a crew of copiers takes them,
+// so the first copies start long before the walk is over and change
+// detection proceeds in parallel with the transfers. When the queue is full
+// the walker waits for the copiers, so the plan never runs far ahead.
+//
+// A file needs copying if it is missing from the destination or differs in
+// size or modification time (with --preserve, the times must match as they
+// are carried over; otherwise the destination must merely be no older). With
+// --verify, files which agree in both are also compared byte for byte.
+//
+// Each file is copied to a temporary file beside its destination which then
+// replaces it, so an interrupted sync never leaves a partial file behind.
+// The copiers use the platform file calls directly, as the file error state
+// of FileReader and FileWriter is shared by all threads.
+//
+// Extraneous destination entries are only deleted (--delete-extra) once the
+// copying is done and then only if the whole source could be read. Directory
+// attributes are preserved last of all since filling or emptying a directory
+// changes its modification time.
+
+const Size SYNC_SLOTS = 64;             // planned copies not yet taken
+const Size POLL_MSECS = 50;
+const char TEMP_EXT[] = ".sync~";
+
+struct SyncJob
+{
+    char        src[UPATH_MAX + 1];
+    char        dst[UPATH_MAX + 1];
+    Int64       size;
+};
+
+struct Copier
+{
+    Thread      thread;
+    Uint8*      buf;
+};
+
+struct PathList
+{
+    Arena       text;                   // paths (which never move)
+    const char** paths;
+    Size        count;
+    Size        cap;
+};
+
+static SyncJob* queue = 0;              // ring of SYNC_SLOTS jobs
+static Size     head = 0;               // jobs taken
+static Size     tail = 0;               // jobs planned
+static bool     planned = false;        // no more jobs to come
+static Mutex    mutex;                  // guards queue and lists
+static Cond     cond;                   // queue changed
+
+static Copier   crew[THREADS_MAX];
+static Size     crewSize = 0;
+static Uint8*   checks[THREADS_MAX];    // per walker thread (--verify)
+static Size     bufSize = 0;
+
+static const char* srcRoot = 0;
+static const char* dstRoot = 0;
+static Size     srcSkip = 0;            // length of root prefix of paths
+static Size     dstSkip = 0;
+static bool     preserve = false;
+static bool     verify = false;
+
+static PathList notes;                  // failures found by other threads
+static Size     flushed = 0;            // notes output so far
+static PathList dirs;                   // directories (relative) for -p
+static PathList doomed;                 // extraneous directories
+
+static Int64    plannedFiles = 0;
+static Int64    plannedBytes = 0;
+static Int64    finished = 0;           // jobs done (or failed)
+static Int64    copied = 0;
+static Int64    bytes = 0;              // bytes written
+static Int64    unchanged = 0;
+static Int64    created = 0;            // directories
+static Int64    deleted = 0;
+static Int64    skipped = 0;            // links and other entries
+static Int64    errors = 0;
+
+static Progress progress;
+
+static Size skipOf(const char* root);
+static bool join(char* path, const char* root, const char* rel);
+static bool visitSource(const WalkEntry& entry, Size worker, void* arg);
+static bool visitTarget(const WalkEntry& entry, Size worker, void* arg);
+static bool isChanged(const WalkEntry& entry, const FileInfo& info, const char* dst, Size worker);
+static bool isSame(const char* a, const char* b, Int64 size, Uint8* buf);
+static void plan(const char* src, const char* dst, Int64 size);
+static void work(void* arg);
+static bool copyFile(const char* src, const char* dst, Uint8* buf);
+static void note(const char* fmt, const char* path);
+static void listAdd(PathList& list, const char* path);
+static void listFree(PathList& list);
+static void flush();
+static void poll(void* arg);
+static void report();
+
+void sync()
+{
+    Walker      walker;
+    FileInfo    info;
+    char        src[UPATH_MAX + 1];
+    char        dst[UPATH_MAX + 1];
+    bool        isDir;
+    Size        n;
+
+    ASSERT(cmd.params.count == 2);
+
+    srcRoot = cmd.params[0].cb();
+    dstRoot = cmd.params[1].cb();
+
+    if ( fileInfo(srcRoot, info) < 0 || ( info.type != ET_FILE && info.type != ET_DIR ) ) xer(XE_CMDPRM, srcRoot);
+
+    isDir = info.type == ET_DIR;
+
+    // a directory is synchronised into a directory of its own
+
+    if ( fileInfo(dstRoot, info) < 0 )
+    {
+        if ( isDir && makeDir(dstRoot) < 0 ) xer(XE_CMDPRM, dstRoot);
+        if ( isDir ) created++;
+    }
+    else if ( info.type != ( isDir ? ET_DIR : ET_FILE ) )
+    {
+        xer(XE_CMD, "cannot sync file with directory");
+    }
+
+    outA("synchronising");
+
+    preserve = cmd.options.preserve;
+    verify = cmd.options.verify;
+    srcSkip = skipOf(srcRoot);
+    dstSkip = skipOf(dstRoot);
+
+    crewSize = cmd.env.threads;
+    if ( crewSize < 1 ) crewSize = 1;
+    if ( crewSize > THREADS_MAX ) crewSize = THREADS_MAX;
+
+    bufSize = cmd.options.bufferSize * cmd.env.chunkSize;
+
+    memAlloc(&queue, SYNC_SLOTS * sizeof(SyncJob));
+
+    progress.unitQty = QN_BYTES;
+    progress.itemQty = QN_FILES;
+    progress.hitsQty = QN_ERRORS;
+    progress.hits = 0;
+    progress.snip = srcRoot;
+    progress.overall.units.estimate = 0;
+    progress.overall.units.complete = 0;
+    progress.overall.items.estimate = 0;
+    progress.overall.items.complete = 0;
+    progress.current.units.estimate = 0;
+    progress.current.units.complete = 0;
+    progress.status = PS_INIT;
+
+    outP(progress);
+
+    // the crew is ready before the first job is planned
+
+    head = 0;
+    tail = 0;
+    planned = false;
+    flushed = 0;
+
+    for ( Size i = 0; i < crewSize; i++ ) crew[i].thread.start(work, &crew[i]);
+
+    if ( isDir && preserve ) listAdd(dirs, "");
+
+    walker.configure();
+    walker.setFields(FF_SIZE | FF_MTIME);
+    walker.walk(srcRoot, visitSource, 0, poll);
+
+    mutex.lock();
+    planned = true;
+    cond.broadcast();
+    mutex.unlock();
+
+    while ( atomicGet(&finished) < atomicGet(&plannedFiles) )
+    {
+        poll(0);
+        milliSleep(POLL_MSECS);
+    }
+
+    for ( Size i = 0; i < crewSize; i++ ) crew[i].thread.join();
+
+    flush();
+
+    for ( Size j = 0; j < walker.failures(); j++ )
+    {
+        outP();
+        oufW("cannot read: %s", walker.failure(j));
+        errors++;
+    }
+
+    // nothing may be deleted on the strength of a partial view of the source
+
+    if ( cmd.options.deleteExtra && isDir )
+    {
+        if ( walker.failures() != 0 )
+        {
+            outP();
+            outW("extraneous entries not deleted as source could not be read");
+        }
+        else
+        {
+            progress.snip = dstRoot;
+
+            walker.configure();
+            walker.setFields(FF_SIZE);
+            walker.walk(dstRoot, visitTarget, 0, poll);
+
+            flush();
+
+            for ( Size j = 0; j < walker.failures(); j++ )
+            {
+                outP();
+                oufW("cannot read: %s", walker.failure(j));
+                errors++;
+            }
+
+            // directories were listed before their contents
+
+            for ( n = doomed.count; n > 0; n-- )
+            {
+                const char* path = doomed.paths[n-1];
+
+                if ( dirRemove(path) < 0 )
+                {
+                    outP();
+                    oufW("cannot delete: %s", path);
+                    errors++;
+                }
+                else deleted++;
+            }
+        }
+    }
+
+    for ( n = dirs.count; n > 0; n-- )
+    {
+        const char* rel = dirs.paths[n-1];
+
+        if ( join(src, srcRoot, rel) && join(dst, dstRoot, rel) && fileCopyAttrs(src, dst) < 0 )
+        {
+            outP();
+            oufW("cannot preserve: %s", dst);
+            errors++;
+        }
+    }
+
+    poll(0);
+    progress.status = PS_FINAL;
+    outP(progress);
+
+    for ( Size i = 0; i < THREADS_MAX; i++ )
+    {
+        if ( checks[i] != 0 ) bufFree(&checks[i], 2 * bufSize);
+    }
+
+    memFree(&queue, SYNC_SLOTS * sizeof(SyncJob));
+
+    listFree(notes);
+    listFree(dirs);
+    listFree(doomed);
+
+    report();
+}
+
+// entry paths are the root (less trailing separators) and a separator
+
+static Size skipOf(const char* root)
+{
+    Size n = strlen(root);
+
+    while ( n > 1 && ( root[n-1] == '/' || root[n-1] == PATH_SEP ) ) n--;
+
+    return ( root[n-1] == '/' || root[n-1] == PATH_SEP ) ? n : n + 1;
+}
+
+// joins a path relative to either root onto either root
+
+static bool join(char* path, const char* root, const char* rel)
+{
+    int r;
+
+    if ( *rel == 0 ) r = snprintfz(path, UPATH_MAX, "%s", root);
+    else r = snprintfz(path, UPATH_MAX, "%.*s%c%s", (int) (skipOf(root) - 1), root, PATH_SEP, rel);
+
+    return r >= 0 && path[0] != 0;
+}
+
+// called by walker threads: directories are created at once so that the
+// copiers never wait for them
+
+static bool visitSource(const WalkEntry& entry, Size worker, void* arg)
+{
+    char        dst[UPATH_MAX + 1];
+    FileInfo    info;
+
+    (void) arg;
+
+    const char* rel = entry.depth == 0 ? "" : entry.path + srcSkip;
+
+    if ( !join(dst, dstRoot, rel) )
+    {
+        note("path too long: %s", entry.path);
+        return false;
+    }
+
+    switch ( entry.info.type )
+    {
+        case ET_DIR:
+
+            if ( fileInfo(dst, info) < 0 )
+            {
+                if ( makeDir(dst) < 0 )
+                {
+                    note("cannot create: %s", dst);
+                    return false;
+                }
+
+                atomicAdd(&created, (Int64) 1);
+            }
+            else if ( info.type != ET_DIR )
+            {
+                note("cannot replace: %s", dst);
+                return false;
+            }
+
+            if ( preserve )
+            {
+                mutex.lock();
+                listAdd(dirs, rel);
+                mutex.unlock();
+            }
+
+            return true;
+
+        case ET_FILE:
+
+            if ( fileInfo(dst, info, FF_SIZE | FF_MTIME) == 0 )
+            {
+                if ( info.type != ET_FILE )
+                {
+                    note("cannot replace: %s", dst);
+                    return true;
+                }
+
+                if ( !isChanged(entry, info, dst, worker) )
+                {
+                    atomicAdd(&unchanged, (Int64) 1);
+                    return true;
+                }
+            }
+
+            plan(entry.path, dst, entry.info.size);
+            return true;
+
+        default:
+
+            atomicAdd(&skipped, (Int64) 1);
+            return true;
+    }
+}
+
+// called by walker threads for destination entries: whatever has no
+// counterpart in the source goes
+
+static bool visitTarget(const WalkEntry& entry, Size worker, void* arg)
+{
+    char        src[UPATH_MAX + 1];
+    FileInfo    info;
+
+    (void) worker;
+    (void) arg;
+
+    if ( entry.depth == 0 ) return true;
+
+    if ( !join(src, srcRoot, entry.path + dstSkip) || fileInfo(src, info) == 0 ) return true;
+
+    if ( entry.info.type == ET_DIR )
+    {
+        mutex.lock();
+        listAdd(doomed, entry.path);
+        mutex.unlock();
+        return true;
+    }
+
+    if ( fileRemove(entry.path) < 0 ) note("cannot delete: %s", entry.path);
+    else atomicAdd(&deleted, (Int64) 1);
+
+    return true;
+}
+
+static bool isChanged(const WalkEntry& entry, const FileInfo& info, const char* dst, Size worker)
+{
+    if ( info.size != entry.info.size ) return true;
+
+    if ( preserve ? info.mtime != entry.info.mtime : info.mtime < entry.info.mtime ) return true;
+
+    // buffers are mapped by the threads which use them (see --buffer-pages)
+
+    if ( verify )
+    {
+        if ( checks[worker] == 0 ) bufAlloc(&checks[worker], 2 * bufSize);
+
+        return !isSame(entry.path, dst, info.size, checks[worker]);
+    }
+
+    return false;
+}
+
+// a file which cannot be read is taken to differ and the copy reports it
+
+static bool isSame(const char* a, const char* b, Int64 size, Uint8* buf)
+{
+    File*   f;
+    File*   g;
+    Size    n;
+    bool    same;
+
+    if ( ( f = fileOpen(a, "rb") ) == 0 ) return false;
+
+    if ( ( g = fileOpen(b, "rb") ) == 0 )
+    {
+        fileClose(f);
+        return false;
+    }
+
+    for ( same = true; same && size > 0; size -= (Int64) n )
+    {
+        n = size > (Int64) bufSize ? bufSize : (Size) size;
+
+        same = fileRead(buf, 1, n, f) == n && fileRead(buf + bufSize, 1, n, g) == n
+            && skipSame(buf, buf + bufSize, n) == n;
+    }
+
+    fileClose(g);
+    fileClose(f);
+
+    return same;
+}
+
+// waits while the queue is full so the plan never runs far ahead of copying
+
+static void plan(const char* src, const char* dst, Int64 size)
+{
+    mutex.lock();
+
+    while ( tail - head == SYNC_SLOTS ) cond.wait(mutex);
+
+    SyncJob& job = queue[tail % SYNC_SLOTS];
+
+    strncpyz(job.src, src, UPATH_MAX);
+    strncpyz(job.dst, dst, UPATH_MAX);
+    job.size = size;
+
+    tail++;
+    atomicAdd(&plannedFiles, (Int64) 1);
+    atomicAdd(&plannedBytes, size);
+
+    cond.broadcast();
+    mutex.unlock();
+}
+
+static void work(void* arg)
+{
+    Copier*     copier = (Copier*) arg;
+    SyncJob     job;
+
+    bufAlloc(&copier->buf, bufSize);
+
+    for (;;)
+    {
+        mutex.lock();
+
+        while ( head == tail && !planned ) cond.wait(mutex);
+
+        if ( head == tail )
+        {
+            mutex.unlock();
+            break;
+        }
+
+        job = queue[head % SYNC_SLOTS];
+        head++;
+
+        cond.broadcast();
+        mutex.unlock();
+
+        if ( copyFile(job.src, job.dst, copier->buf) ) atomicAdd(&copied, (Int64) 1);
+
+        atomicAdd(&finished, (Int64) 1);
+    }
+
+    bufFree(&copier->buf, bufSize);
+}
+
+static bool copyFile(const char* src, const char* dst, Uint8* buf)
+{
+    char    tmp[UPATH_MAX + 1];
+    File*   f;
+    File*   g;
+    Size    n;
+    bool    ok;
+
+    if ( snprintfz(tmp, UPATH_MAX, "%s%s", dst, TEMP_EXT) < 0 || tmp[0] == 0 )
+    {
+        note("path too long: %s", dst);
+        return false;
+    }
+
+    if ( ( f = fileOpen(src, "rb") ) == 0 )
+    {
+        note("cannot read: %s", src);
+        return false;
+    }
+
+    if ( ( g = fileOpen(tmp, "wb") ) == 0 )
+    {
+        fileClose(f);
+        note("cannot write: %s", dst);
+        return false;
+    }
+
+    ok = true;
+
+    while ( ok && ( n = fileRead(buf, 1, bufSize, f) ) > 0 )
+    {
+        ok = fileWrite(buf, 1, n, g) == n;
+        atomicAdd(&bytes, (Int64) n);
+    }
+
+    if ( fileClose(g) != 0 ) ok = false;
+    fileClose(f);
+
+    if ( !ok || fileReplace(tmp, dst) < 0 )
+    {
+        fileRemove(tmp);
+        note("cannot write: %s", dst);
+        return false;
+    }
+
+    if ( preserve && fileCopyAttrs(src, dst) < 0 ) note("cannot preserve: %s", dst);
+
+    return true;
+}
+
+// channels belong to the main thread so other threads leave notes for it
+
+static void note(const char* fmt, const char* path)
+{
+    char msg[UPATH_MAX + 32];
+
+    snprintfz(msg, sizeof(msg) - 1, fmt, path);
+
+    mutex.lock();
+    listAdd(notes, msg);
+    mutex.unlock();
+
+    atomicAdd(&errors, (Int64) 1);
+}
+
+static void listAdd(PathList& list, const char* path)
+{
+    Size    cap;
+
+    if ( list.count == list.cap )
+    {
+        cap = list.cap == 0 ? 1024 : list.cap * 2;
+
+        if ( list.paths == 0 ) memAlloc(&list.paths, cap * sizeof(const char*));
+        else memRealloc(&list.paths, cap * sizeof(const char*), list.cap * sizeof(const char*));
+
+        list.cap = cap;
+    }
+
+    list.paths[list.count++] = list.text.strDup(path, strlen(path));
+}
+
+static void listFree(PathList& list)
+{
+    list.text.release();
+
+    if ( list.paths != 0 ) memFree(&list.paths, list.cap * sizeof(const char*));
+
+    list.count = 0;
+    list.cap = 0;
+}
+
+// outputs notes left since the last flush (main thread only); notes stay put
+// once added but the list of them may be growing in another thread
+
+static void flush()
+{
+    const char* msg;
+
+    for (;;)
+    {
+        mutex.lock();
+        msg = flushed < notes.count ? notes.paths[flushed++] : 0;
+        mutex.unlock();
+
+        if ( msg == 0 ) break;
+
+        outP();
+        outW(msg);
+    }
+}
+
+static void poll(void* arg)
+{
+    (void) arg;
+
+    progress.overall.units.estimate = atomicGet(&plannedBytes);
+    progress.overall.units.complete = atomicGet(&bytes);
+    progress.overall.items.estimate = atomicGet(&plannedFiles);
+    progress.overall.items.complete = atomicGet(&finished);
+    progress.hits = atomicGet(&errors);
+
+    outP(progress);
+    progress.status = PS_NORMAL;
+
+    flush();
+}
+
+static void report()
+{
+    char    s[FMT_NUM_MAX + 1];
+    int     w;
+
+    if ( cmd.options.rawReporting ) return;
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_FILES, copied);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("copied    : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_BYTES, bytes);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("bytes     : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_FILES, unchanged);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("unchanged : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_DIRS, created);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("created   : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ITEMS, deleted);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("deleted   : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ITEMS, skipped);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("skipped   : %s", s);
+
+    w = format(s, FMT_NUM_MAX, FS_AUTO, QN_ERRORS, errors);
+    ASSERT_ALWAYS(w >= 0);
+    oufR("errors    : %s", s);
+
+    outR();
+}
+
+// EOF
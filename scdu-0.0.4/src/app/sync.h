@@ -0,0 +1,12 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined SYNC_H
+
+    #define SYNC_H
+
+    extern void sync();
+
+#endif // SYNC_H
+
+// EOF
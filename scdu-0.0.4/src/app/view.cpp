@@ -1,79 +1,527 @@
 // Copyright 2015-2016 RVJ Callanan.
 // Released under the GNU General Public License (Version 3).
 
-#include <stdlib.h>
+#include <string.h>
 
 #include "../core/core.h"
-#include "../alg/match.h"
+#include "../alg/scan.h"
+#include "../ffs/file.h"
+#include "../ffs/lines.h"
 
 #include "view.h"
 
+// Lines are formatted from lookup tables straight into a large output block
+// which goes to the R channel in one call when full. Each hex cell is copied
+// as a single 4-byte entry (the surplus byte is overwritten by whatever comes
+// next) so there is no per-byte printf or nibble arithmetic. Lines never span
+// reader buffers except at the end of a window, where a short carry is used.
+//
+// Viewing by line uses a sidecar index of line offsets (see ffs/lines) to
+// seek near the first line wanted. Lines are located a buffer at a time
+// with skipLines() and any new index entries found on the way are saved.
+
+const Size VIEW_COLS = 16;              // bytes per line
+const Size VIEW_RAW_COLS = 32;          // bytes per line (raw reporting)
+const Size VIEW_BLOCK = 64 * 1024;      // output block
+const Size VIEW_LINE_MAX = 96;          // longest formatted line
+const char* const VIEW_INDEX_EXT = ".lix";
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static char     hexCells[256][4];       // "xx " for each byte value
+static char     textChars[256];         // printable character or '.'
+
+static LineIndex lineIndex;
+static char*    block = 0;
+static Size     blockLen = 0;
+static Size     offsetWidth = 0;
+static bool     raw = false;
+
 static Progress progress;
 
+static void viewHex(FileReader& reader, const char* src);
+static void viewLines(FileReader& reader, const char* src);
+static void parseLines(const char* s, Int64& first, Int64& last);
+static void putText(const Uint8* p, Size n);
+static void putNumber(Int64 n, Size width);
+static void initTables();
+static void putLine(Int64 offset, const Uint8* p, Size n);
+static void putOffset(Int64 offset);
+static void flush();
+
 void view()
 {
-    ASSERT_ALWAYS( isMatchCS("*match*", "match") );
+    FileReader  reader;                 // not static: xer() must not destroy it
+
+    ASSERT(cmd.params.count == 1);
 
-    const Size MAX_SNIP = 60;
-    char snip[MAX_SNIP+1];
+    const char* src = cmd.params[0].cb();
 
     outA("viewing");
 
-    const Int64 cue = 512;
-    const Int64 cus = 512;
+    raw = cmd.options.rawReporting;
+
+    reader.reserve(cmd.options.bufferSize);
+    memAlloc(&block, VIEW_BLOCK);
+    blockLen = 0;
+
+    if ( cmd.options.lines.len() != 0 ) viewLines(reader, src);
+    else viewHex(reader, src);
+
+    memFree(&block, VIEW_BLOCK);
+    reader.release();
+}
+
+static void viewHex(FileReader& reader, const char* src)
+{
+    Uint8       carry[VIEW_RAW_COLS];
+    Size        carryLen, cols, n, used;
+    Int64       size, start, end, pos, line;
+    const Uint8* p;
 
-    const Int64 oie = 1234;
-    const Int64 oue = oie * cue;
+    cols = raw ? VIEW_RAW_COLS : VIEW_COLS;
+
+    initTables();
+
+    reader.open(src);
+    if ( fen ) xer(XE_FILE, fem);
+
+    // clip window to file; a window beyond the end is simply empty
+
+    size = reader.size();
+    start = cmd.options.offset < size ? cmd.options.offset : size;
+    end = size;
+
+    if ( cmd.options.length != 0 && cmd.options.length < end - start )
+    {
+        end = start + cmd.options.length;
+    }
+
+    // offsets are as wide as the last one needs (at least 8 digits)
+
+    offsetWidth = 8;
+    while ( offsetWidth < 16 && (end >> (4 * offsetWidth)) != 0 ) offsetWidth++;
 
     progress.unitQty = QN_BYTES;
     progress.itemQty = QN_FILES;
-    progress.hitsQty = QN_MATCHES;
-
+    progress.hitsQty = QN_LINES;
     progress.hits = 0;
-    progress.snip = 0;
-
-    progress.overall.items.estimate = oie;
-    progress.overall.items.complete = 0;
-    progress.overall.units.estimate = oue;
+    progress.snip = src;
+    progress.overall.units.estimate = end - start;
     progress.overall.units.complete = 0;
-
-    progress.current.units.estimate = cue;
+    progress.overall.items.estimate = 1;
+    progress.overall.items.complete = 0;
+    progress.current.units.estimate = end - start;
     progress.current.units.complete = 0;
-
     progress.status = PS_INIT;
 
-    for ( Int64 i = 1; i <= oie; i++ )
+    outP(progress);
+
+    // seek directly to the window rather than reading up to it
+
+    if ( start != 0 )
     {
-        snprintfz(snip, MAX_SNIP, "This is a long file name with an index number " F64d(), i);
+        reader.seek(start);
+        if ( fen ) xer(XE_FILE, fem);
+    }
+
+    pos = start;
+    line = start;
+    carryLen = 0;
+
+    while ( pos < end )
+    {
+        if ( reader.len() == 0 )
+        {
+            reader.fill();
+            if ( fen ) xer(XE_FILE, fem);
+
+            progress.overall.units.complete = pos - start;
+            progress.current.units.complete = pos - start;
+            outP(progress);
+            progress.status = PS_NORMAL;
+        }
 
-        progress.snip = snip;
-        progress.current.units.complete = 0;
+        p = reader.data();
+        n = reader.len();
+        if ( (Int64) n > end - pos ) n = (Size) (end - pos);
 
-        for ( Int64 c = 0; c < cue; c += cus )
+        used = n;
+
+        if ( carryLen != 0 )
         {
-            progress.current.units.complete += cus;
-            progress.overall.units.complete += progress.current.units.complete;
+            Size k = cols - carryLen < n ? cols - carryLen : n;
 
-            progress.hits += ( rand() % 100 );
+            memcpy(carry + carryLen, p, k);
+            carryLen += k;
+            p += k;
+            n -= k;
 
-            if ( c + cus >= cue )
+            if ( carryLen == cols )
             {
-                progress.overall.items.complete += 1;
+                putLine(line, carry, cols);
+                line += cols;
+                carryLen = 0;
             }
+        }
 
-            outP(progress);
+        while ( n >= cols )
+        {
+            putLine(line, p, cols);
+            line += cols;
+            p += cols;
+            n -= cols;
+        }
+
+        if ( n != 0 )
+        {
+            memcpy(carry, p, n);
+            carryLen = n;
+        }
 
+        reader.drop(used);
+        pos += used;
+    }
+
+    if ( carryLen != 0 ) putLine(line, carry, carryLen);
+
+    // like hexdump, finish with the offset just past the window
+
+    if ( !raw && end > start )
+    {
+        if ( blockLen + VIEW_LINE_MAX > VIEW_BLOCK ) flush();
+        putOffset(end);
+        block[blockLen++] = '\n';
+    }
+
+    flush();
+
+    progress.overall.units.complete = end - start;
+    progress.overall.items.complete = 1;
+    progress.current.units.complete = end - start;
+    progress.status = PS_FINAL;
+    outP(progress);
+
+    reader.close();
+}
+
+static void viewLines(FileReader& reader, const char* src)
+{
+    FileInfo    info;
+    Str         path;
+    Int64       first, last, line, at, offset, base;
+    Size        n, off, adv, count, want, width;
+    bool        midLine;
+    const Uint8* p;
+
+    parseLines(cmd.options.lines.cb(), first, last);
+
+    if ( fileInfo(src, info, FF_SIZE | FF_MTIME) < 0 ) xer(XE_CMDPRM, src);
+    if ( info.type != ET_FILE ) xer(XE_CMDPRM, src);
+
+    // start from the nearest indexed line (line 1 if there is no index)
+
+    path = src;
+    path += VIEW_INDEX_EXT;
+
+    lineIndex.open(path.cb(), info);
+    lineIndex.find(first, at, offset);
+
+    reader.open(src);
+    if ( fen ) xer(XE_FILE, fem);
+
+    if ( offset > reader.size() ) offset = reader.size();
+
+    if ( offset != 0 )
+    {
+        reader.seek(offset);
+        if ( fen ) xer(XE_FILE, fem);
+    }
+
+    // line numbers are as wide as the last one needs (at least 6 digits)
+
+    width = 6;
+    for ( Int64 v = last == INT64_VAL_MAX ? first : last; v >= 1000000; v /= 10 ) width++;
+
+    progress.unitQty = QN_BYTES;
+    progress.itemQty = QN_FILES;
+    progress.hitsQty = QN_LINES;
+    progress.hits = 0;
+    progress.snip = src;
+    progress.overall.units.estimate = reader.size() - offset;
+    progress.overall.units.complete = 0;
+    progress.overall.items.estimate = 1;
+    progress.overall.items.complete = 0;
+    progress.current.units.estimate = reader.size() - offset;
+    progress.current.units.complete = 0;
+    progress.status = PS_INIT;
+
+    outP(progress);
+
+    line = at;                          // line which starts at reader.pos()
+    midLine = false;                    // part of line already output
+
+    while ( reader.pos() < reader.size() && line <= last )
+    {
+        if ( reader.len() == 0 )
+        {
+            reader.fill();
+            if ( fen ) xer(XE_FILE, fem);
+
+            progress.overall.units.complete = reader.pos() - offset;
+            progress.current.units.complete = reader.pos() - offset;
+            outP(progress);
             progress.status = PS_NORMAL;
+        }
+
+        p = reader.data();
+        n = reader.len();
+        base = reader.pos();
+        off = 0;
+
+        while ( off < n && line <= last )
+        {
+            if ( !midLine ) lineIndex.add(line, base + (Int64) off);
+
+            if ( line < first )
+            {
+                // skip to the first line wanted or the next line to be
+                // indexed, whichever comes sooner
+
+                want = LINE_STRIDE - (Size) ((line - 1) % (Int64) LINE_STRIDE);
+                if ( first - line < (Int64) want ) want = (Size) (first - line);
 
-            milliSleep(rand() % 10);
+                count = want;
+                off += skipLines(p + off, n - off, count);
+                line += (Int64) (want - count);
+                continue;
+            }
+
+            // output one line (or as much of it as is buffered)
+
+            count = 1;
+            adv = skipLines(p + off, n - off, count);
+
+            if ( !midLine && !raw ) putNumber(line, width);
+
+            putText(p + off, adv);
+            off += adv;
+
+            if ( count == 0 )
+            {
+                line++;
+                midLine = false;
+                progress.hits++;
+            }
+            else
+            {
+                midLine = true;
+            }
         }
+
+        reader.drop(off);
     }
 
+    // final line may lack a newline
+
+    if ( midLine )
+    {
+        putText((const Uint8*) "\n", 1);
+        progress.hits++;
+    }
+
+    flush();
+
+    // the range may end well before the file does, so the final update
+    // is based on what was read rather than the estimate
+
+    progress.overall.units.complete = reader.pos() - offset;
+    progress.overall.units.estimate = progress.overall.units.complete;
+    progress.overall.items.complete = 1;
+    progress.current.units.complete = progress.overall.units.complete;
+    progress.current.units.estimate = progress.overall.units.complete;
     progress.status = PS_FINAL;
     outP(progress);
 
-    outR("OK");
-    outR();
+    reader.close();
+
+    if ( !lineIndex.save() ) oufW("cannot save line index: %s", path.cb());
+
+    lineIndex.close();
+}
+
+// Accepts a..b, a.. or a (lines are numbered from 1).
+
+static void parseLines(const char* s, Int64& first, Int64& last)
+{
+    char        a[INT64_DEC_MAX + 1];
+    const char* dots;
+    Size        n;
+
+    dots = strstr(s, "..");
+    n = dots == 0 ? strlen(s) : (Size) (dots - s);
+
+    if ( n == 0 || n > (Size) INT64_DEC_MAX ) xer(XE_CMD, "invalid line range");
+
+    memcpy(a, s, n);
+    a[n] = 0;
+
+    parse(a, QN_DEC, first);
+    if ( pen || first < 1 ) xer(XE_CMD, "invalid line range");
+
+    if ( dots == 0 )
+    {
+        last = first;
+    }
+    else if ( dots[2] == 0 )
+    {
+        last = INT64_VAL_MAX;
+    }
+    else
+    {
+        parse(dots + 2, QN_DEC, last);
+        if ( pen || last < first ) xer(XE_CMD, "invalid line range");
+    }
+}
+
+// Copies line content into the output block, dropping CR from CRLF endings
+// since the output stream applies its own newline convention.
+
+static void putText(const Uint8* p, Size n)
+{
+    Size k;
+
+    if ( n != 0 && p[n - 1] == '\n' && n >= 2 && p[n - 2] == '\r' )
+    {
+        putText(p, n - 2);
+        p += n - 1;
+        n = 1;
+    }
+
+    while ( n != 0 )
+    {
+        if ( blockLen == VIEW_BLOCK ) flush();
+
+        k = VIEW_BLOCK - blockLen < n ? VIEW_BLOCK - blockLen : n;
+
+        memcpy(block + blockLen, p, k);
+        blockLen += k;
+        p += k;
+        n -= k;
+    }
+}
+
+static void putNumber(Int64 n, Size width)
+{
+    char    s[INT64_DEC_MAX + 2];
+    Size    i;
+
+    if ( blockLen + width + 2 > VIEW_BLOCK ) flush();
+
+    // right-aligned like cat -n, but followed by two spaces
+
+    i = sizeof(s);
+    do { s[--i] = (char) ('0' + n % 10); n /= 10; } while ( n != 0 );
+    while ( sizeof(s) - i < width ) s[--i] = ' ';
+
+    memcpy(block + blockLen, s + i, sizeof(s) - i);
+    blockLen += sizeof(s) - i;
+    block[blockLen++] = ' ';
+    block[blockLen++] = ' ';
+}
+
+static void initTables()
+{
+    for ( Size i = 0; i < 256; i++ )
+    {
+        hexCells[i][0] = hexDigits[i >> 4];
+        hexCells[i][1] = hexDigits[i & 15];
+        hexCells[i][2] = ' ';
+        hexCells[i][3] = ' ';
+
+        textChars[i] = ( i >= 0x20 && i < 0x7F ) ? (char) i : '.';
+    }
+}
+
+static void putLine(Int64 offset, const Uint8* p, Size n)
+{
+    char* o;
+
+    if ( blockLen + VIEW_LINE_MAX > VIEW_BLOCK ) flush();
+
+    if ( raw )
+    {
+        // plain hex as for xxd -p
+
+        o = block + blockLen;
+
+        for ( Size i = 0; i < n; i++ )
+        {
+            memcpy(o, hexCells[p[i]], 4);
+            o += 2;
+        }
+
+        *o++ = '\n';
+
+        blockLen = o - block;
+        progress.hits++;
+        return;
+    }
+
+    // canonical layout as for hexdump -C
+
+    putOffset(offset);
+
+    o = block + blockLen;
+
+    *o++ = ' ';
+    *o++ = ' ';
+
+    for ( Size i = 0; i < VIEW_COLS; i++ )
+    {
+        if ( i == VIEW_COLS / 2 ) *o++ = ' ';
+
+        if ( i < n ) memcpy(o, hexCells[p[i]], 4);
+        else memcpy(o, "    ", 4);
+
+        o += 3;
+    }
+
+    *o++ = ' ';
+    *o++ = '|';
+
+    for ( Size i = 0; i < n; i++ ) *o++ = textChars[p[i]];
+
+    *o++ = '|';
+    *o++ = '\n';
+
+    blockLen = o - block;
+    progress.hits++;
+}
+
+static void putOffset(Int64 offset)
+{
+    Uint64  v;
+    char*   o;
+
+    v = (Uint64) offset;
+    o = block + blockLen;
+
+    for ( Size i = offsetWidth; i > 0; i-- )
+    {
+        o[i - 1] = hexDigits[v & 15];
+        v >>= 4;
+    }
+
+    blockLen += offsetWidth;
+}
+
+static void flush()
+{
+    if ( blockLen == 0 ) return;
+
+    outR(block, blockLen);
+    blockLen = 0;
 }
 
-// EOF
\ No newline at end of file
+// EOF
@@ -6,8 +6,7 @@
 
 #include "core.h"
 
-static const bool sharedConsole =   cmd.env.consoleStreams.s &&
-                                    cmd.env.consoleStreams.d;
+static bool sharedConsole = false;      // std and dgn on one console (see openChannels)
 
 static const char* stdNewline = NEWLINE_DEF;
 static const char* dgnNewline = NEWLINE_DEF;
@@ -80,14 +79,19 @@ static bool  routeT = false;
 static void stdPutv(const char* fmt, va_list args);
 static void stdPutc(int c);
 static void stdPuts(const char* s);
+static void stdPutb(const char* s, Size len);
 
 static void dgnPutv(const char* fmt, va_list args);
 static void dgnPutc(int c);
 static void dgnPuts(const char* s);
+static void dgnPutb(const char* s, Size len);
 
 static void logPutv(const char* fmt, va_list args);
 static void logPutc(int c);
 static void logPuts(const char* s);
+static void logPutb(const char* s, Size len);
+
+static void putLines(void (*putb)(const char*, Size), const char* s, Size len, const char* newline);
 
 const ChanDef chanDefs[] =
 {
@@ -135,6 +139,10 @@ void openChannels()
 
     ASSERT(!opened);
 
+    // not known until cmd is initialised, so never in a static initialiser
+
+    sharedConsole = cmd.env.consoleStreams.s && cmd.env.consoleStreams.d;
+
     stdNewline = ns.D ? NEWLINE_DEF : ns.W ? NEWLINE_WIN : NEWLINE_NIX;
     dgnNewline = nd.D ? NEWLINE_DEF : nd.W ? NEWLINE_WIN : NEWLINE_NIX;
     logNewline = nl.D ? NEWLINE_DEF : nl.W ? NEWLINE_WIN : NEWLINE_NIX;
@@ -562,6 +570,18 @@ void oufR(const char* fmt, ...)
     va_end (args);
 }
 
+// Writes a block of complete lines, each terminated by '\n', with as few
+// stream calls as possible. Intended for bulk results such as dumps.
+
+void outR(const char* s, Size len)
+{
+    if ( !routeR ) return;
+
+    if ( stdR ) { putLines(stdPutb, s, len, stdNewline); }
+    if ( dgnR ) { FDB(); putLines(dgnPutb, s, len, dgnNewline); FDE(); }
+    if ( logR ) { putLines(logPutb, s, len, logNewline); }
+}
+
 void outP()
 {
     if ( !routeP ) return;
@@ -1196,6 +1216,18 @@ static void stdPuts(const char* s)
     }
 }
 
+static void stdPutb(const char* s, Size len)
+{
+    if ( stdProgress ) outP();
+
+    stdFlushable = true;
+
+    if ( fwrite(s, 1, len, stdout) != len )
+    {
+        xer(XE_STREAM, "std", "write fail");
+    }
+}
+
 static void stdPutc(int c)
 {
     if ( stdProgress ) outP();
@@ -1232,6 +1264,18 @@ static void dgnPuts(const char* s)
     }
 }
 
+static void dgnPutb(const char* s, Size len)
+{
+    if ( dgnProgress ) outP();
+
+    dgnFlushable = true;
+
+    if ( fwrite(s, 1, len, stderr) != len )
+    {
+        xer(XE_STREAM, "dgn", "write fail");
+    }
+}
+
 static void dgnPutc(const int c)
 {
     if ( dgnProgress ) outP();
@@ -1268,6 +1312,18 @@ static void logPuts(const char* s)
     }
 }
 
+static void logPutb(const char* s, Size len)
+{
+    if ( logProgress ) outP();
+
+    logFlushable = true;
+
+    if ( fwrite(s, 1, len, logout) != len )
+    {
+        xer(XE_STREAM, "log", "write fail");
+    }
+}
+
 static void logPutc(int c)
 {
     if ( logProgress ) outP();
@@ -1280,4 +1336,33 @@ static void logPutc(int c)
     }
 }
 
+static void putLines(void (*putb)(const char*, Size), const char* s, Size len, const char* newline)
+{
+    const char* p;
+    const char* end;
+    Size        n;
+
+    // a block already in the stream's newline convention goes out in one
+
+    if ( newline[0] == '\n' && newline[1] == 0 )
+    {
+        putb(s, len);
+        return;
+    }
+
+    n = strlen(newline);
+    end = s + len;
+
+    while ( s < end )
+    {
+        p = (const char*) memchr(s, '\n', (Size) (end - s));
+        if ( p == 0 ) p = end;
+
+        putb(s, (Size) (p - s));
+        if ( p < end ) putb(newline, n);
+
+        s = p + 1;
+    }
+}
+
 // EOF
\ No newline at end of file
@@ -115,6 +115,7 @@ extern void outR();
 extern void outR(const char* s);
 extern void ouvR(const char* fmt, va_list args);
 extern void oufR(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+extern void outR(const char* s, Size len);
 
 extern void outP();
 extern void outP(Progress& p);
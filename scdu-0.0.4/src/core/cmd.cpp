@@ -44,30 +44,55 @@ const EnvDef envDefs[] =
 {
     {   ENV_CS,     "chunk-size",       { TYP_INUM, QN_BYTES,   "", "", ""      }   },
     {   ENV_CST,    "console-streams",  { TYP_PICK, QN_PCK,     "", "", "sd"    }   },
+    {   ENV_TH,     "threads",          { TYP_INUM, QN_DEC,     "", "", ""      }   },
     {   ENV_WD,     "work-directory",   { TYP_TEXT, QN_PATH,    "", "", ""      }   }
 };
 
 const ActDef actDefs[] =
 {
+    {   ACT_COMPARE, "compare", 2, 2, "<source> <target>",
+        "compares two files or directory trees and reports differences",
+        "-r -vf photos backup/photos"                               },
+
     {   ACT_COPY, "copy", 2, 2, "<source> <destination>",
         "copies source files or directories to destination",
         "-cf=scdu.cfg -bs=100 myfile.dat mycopy.dat"                },
 
+    {   ACT_DUPES, "dupes", 1, PARAMS_MAX, "<directory> [ <directory> ... ]",
+        "finds files with identical content in one or more directories",
+        "-r -vf photos backup/photos"                               },
+
+    {   ACT_FIND, "find", 1, PARAMS_MAX, "[ <pattern> ] <source> [ <source> ... ]",
+        "finds offsets of a byte pattern in files (? = any, * = gap)",
+        "-r -hx 7f454c46 /usr/lib"                                  },
+
     {   ACT_HELP, "help", 0, 1, "[ <action> ]",
         "provides general or specific help",
         "show"                                                      },
 
     {   ACT_INFO, "info", 1, 1, "<source>",
         "provides useful information about the source",
-        "-rs=R -rd= 192.168.1.1"                                    },
+        "-tp=20 /home"                                              },
 
     {   ACT_SHOW, "show", 1, 1, "acks | authors | contribs | copyright | terms | version",
         "outputs program information",
         "version"                                                   },
 
+    {   ACT_SYNC, "sync", 2, 2, "<source> <destination>",
+        "copies new and changed files from source to destination",
+        "-r -p -dx photos backup/photos"                            },
+
     {   ACT_VIEW, "view", 1, 1, "<source>",
         "displays source in human-readable format",
-        "myfile.dat"                                                }
+        "-of=1Ki -lg=256 myfile.dat"                                },
+
+    #if defined SCDU_MODE_DEBUG
+
+        {   ACT_BENCH, "bench", 1, 1, "<directory>",
+            "counts heap allocations of strings built from paths found",
+            "-r /usr"                                               },
+
+    #endif
 };
 
 const OptDef optDefs[] =
@@ -112,6 +137,14 @@ const OptDef optDefs[] =
         { TYP_INUM, QN_BYTES, "512", "10Mi", "0" },
         "LCM of page sizes of accessible file systems (0 = auto)"   },
 
+    {   OPT_DX, "dx", "delete-extra", "",
+        { TYP_FLAG, QN_FLAG_E, "", "", "" },
+        "delete target entries not in source e.g. for sync"         },
+
+    {   OPT_EX, "ex", "exclude", "",
+        { TYP_TEXT, QN_TEXT, "", "", "" },
+        "skip directory entries matching any pattern (; separated)" },
+
     {   OPT_FD, "fd", "flush-delay", "50",
         { TYP_INUM, QN_MSECS, "1", "100", "" },
         "minimum catch-up time for slow stream flush"               },
@@ -128,10 +161,26 @@ const OptDef optDefs[] =
         { TYP_PICK, QN_PCK, "", "", "sdl" },
         "streams which do not require catch-up time after flush"    },
 
+    {   OPT_HX, "hx", "hex", "",
+        { TYP_FLAG, QN_FLAG_E, "", "", "" },
+        "pattern is pairs of hex digits e.g. for find (? = any)"    },
+
+    {   OPT_IN, "in", "include", "",
+        { TYP_TEXT, QN_TEXT, "", "", "" },
+        "only process files matching any pattern (; separated)"     },
+
     {   OPT_LF, "lf", "log-file", "scdu.log",
         { TYP_TEXT, QN_PATH, "1", "", "" },
         "destination of logged channels (see -rl and -lm options)"  },
 
+    {   OPT_LG, "lg", "length", "0",
+        { TYP_INUM, QN_BYTES, "0", "", "" },
+        "bytes in range e.g. viewed from offset (0 = to end)"       },
+
+    {   OPT_LI, "li", "lines", "",
+        { TYP_TEXT, QN_TEXT, "", "", "" },
+        "range of lines viewed as a..b (<null> = hex dump)"         },
+
     {   OPT_LM, "lm", "log-mode", "",
         { TYP_PICK, QN_PCK, "", "1", "AO" },
         "<null> = disabled; A = append; O = overwrite;"             },
@@ -148,10 +197,22 @@ const OptDef optDefs[] =
         { TYP_PICK, QN_PCK, "1", "1", "DWN" },
         "Default; Windows(CRLF); Nix(LF)"                           },
 
+    {   OPT_OF, "of", "offset", "0",
+        { TYP_INUM, QN_BYTES, "0", "", "" },
+        "start of byte range e.g. viewed (see -lg option)"          },
+
     {   OPT_PF, "pf", "progress-feed", "IF",
         { TYP_PICK, QN_PCK, "", "", "IUF" },
         "<null> = never; Interrupts; Updates; Final"                },
 
+    {   OPT_PG, "pg", "buffer-pages", "",
+        { TYP_PICK, QN_PCK, "", "", "HL" },
+        "buffer pages: Huge; Local to NUMA node of thread"          },
+
+    {   OPT_PL, "pl", "pattern-list", "",
+        { TYP_TEXT, QN_PATH, "", "", "" },
+        "file of patterns found in one pass e.g. by find (see -hx)" },
+
     {   OPT_PR, "pr", "progress-rate", "0.25",
         { TYP_FNUM, QN_SECS_5V, "0.1", "300.0", "" },
         "minimum time between progress updates"                     },
@@ -184,19 +245,48 @@ const OptDef optDefs[] =
         { TYP_FLAG, QN_FLAG_E, "", "", "" },
         "show bare data in results and summary output"              },
 
+    {   OPT_RH, "rh", "rehash", "",
+        { TYP_FLAG, QN_FLAG_E, "", "", "" },
+        "ignore digests in scan cache and read all content again"   },
+
+    {   OPT_SC, "sc", "scan-cache", "",
+        { TYP_TEXT, QN_PATH, "", "", "" },
+        "file for reusing digests between runs (<null> = none)"     },
+
     {   OPT_SS, "ss", "summary-stats", "",
-        { TYP_PICK, QN_PCK, "", "", "AD" },
-        "Allocs; Duration;"                                         },
+        { TYP_PICK, QN_PCK, "", "", "ABDP" },
+        "Allocs; Buffers; Duration; Profile of allocation sites;"   },
+
+    {   OPT_TH, "th", "threads", "0",
+        { TYP_INUM, QN_DEC, "0", "64", "" },
+        "worker threads for multi-file actions (0 = auto)"          },
+
+    {   OPT_TP, "tp", "top", "10",
+        { TYP_INUM, QN_DEC, "0", "1000", "" },
+        "number of largest items listed e.g. files by info action"  },
+
+    {   OPT_TY, "ty", "types", "",
+        { TYP_FLAG, QN_FLAG_E, "", "", "" },
+        "identify file types from content e.g. by info action"      },
+
+    {   OPT_VF, "vf", "verify", "",
+        { TYP_FLAG, QN_FLAG_E, "", "", "" },
+        "verify content matches byte-by-byte e.g. duplicate files"  },
 
     {   OPT_WD, "wd", "work-directory", "",
         { TYP_TEXT, QN_PATH, "", "", "" },
-        "alternative working directory to calling process"          }
+        "alternative working directory to calling process"          },
+
+    {   OPT_WO, "wo", "walk-order", "D",
+        { TYP_PICK, QN_PCK, "1", "1", "DBI" },
+        "directory walk: Depth-first; Breadth-first; Inode-sorted"  }
 };
 
 Env::Env()
 {
     chunkSize  = 0;
     consoleStreams.all = 0;
+    threads = 0;
     workDirectory = "";
 }
 
@@ -213,6 +303,7 @@ void Env::get(EnvNum envnum, Value& val) const
     {
         case ENV_CS:    val.setInum( (Inum)     chunkSize,      var);   break;
         case ENV_CST:   val.setPick(            consoleStreams, var);   break;
+        case ENV_TH:    val.setInum( (Inum)     threads,        var);   break;
         case ENV_WD:    val.setText(            workDirectory,  var);   break;
 
         default: ASSERT(false);
@@ -282,16 +373,25 @@ void Options::set(OptNum optnum, const Value& val)
         case OPT_BS:    bufferSize      = (Size)    val.inum();     break;
         case OPT_CF:    configFile      =           val.text();     break;
         case OPT_CS:    chunkSize       = (Size)    val.inum();     break;
+        case OPT_DX:    deleteExtra     =           val.flag();     break;
+        case OPT_EX:    exclude         =           val.text();     break;
         case OPT_FD:    flushDelay      = (Size)    val.inum();     break;
         case OPT_FF:    flushFactor     = (Size)    val.inum();     break;
         case OPT_FL:    flushLimit      = (Size)    val.inum();     break;
         case OPT_FST:   fastStreams     =           val.pick();     break;
+        case OPT_HX:    hex             =           val.flag();     break;
+        case OPT_IN:    include         =           val.text();     break;
         case OPT_LF:    logFile         =           val.text();     break;
+        case OPT_LG:    length          =           val.inum();     break;
+        case OPT_LI:    lines           =           val.text();     break;
         case OPT_LM:    logMode         =           val.pick();     break;
         case OPT_NS:    newlineStd      =           val.pick();     break;
         case OPT_ND:    newlineDgn      =           val.pick();     break;
         case OPT_NL:    newlineLog      =           val.pick();     break;
+        case OPT_OF:    offset          =           val.inum();     break;
         case OPT_PF:    progressFeed    =           val.pick();     break;
+        case OPT_PG:    bufferPages     =           val.pick();     break;
+        case OPT_PL:    patternList     =           val.text();     break;
         case OPT_PR:    progressRate    =           val.fnum();     break;
         case OPT_PS:    progressStats   =           val.pick();     break;
         case OPT_PW:    progressWidth   = (Size)    val.inum();     break;
@@ -300,8 +400,15 @@ void Options::set(OptNum optnum, const Value& val)
         case OPT_RL:    routeLog        =           val.pick();     break;
         case OPT_RM:    rateMetric      =           val.pick();     break;
         case OPT_RR:    rawReporting    =           val.flag();     break;
+        case OPT_RH:    rehash          =           val.flag();     break;
+        case OPT_SC:    scanCache       =           val.text();     break;
         case OPT_SS:    summaryStats    =           val.pick();     break;
+        case OPT_TH:    threads         = (Size)    val.inum();     break;
+        case OPT_TP:    top             = (Size)    val.inum();     break;
+        case OPT_TY:    types           =           val.flag();     break;
+        case OPT_VF:    verify          =           val.flag();     break;
         case OPT_WD:    workDirectory   =           val.text();     break;
+        case OPT_WO:    walkOrder       =           val.pick();     break;
 
         default: ASSERT(false);
     }
@@ -328,16 +435,25 @@ void Options::get(OptNum optnum, Value& val) const
         case OPT_BS:    val.setInum( (Inum)     bufferSize,     var);   break;
         case OPT_CF:    val.setText(            configFile,     var);   break;
         case OPT_CS:    val.setInum( (Inum)     chunkSize,      var);   break;
+        case OPT_DX:    val.setFlag(            deleteExtra,    var);   break;
+        case OPT_EX:    val.setText(            exclude,        var);   break;
         case OPT_FD:    val.setInum( (Inum)     flushDelay,     var);   break;
         case OPT_FF:    val.setInum( (Inum)     flushFactor,    var);   break;
         case OPT_FL:    val.setInum( (Inum)     flushLimit,     var);   break;
         case OPT_FST:   val.setPick(            fastStreams,    var);   break;
+        case OPT_HX:    val.setFlag(            hex,            var);   break;
+        case OPT_IN:    val.setText(            include,        var);   break;
         case OPT_LF:    val.setText(            logFile,        var);   break;
+        case OPT_LG:    val.setInum(            length,         var);   break;
+        case OPT_LI:    val.setText(            lines,          var);   break;
         case OPT_LM:    val.setPick(            logMode,        var);   break;
         case OPT_NS:    val.setPick(            newlineStd,     var);   break;
         case OPT_ND:    val.setPick(            newlineDgn,     var);   break;
         case OPT_NL:    val.setPick(            newlineLog,     var);   break;
+        case OPT_OF:    val.setInum(            offset,         var);   break;
         case OPT_PF:    val.setPick(            progressFeed,   var);   break;
+        case OPT_PG:    val.setPick(            bufferPages,    var);   break;
+        case OPT_PL:    val.setText(            patternList,    var);   break;
         case OPT_PR:    val.setFnum(            progressRate,   var);   break;
         case OPT_PS:    val.setPick(            progressStats,  var);   break;
         case OPT_PW:    val.setInum( (Inum)     progressWidth,  var);   break;
@@ -346,8 +462,15 @@ void Options::get(OptNum optnum, Value& val) const
         case OPT_RL:    val.setPick(            routeLog,       var);   break;
         case OPT_RM:    val.setPick(            rateMetric,     var);   break;
         case OPT_RR:    val.setFlag(            rawReporting,   var);   break;
+        case OPT_RH:    val.setFlag(            rehash,         var);   break;
+        case OPT_SC:    val.setText(            scanCache,      var);   break;
         case OPT_SS:    val.setPick(            summaryStats,   var);   break;
+        case OPT_TH:    val.setInum( (Inum)     threads,        var);   break;
+        case OPT_TP:    val.setInum( (Inum)     top,            var);   break;
+        case OPT_TY:    val.setFlag(            types,          var);   break;
+        case OPT_VF:    val.setFlag(            verify,         var);   break;
         case OPT_WD:    val.setText(            workDirectory,  var);   break;
+        case OPT_WO:    val.setPick(            walkOrder,      var);   break;
 
         default: ASSERT(false);
     }
@@ -611,6 +734,7 @@ void Cmd::setEnv() const
 {
     setEnvChunkSize(false);
     setEnvConsoleStreams(false);
+    setEnvThreads(false);
     setEnvWorkDirectory(false);
 }
 
@@ -641,6 +765,21 @@ void Cmd::setEnvConsoleStreams(bool force) const
     mEnv.consoleStreams.d   = isConsole(fileDesc(stderr));
 }
 
+void Cmd::setEnvThreads(bool force) const
+{
+    Size th = cmd.options.threads;
+
+    if ( !force && mEnv.threads != 0 ) return;
+
+    // auto configuration ( -th=0 ) uses one worker per logical CPU
+    // which suits our mix of hashing and file system latency
+
+    if ( th == 0 ) th = cpuCount();
+    if ( th > THREADS_MAX ) th = THREADS_MAX;
+
+    mEnv.threads = th;
+}
+
 void Cmd::setEnvWorkDirectory(bool force) const
 {
     const char* wd = cmd.options.workDirectory.cb();
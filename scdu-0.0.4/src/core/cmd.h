@@ -51,6 +51,7 @@ enum EnvNum
     ENV_NONE = -1,
     ENV_CS = 0,
     ENV_CST,
+    ENV_TH,
     ENV_WD,
     ENV_COUNT
 };
@@ -70,17 +71,25 @@ public:
 
     Size    chunkSize;
     Pick    consoleStreams;
+    Size    threads;
     Str     workDirectory;
 };
 
 enum ActNum
 {
     ACT_NONE = -1,
-    ACT_COPY = 0,
+    ACT_COMPARE = 0,
+    ACT_COPY,
+    ACT_DUPES,
+    ACT_FIND,
     ACT_HELP,
     ACT_INFO,
     ACT_SHOW,
+    ACT_SYNC,
     ACT_VIEW,
+    #if defined SCDU_MODE_DEBUG
+        ACT_BENCH,                      // developer benchmark
+    #endif
     ACT_COUNT
 };
 
@@ -120,16 +129,25 @@ enum OptNum
     OPT_BS,
     OPT_CF,
     OPT_CS,
+    OPT_DX,
+    OPT_EX,
     OPT_FD,
     OPT_FF,
     OPT_FL,
     OPT_FST,
+    OPT_HX,
+    OPT_IN,
     OPT_LF,
+    OPT_LG,
+    OPT_LI,
     OPT_LM,
     OPT_NS,
     OPT_ND,
     OPT_NL,
+    OPT_OF,
     OPT_PF,
+    OPT_PG,
+    OPT_PL,
     OPT_PR,
     OPT_PS,
     OPT_PW,
@@ -138,8 +156,15 @@ enum OptNum
     OPT_RL,
     OPT_RM,
     OPT_RR,
+    OPT_RH,
+    OPT_SC,
     OPT_SS,
+    OPT_TH,
+    OPT_TP,
+    OPT_TY,
+    OPT_VF,
     OPT_WD,
+    OPT_WO,
     OPT_COUNT
 };
 
@@ -173,16 +198,25 @@ public:
     Size    bufferSize;
     Str     configFile;
     Size    chunkSize;
+    bool    deleteExtra;
+    Str     exclude;
     Size    flushDelay;
     Size    flushFactor;
     Size    flushLimit;
     Pick    fastStreams;
+    bool    hex;
+    Str     include;
     Str     logFile;
+    Int64   length;
+    Str     lines;
     Pick    logMode;
     Pick    newlineStd;
     Pick    newlineDgn;
     Pick    newlineLog;
+    Int64   offset;
     Pick    progressFeed;
+    Pick    bufferPages;
+    Str     patternList;
     double  progressRate;
     Pick    progressStats;
     Size    progressWidth;
@@ -191,8 +225,15 @@ public:
     Pick    routeLog;
     Pick    rateMetric;
     bool    rawReporting;
+    bool    rehash;
+    Str     scanCache;
     Pick    summaryStats;
+    Size    threads;
+    Size    top;
+    bool    types;
+    bool    verify;
     Str     workDirectory;
+    Pick    walkOrder;
 };
 
 class Params
@@ -229,6 +270,7 @@ private:
     void setEnv() const;
     void setEnvChunkSize(bool force) const;
     void setEnvConsoleStreams(bool force) const;
+    void setEnvThreads(bool force) const;
     void setEnvWorkDirectory(bool force) const;
 
     mutable bool    mInitialised;
@@ -10,7 +10,13 @@
     #include <errno.h>
     #include <malloc.h>
     #include <stdio.h>
-    #include <io.h>
+    #include <string.h>
+    #if defined SCDU_OS_WINDOWS
+        #include <io.h>
+    #else
+        #include <unistd.h>
+        #include <inttypes.h>
+    #endif
     #include <fcntl.h>
     #include <time.h>
 
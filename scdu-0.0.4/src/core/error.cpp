@@ -21,7 +21,10 @@ const XerDef xerDefs[] =
     { XE_MEMOUT,    "XE_MEMOUT",    "out of memory",                ""          },
     { XE_STREAM,    "XE_STREAM",    "stream error",                 "%s: %s"    },
     { XE_CMD,       "XE_CMD",       "invalid command",              "%s"        },
-    { XE_CMDPRM,    "XE_CMDPRM",    "invalid command parameter",    "%s"        }
+    { XE_CMDPRM,    "XE_CMDPRM",    "invalid command parameter",    "%s"        },
+    { XE_THREAD,    "XE_THREAD",    "unable to start thread",       ""          },
+    { XE_FILE,      "XE_FILE",      "file error",                   "%s"        },
+    { XE_PATLIST,   "XE_PATLIST",   "invalid pattern list",         "%s:%d"     }
 };
 
 static void printerr(const char* fmt, ...);
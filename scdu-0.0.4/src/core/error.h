@@ -29,6 +29,9 @@ enum Xen
     XE_STREAM,
     XE_CMD,
     XE_CMDPRM,
+    XE_THREAD,
+    XE_FILE,
+    XE_PATLIST,
     XE_COUNT
 };
 
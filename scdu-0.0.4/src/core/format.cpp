@@ -9,12 +9,12 @@
 static int formatReg(char* s, Size max, FmtSpec spec, Int64 val);
 static int formatReg(char* s, Size max, FmtSpec spec, double val);
 
-static int formatTEA(char* s, Size max, FmtSpec spec, const char* val);
-static int formatTEU(char* s, Size max, FmtSpec spec, const char* val);
-static int formatPAA(char* s, Size max, FmtSpec spec, const char* val);
-static int formatPAU(char* s, Size max, FmtSpec spec, const char* val);
-static int formatURL(char* s, Size max, FmtSpec spec, const char* val);
-static int formatPSW(char* s, Size max, FmtSpec spec, const char* val);
+static int formatTEA(char* s, Size max, FmtSpec spec, StrView val);
+static int formatTEU(char* s, Size max, FmtSpec spec, StrView val);
+static int formatPAA(char* s, Size max, FmtSpec spec, StrView val);
+static int formatPAU(char* s, Size max, FmtSpec spec, StrView val);
+static int formatURL(char* s, Size max, FmtSpec spec, StrView val);
+static int formatPSW(char* s, Size max, FmtSpec spec, StrView val);
 static int formatHEX(char* s, Size max, FmtSpec spec, Int64 val);
 static int formatHMS(char* s, Size max, FmtSpec spec, Int64 val);
 static int formatP5V(char* s, Size max, FmtSpec spec, double val);
@@ -71,6 +71,20 @@ int format(char* s, Size max, FmtSpec spec, QtyNum qtynum, bool val)
 }
 
 int format(char *s, Size max, FmtSpec spec, QtyNum qtynum, const char* val)
+{
+    if ( val == 0 )
+    {
+        if ( max < 6 ) return -1;
+        strcpy(s, "<NULL>");
+        return 6;
+    }
+
+    return format(s, max, spec, qtynum, StrView(val));
+}
+
+// text is copied by length so a view need not be null terminated
+
+int format(char *s, Size max, FmtSpec spec, QtyNum qtynum, StrView val)
 {
     ASSERT(qtynum >= 0 && qtynum < QN_COUNT);
 
@@ -335,7 +349,7 @@ int formatFlag(char* s, Size max, FmtSpec spec, const Var* var, const Flag& flag
 int formatText(char* s, Size max, FmtSpec spec, const Var* var, const Text& text)
 {
     ASSERT(var->typnum == TYP_TEXT);
-    return format(s, max, spec, var->qtynum, text.cb());
+    return format(s, max, spec, var->qtynum, StrView(text));
 }
 
 int formatInum(char* s, Size max, FmtSpec spec, const Var* var, const Inum& inum)
@@ -444,18 +458,9 @@ static int formatReg(char* s, Size max, FmtSpec spec, double val)
     return snprintfz(s, max, fmt, aval);
 }
 
-static int formatTEA(char* s, Size max, FmtSpec spec, const char* val)
+static int formatTEA(char* s, Size max, FmtSpec spec, StrView val)
 {
-    Size w;
-
-    if ( val == 0 )
-    {
-        if ( max < 6 ) return -1;
-        strcpy(s, "<NULL>");
-        return 6;
-    }
-
-    w = strlen(val);
+    Size w = val.len();
 
     if ( w == 0 && (spec & FSM_FRIENDLY) )
     {
@@ -466,22 +471,14 @@ static int formatTEA(char* s, Size max, FmtSpec spec, const char* val)
 
     if ( max < w ) return -1;
 
-    strcpy(s, val);
+    memcpy(s, val.cb(), w);
+    s[w] = 0;
     return (int) w;
 }
 
-static int formatTEU(char* s, Size max, FmtSpec spec, const char* val)
+static int formatTEU(char* s, Size max, FmtSpec spec, StrView val)
 {
-   Size w;
-
-    if ( val == 0 )
-    {
-        if ( max < 6 ) return -1;
-        strcpy(s, "<NULL>");
-        return 6;
-    }
-
-    w = strlen(val);
+    Size w = val.len();
 
     if ( w == 0 && (spec & FSM_FRIENDLY) )
     {
@@ -492,22 +489,14 @@ static int formatTEU(char* s, Size max, FmtSpec spec, const char* val)
 
     if ( max < w ) return -1;
 
-    strcpy(s, val);
+    memcpy(s, val.cb(), w);
+    s[w] = 0;
     return (int) w;
 }
 
-static int formatPAA(char* s, Size max, FmtSpec spec, const char* val)
+static int formatPAA(char* s, Size max, FmtSpec spec, StrView val)
 {
-   Size w;
-
-    if ( val == 0 )
-    {
-        if ( max < 6 ) return -1;
-        strcpy(s, "<NULL>");
-        return 6;
-    }
-
-    w = strlen(val);
+    Size w = val.len();
 
     if ( w == 0 && (spec & FSM_FRIENDLY) )
     {
@@ -518,22 +507,14 @@ static int formatPAA(char* s, Size max, FmtSpec spec, const char* val)
 
     if ( max < w ) return -1;
 
-    strcpy(s, val);
+    memcpy(s, val.cb(), w);
+    s[w] = 0;
     return (int) w;
 }
 
-static int formatPAU(char* s, Size max, FmtSpec spec, const char* val)
+static int formatPAU(char* s, Size max, FmtSpec spec, StrView val)
 {
-   Size w;
-
-    if ( val == 0 )
-    {
-        if ( max < 6 ) return -1;
-        strcpy(s, "<NULL>");
-        return 6;
-    }
-
-    w = strlen(val);
+    Size w = val.len();
 
     if ( w == 0 && (spec & FSM_FRIENDLY) )
     {
@@ -544,22 +525,14 @@ static int formatPAU(char* s, Size max, FmtSpec spec, const char* val)
 
     if ( max < w ) return -1;
 
-    strcpy(s, val);
+    memcpy(s, val.cb(), w);
+    s[w] = 0;
     return (int) w;
 }
 
-static int formatURL(char* s, Size max, FmtSpec spec, const char* val)
+static int formatURL(char* s, Size max, FmtSpec spec, StrView val)
 {
-   Size w;
-
-    if ( val == 0 )
-    {
-        if ( max < 6 ) return -1;
-        strcpy(s, "<NULL>");
-        return 6;
-    }
-
-    w = strlen(val);
+    Size w = val.len();
 
     if ( w == 0 && (spec & FSM_FRIENDLY) )
     {
@@ -570,22 +543,14 @@ static int formatURL(char* s, Size max, FmtSpec spec, const char* val)
 
     if ( max < w ) return -1;
 
-    strcpy(s, val);
+    memcpy(s, val.cb(), w);
+    s[w] = 0;
     return (int) w;
 }
 
-static int formatPSW(char* s, Size max, FmtSpec spec, const char* val)
+static int formatPSW(char* s, Size max, FmtSpec spec, StrView val)
 {
-   Size w;
-
-    if ( val == 0 )
-    {
-        if ( max < 6 ) return -1;
-        strcpy(s, "<NULL>");
-        return 6;
-    }
-
-    w = strlen(val);
+    Size w = val.len();
 
     if ( w == 0 && (spec & FSM_FRIENDLY) )
     {
@@ -596,7 +561,8 @@ static int formatPSW(char* s, Size max, FmtSpec spec, const char* val)
 
     if ( max < w ) return -1;
 
-    strcpy(s, val);
+    memcpy(s, val.cb(), w);
+    s[w] = 0;
     return (int) w;
 }
 
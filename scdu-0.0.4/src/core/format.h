@@ -78,6 +78,7 @@ enum FmtSpec
 
 extern int format(char* s, Size max, FmtSpec spec, QtyNum qtynum, bool val);
 extern int format(char* s, Size max, FmtSpec spec, QtyNum qtynum, const char* val);
+extern int format(char* s, Size max, FmtSpec spec, QtyNum qtynum, StrView val);
 extern int format(char* s, Size max, FmtSpec spec, QtyNum qtynum, Int64 val);
 extern int format(char* s, Size max, FmtSpec spec, QtyNum qtynum, double val);
 
@@ -1,11 +1,38 @@
 // Copyright 2015-2016 RVJ Callanan.
 // Released under the GNU General Public License (Version 3).
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "core.h"
 
-Allocs allocs_m;
+static Int64    allocsCur = 0;          // totals of flushed shards (the
+static Int64    allocsMax = 0;          // current total may dip below zero)
+
+thread_local AllocShard allocShard;
+
+struct ProfileBlock                     // allocation made while profiling
+{
+    void*       ptr;                    // 0 = free slot
+    Size        size;
+    Size        site;
+};
+
+bool allocsProfiling = false;
+
+static Mutex    profileMutex;           // guards all below
+static AllocSite sites[ALLOC_SITES_MAX];
+static Size     siteCount = 0;
+static Size     siteSlots[2 * ALLOC_SITES_MAX]; // hash of sites (index + 1)
+static ProfileBlock* blocks = 0;        // hash of blocks by address
+static Size     blockCount = 0;
+static Size     blockCap = 0;
+static AllocSite ranked[ALLOC_SITES_MAX];
 
-const Allocs& allocs = allocs_m;
+static Size siteOf(const char* func, const char* file, int line);
+static Size blockHome(const void* ptr);
+static bool blocksGrow();
+static int siteCmp(const void* a, const void* b);
 
 Allocs::Allocs()
 {
@@ -13,4 +40,699 @@ Allocs::Allocs()
     max = 0;
 }
 
+// The peak is taken as the total before the flush plus the highest point
+// the shard reached since its last flush. Counts held by other threads are
+// not seen, so the peak may be short by up to ALLOCS_FLUSH for each thread
+// running at the time, but totals are exact once threads have finished.
+
+void allocsFlush(AllocShard& shard)
+{
+    Int64 cur;
+
+    cur = atomicAdd(&allocsCur, shard.delta);
+    atomicMax(&allocsMax, cur - shard.delta + shard.peak);
+
+    shard.delta = 0;
+    shard.peak = 0;
+}
+
+// totals are only aggregated when they are wanted
+
+Allocs allocsTotal()
+{
+    Allocs a;
+
+    allocsFlush(allocShard);
+
+    a.cur = (Size) atomicGet(&allocsCur);
+    a.max = (Size) atomicGet(&allocsMax);
+
+    return a;
+}
+
+// While profiling, every allocation is recorded against its call site in a
+// hash table keyed by address, so that frees (which may be made elsewhere)
+// can be charged back to the site which made the allocation. The tables
+// themselves use the C library directly, so as not to profile themselves,
+// and everything is done under one lock: profiling is a diagnostic mode.
+
+void allocsProfile(bool on)
+{
+    profileMutex.lock();
+
+    allocsProfiling = on;
+
+    if ( !on )
+    {
+        if ( blocks != 0 ) free(blocks);
+
+        blocks = 0;
+        blockCount = 0;
+        blockCap = 0;
+        siteCount = 0;
+        memset(siteSlots, 0, sizeof(siteSlots));
+    }
+
+    profileMutex.unlock();
+}
+
+void allocsProfileAdd(void* ptr, Size size, const char* func, const char* file, int line)
+{
+    Size i, site;
+
+    profileMutex.lock();
+
+    site = siteOf(func, file, line);
+
+    // short of memory, the table fills up beyond its usual load
+
+    if ( 2 * ( blockCount + 1 ) > blockCap && !blocksGrow() && blockCount + 1 >= blockCap ) site = SIZE_VAL_MAX;
+
+    if ( site != SIZE_VAL_MAX )
+    {
+        for ( i = blockHome(ptr); blocks[i].ptr != 0; i = ( i + 1 ) & ( blockCap - 1 ) ) ;
+
+        blocks[i].ptr = ptr;
+        blocks[i].size = size;
+        blocks[i].site = site;
+        blockCount++;
+
+        AllocSite& s = sites[site];
+
+        s.count++;
+        s.bytes += (Int64) size;
+        s.cur += (Int64) size;
+        if ( s.cur > s.peak ) s.peak = s.cur;
+    }
+
+    profileMutex.unlock();
+}
+
+// blocks allocated before profiling began are not found and are ignored
+
+void allocsProfileRemove(void* ptr)
+{
+    Size i, j, k;
+
+    profileMutex.lock();
+
+    if ( blockCap != 0 )
+    {
+        for ( i = blockHome(ptr); blocks[i].ptr != 0 && blocks[i].ptr != ptr; i = ( i + 1 ) & ( blockCap - 1 ) ) ;
+
+        if ( blocks[i].ptr != 0 )
+        {
+            sites[blocks[i].site].cur -= (Int64) blocks[i].size;
+            blockCount--;
+
+            // close the gap by moving back any later block of the same run
+            // which may not stay where it is (linear probing)
+
+            for ( j = i; ; )
+            {
+                j = ( j + 1 ) & ( blockCap - 1 );
+
+                if ( blocks[j].ptr == 0 ) break;
+
+                k = blockHome(blocks[j].ptr);
+
+                if ( i <= j ? ( i < k && k <= j ) : ( i < k || k <= j ) ) continue;
+
+                blocks[i] = blocks[j];
+                i = j;
+            }
+
+            blocks[i].ptr = 0;
+        }
+    }
+
+    profileMutex.unlock();
+}
+
+// copies out the sites which allocated most bytes, most first
+
+Size allocsProfileTop(AllocSite* top, Size max)
+{
+    Size n;
+
+    profileMutex.lock();
+
+    memcpy(ranked, sites, siteCount * sizeof(AllocSite));
+    qsort(ranked, siteCount, sizeof(AllocSite), siteCmp);
+
+    n = siteCount < max ? siteCount : max;
+    memcpy(top, ranked, n * sizeof(AllocSite));
+
+    profileMutex.unlock();
+
+    return n;
+}
+
+// call site names are literals so their addresses identify them; sites
+// beyond ALLOC_SITES_MAX go unrecorded
+
+static Size siteOf(const char* func, const char* file, int line)
+{
+    const Size  mask = 2 * ALLOC_SITES_MAX - 1;
+    Size        i;
+
+    i = (Size) ( ( (Uint64) (Size) file ^ (Uint64) (Size) func ^ (Uint64) line ) * 0x9E3779B97F4A7C15ull >> 40 ) & mask;
+
+    for ( ; siteSlots[i] != 0; i = ( i + 1 ) & mask )
+    {
+        const AllocSite& s = sites[siteSlots[i] - 1];
+
+        if ( s.line == line && s.file == file && s.func == func ) return siteSlots[i] - 1;
+    }
+
+    if ( siteCount == ALLOC_SITES_MAX ) return SIZE_VAL_MAX;
+
+    AllocSite& s = sites[siteCount];
+
+    s.func = func;
+    s.file = file;
+    s.line = line;
+    s.count = 0;
+    s.bytes = 0;
+    s.cur = 0;
+    s.peak = 0;
+
+    siteSlots[i] = ++siteCount;
+
+    return siteCount - 1;
+}
+
+static Size blockHome(const void* ptr)
+{
+    return (Size) ( ( (Uint64) (Size) ptr >> 4 ) * 0x9E3779B97F4A7C15ull >> 32 ) & ( blockCap - 1 );
+}
+
+// the lock is held so running out of memory cannot be fatal here
+
+static bool blocksGrow()
+{
+    ProfileBlock*   old = blocks;
+    Size            oldCap = blockCap;
+    Size            i;
+
+    blockCap = oldCap == 0 ? 4096 : oldCap * 2;
+    blocks = (ProfileBlock*) calloc(blockCap, sizeof(ProfileBlock));
+
+    if ( blocks == 0 )
+    {
+        blocks = old;
+        blockCap = oldCap;
+        return false;
+    }
+
+    for ( Size j = 0; j < oldCap; j++ )
+    {
+        if ( old[j].ptr == 0 ) continue;
+
+        for ( i = blockHome(old[j].ptr); blocks[i].ptr != 0; i = ( i + 1 ) & ( blockCap - 1 ) ) ;
+
+        blocks[i] = old[j];
+    }
+
+    if ( old != 0 ) free(old);
+
+    return true;
+}
+
+static int siteCmp(const void* a, const void* b)
+{
+    const AllocSite* p = (const AllocSite*) a;
+    const AllocSite* q = (const AllocSite*) b;
+
+    if ( p->bytes != q->bytes ) return p->bytes > q->bytes ? -1 : 1;
+    if ( p->count != q->count ) return p->count > q->count ? -1 : 1;
+
+    return 0;
+}
+
+struct BufMapping                       // I/O buffer mapped from the OS
+{
+    void*       ptr;
+    Size        size;                   // as requested
+    PageInfo    info;
+};
+
+static Mutex    bufMutex;               // guards all below
+static Uint32   bufFlags = 0;
+static bool     bufQuerying = false;
+static BufMapping bufs[BUFS_MAX];
+static Size     bufCount = 0;
+static BufStats bufStats;
+
+BufStats::BufStats()
+{
+    count = 0;
+    bytes = 0;
+    huge = 0;
+    page = 0;
+    nodes = 0;
+}
+
+// Sets the PG_ flags with which large buffers are mapped (see --buffer-pages) and
+// whether the pages they got are looked up as each is freed, when they have
+// been used (see --summary-stats=B).
+
+void bufsConfigure(Uint32 flags, bool query)
+{
+    bufMutex.lock();
+    bufFlags = flags;
+    bufQuerying = query;
+    bufMutex.unlock();
+}
+
+BufStats bufsTotal()
+{
+    BufStats s;
+
+    bufMutex.lock();
+    s = bufStats;
+    bufMutex.unlock();
+
+    return s;
+}
+
+// Large I/O buffers are mapped in whole pages directly from the OS, so that
+// they may be placed on huge pages and near the thread which uses them (it
+// should allocate them itself). Should that fail, or the table be full, they
+// come from the heap like small ones. Either way they are counted in the
+// allocation totals and charged to the caller while profiling.
+
+void* bufMap(Size size, const char* func, const char* file, int line)
+{
+    Uint8*      ptr = 0;
+    PageInfo    info;
+
+    if ( size >= BUF_PAGED_MIN )
+    {
+        bufMutex.lock();
+
+        if ( bufCount < BUFS_MAX )
+        {
+            ptr = (Uint8*) pageAlloc(size, bufFlags, info);
+
+            if ( ptr != 0 )
+            {
+                bufs[bufCount].ptr = ptr;
+                bufs[bufCount].size = size;
+                bufs[bufCount].info = info;
+                bufCount++;
+            }
+        }
+
+        bufMutex.unlock();
+    }
+
+    if ( ptr == 0 )
+    {
+        memAlloc_(&ptr, size, func, file, line);
+        return ptr;
+    }
+
+    allocsAdd((Int64) info.size);
+
+    if ( allocsProfiling ) allocsProfileAdd(ptr, info.size, func, file, line);
+
+    return ptr;
+}
+
+// buffers not found in the table came from the heap
+
+void bufUnmap(void* ptr, Size size, const char* func, const char* file, int line)
+{
+    BufMapping  b;
+    Uint8*      p;
+    Size        i;
+
+    bufMutex.lock();
+
+    for ( i = 0; i < bufCount && bufs[i].ptr != ptr; i++ ) ;
+
+    if ( i == bufCount )
+    {
+        bufMutex.unlock();
+
+        p = (Uint8*) ptr;
+        memFree_(&p, size, func, file, line);
+        return;
+    }
+
+    b = bufs[i];
+    bufs[i] = bufs[--bufCount];
+
+    if ( b.size != size )
+    {
+        bufMutex.unlock();
+        panic(func, file, line, "free buffer size check failed");
+    }
+
+    if ( bufQuerying )
+    {
+        pageQuery(b.ptr, b.info);
+
+        bufStats.count++;
+        bufStats.bytes += b.info.size;
+        if ( b.info.page > bufStats.page ) bufStats.page = b.info.page;
+        if ( b.info.huge ) bufStats.huge += b.info.size;
+        if ( b.info.node >= 0 && b.info.node < 64 ) bufStats.nodes |= (Uint64) 1 << b.info.node;
+    }
+
+    bufMutex.unlock();
+
+    if ( allocsProfiling ) allocsProfileRemove(ptr);
+
+    pageFree(ptr, b.info);
+
+    allocsAdd(-(Int64) b.info.size);
+}
+
+// called as each Thread finishes so that nothing it counted or cached is
+// lost with it
+
+void memThreadExit()
+{
+    poolThreadExit();
+    allocsFlush(allocShard);
+}
+
+thread_local PoolCache poolCaches[POOLS_MAX];
+
+static PoolBase* pools[POOLS_MAX];      // by slot
+static Size     poolUsed[POOLS_MAX];    // slot claimed (atomic)
+static Size     poolGen = 0;            // generations issued (atomic)
+
+// Slots are claimed atomically rather than under a lock since pools may be
+// static objects constructed in any order. Items are at least a pointer in
+// size (to link free ones) and a whole number of pointers for alignment.
+
+PoolBase::PoolBase(Size itemSize)
+{
+    for ( mSlot = 0; mSlot < POOLS_MAX; mSlot++ )
+    {
+        if ( atomicCas(&poolUsed[mSlot], 0, 1) ) break;
+    }
+
+    ASSERT_ALWAYS(mSlot < POOLS_MAX);
+
+    mGen = atomicAdd(&poolGen, (Size) 1);
+
+    mItemSize = ( itemSize + sizeof(PoolItem) - 1 ) / sizeof(PoolItem) * sizeof(PoolItem);
+    if ( mItemSize == 0 ) mItemSize = sizeof(PoolItem);
+
+    mFree = 0;
+    mFreeCount = 0;
+    mSlabs = 0;
+    mInUse = 0;
+
+    pools[mSlot] = this;
+}
+
+// the slot is free for another pool once this one is gone; caches left in
+// it by other threads are of an old generation and so are never used
+
+PoolBase::~PoolBase()
+{
+    release();
+    pools[mSlot] = 0;
+    atomicCas(&poolUsed[mSlot], 1, 0);
+}
+
+// takes a batch from the pool, carving a new slab if there is none
+
+void PoolBase::refill(PoolCache& c)
+{
+    PoolItem*   p;
+    Uint8*      slab = 0;
+    Size        n;
+
+    mMutex.lock();
+
+    if ( mFreeCount == 0 )
+    {
+        n = POOL_BATCH * POOL_SLAB_BATCHES;
+
+        memAlloc(&slab, ( n + 1 ) * mItemSize);
+
+        ( (PoolItem*) slab )->next = mSlabs;
+        mSlabs = (PoolItem*) slab;
+
+        for ( Size i = n; i > 0; i-- )
+        {
+            p = (PoolItem*) ( slab + i * mItemSize );
+            p->next = mFree;
+            mFree = p;
+        }
+
+        mFreeCount = n;
+    }
+
+    n = mFreeCount < POOL_BATCH ? mFreeCount : POOL_BATCH;
+
+    for ( Size i = 0; i < n; i++ )
+    {
+        p = mFree;
+        mFree = p->next;
+        p->next = c.items;
+        c.items = p;
+    }
+
+    mFreeCount -= n;
+    c.count += n;
+
+    mMutex.unlock();
+}
+
+// gives back all but the first few items of a thread cache
+
+void PoolBase::spill(PoolCache& c, Size keep)
+{
+    PoolItem*   first;
+    PoolItem*   last;
+    PoolItem**  link;
+    Size        n;
+
+    if ( c.count <= keep ) return;
+
+    link = &c.items;
+    for ( Size i = 0; i < keep; i++ ) link = &(*link)->next;
+
+    first = *link;
+    *link = 0;
+
+    n = 0;
+    for ( last = first; last->next != 0; last = last->next ) n++;
+
+    mMutex.lock();
+    last->next = mFree;
+    mFree = first;
+    mFreeCount += n + 1;
+    mMutex.unlock();
+
+    c.count = keep;
+}
+
+// Frees all slabs at once, and with them any items not given back; no
+// other thread may be using the pool. Items still cached by any thread are
+// disowned by moving to a new generation.
+
+void PoolBase::release()
+{
+    PoolItem*   next;
+    Uint8*      slab;
+
+    mGen = atomicAdd(&poolGen, (Size) 1);
+
+    while ( mSlabs != 0 )
+    {
+        next = mSlabs->next;
+        slab = (Uint8*) mSlabs;
+        memFree(&slab, ( POOL_BATCH * POOL_SLAB_BATCHES + 1 ) * mItemSize);
+        mSlabs = next;
+    }
+
+    mFree = 0;
+    mFreeCount = 0;
+    mInUse = 0;
+}
+
+// exact once all other threads using the pool have exited
+
+Int64 PoolBase::inUse()
+{
+    Int64 n;
+
+    mMutex.lock();
+    n = mInUse + cache().net;
+    mMutex.unlock();
+
+    return n;
+}
+
+// returns the cached items of a finished thread and merges its counts
+
+void poolThreadExit()
+{
+    for ( Size i = 0; i < POOLS_MAX; i++ )
+    {
+        PoolBase*   pool = pools[i];
+        PoolCache&  c = poolCaches[i];
+
+        if ( pool == 0 || c.gen != pool->mGen ) continue;
+
+        pool->spill(c, 0);
+
+        pool->mMutex.lock();
+        pool->mInUse += c.net;
+        pool->mMutex.unlock();
+
+        c.net = 0;
+    }
+}
+
+Arena::Arena(Size blockSize)
+{
+    mFirst = 0;
+    mBlock = 0;
+    mLarge = 0;
+    mUsed = 0;
+    mBlockSize = blockSize;
+    mReserved = 0;
+}
+
+Arena::~Arena()
+{
+    release();
+}
+
+// Moves on to the next block, reusing one kept by reset() or rewind() or
+// else adding a new one. A request larger than the block size gets a block
+// of its own which is freed as soon as the arena is reset or rewound past
+// it, so blocks kept for reuse are all of the one size.
+
+void* Arena::grow(Size size, Size align)
+{
+    ArenaBlock* b;
+    Uint8*      p = 0;
+    Size        cap;
+
+    ASSERT(align != 0 && align <= ARENA_ALIGN_MAX && ( align & ( align - 1 ) ) == 0);
+    (void) align;                       // block data is aligned for any
+
+    cap = size > mBlockSize ? size : mBlockSize;
+    b = size > mBlockSize ? 0 : ( mBlock == 0 ? mFirst : mBlock->next );
+
+    if ( b == 0 )
+    {
+        memAlloc(&p, sizeof(ArenaBlock) + cap);
+
+        b = (ArenaBlock*) p;
+        b->next = 0;
+        b->size = cap;
+
+        mReserved += cap;
+    }
+
+    if ( size > mBlockSize )
+    {
+        b->next = mLarge;
+        mLarge = b;
+        return b + 1;
+    }
+
+    if ( mBlock == 0 ) mFirst = b;
+    else mBlock->next = b;
+
+    mBlock = b;
+    mUsed = size;
+
+    return b + 1;
+}
+
+// frees large blocks added since the given one
+
+void Arena::drop(ArenaBlock* until)
+{
+    ArenaBlock* b;
+    Uint8*      p;
+
+    while ( mLarge != until )
+    {
+        b = mLarge;
+        mLarge = b->next;
+        mReserved -= b->size;
+
+        p = (Uint8*) b;
+        memFree(&p, sizeof(ArenaBlock) + b->size);
+    }
+}
+
+char* Arena::strDup(const char* s, Size len)
+{
+    char* p = (char*) alloc(len + 1, 1);
+
+    memcpy(p, s, len);
+    p[len] = 0;
+
+    return p;
+}
+
+ArenaMark Arena::mark() const
+{
+    ArenaMark m;
+
+    m.block = mBlock;
+    m.used = mUsed;
+    m.large = mLarge;
+
+    return m;
+}
+
+// frees everything allocated since the mark, keeping the blocks for reuse
+
+void Arena::rewind(const ArenaMark& m)
+{
+    drop(m.large);
+
+    mBlock = m.block == 0 ? mFirst : m.block;
+    mUsed = m.block == 0 ? 0 : m.used;
+}
+
+void Arena::reset()
+{
+    drop(0);
+
+    mBlock = mFirst;
+    mUsed = 0;
+}
+
+void Arena::release()
+{
+    ArenaBlock* b;
+    ArenaBlock* next;
+    Uint8*      p;
+
+    drop(0);
+
+    for ( b = mFirst; b != 0; b = next )
+    {
+        next = b->next;
+        p = (Uint8*) b;
+        memFree(&p, sizeof(ArenaBlock) + b->size);
+    }
+
+    mFirst = 0;
+    mBlock = 0;
+    mUsed = 0;
+    mReserved = 0;
+}
+
+Size Arena::reserved() const
+{
+    return mReserved;
+}
+
 // EOF
\ No newline at end of file
@@ -12,7 +12,226 @@ struct Allocs
     Size max;
 };
 
-extern const Allocs& allocs;
+const Int64 ALLOCS_FLUSH = 256 * 1024;  // bytes a thread may count privately
+
+struct AllocShard
+{
+    Int64       delta;                  // bytes allocated less bytes freed
+    Int64       peak;                   // highest delta
+};
+
+extern thread_local AllocShard allocShard;
+
+extern void allocsFlush(AllocShard& shard);
+extern Allocs allocsTotal();
+extern void memThreadExit();
+
+const Size ALLOC_SITES_MAX = 1024;     // call sites profiled
+
+struct AllocSite
+{
+    const char* func;
+    const char* file;
+    int         line;
+    Int64       count;                  // allocations made here
+    Int64       bytes;                  // bytes allocated here
+    Int64       cur;                    // bytes still allocated
+    Int64       peak;                   // most bytes allocated at once
+};
+
+extern bool allocsProfiling;
+
+extern void allocsProfile(bool on);
+extern void allocsProfileAdd(void* ptr, Size size, const char* func, const char* file, int line);
+extern void allocsProfileRemove(void* ptr);
+extern Size allocsProfileTop(AllocSite* sites, Size max);
+
+// Each thread counts in a shard of its own, without atomics, and only adds
+// to the shared totals once its count has moved by ALLOCS_FLUSH either way.
+
+inline void allocsAdd(Int64 size)
+{
+    AllocShard& shard = allocShard;
+
+    shard.delta += size;
+    if ( shard.delta > shard.peak ) shard.peak = shard.delta;
+
+    if ( shard.delta >= ALLOCS_FLUSH || shard.delta <= -ALLOCS_FLUSH ) allocsFlush(shard);
+}
+
+const Size ARENA_BLOCK_DEF = 64 * 1024; // bytes per arena block by default
+const Size ARENA_ALIGN = 8;             // default alignment
+const Size ARENA_ALIGN_MAX = 2 * sizeof(void*); // alignment of block data
+
+struct ArenaBlock
+{
+    ArenaBlock* next;
+    Size        size;                   // bytes of data following header
+};
+
+struct ArenaMark
+{
+    ArenaBlock* block;
+    Size        used;
+    ArenaBlock* large;
+};
+
+class Arena
+{
+public:
+    Arena(Size blockSize = ARENA_BLOCK_DEF);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    void* alloc(Size size, Size align = ARENA_ALIGN);
+    char* strDup(const char* s, Size len);
+    ArenaMark mark() const;
+    void rewind(const ArenaMark& m);
+    void reset();
+    void release();
+    Size reserved() const;
+
+private:
+    void* grow(Size size, Size align);
+    void drop(ArenaBlock* until);
+
+    ArenaBlock* mFirst;
+    ArenaBlock* mBlock;                 // block being filled
+    ArenaBlock* mLarge;                 // blocks of one request each (newest first)
+    Size        mUsed;                  // bytes of block in use
+    Size        mBlockSize;
+    Size        mReserved;              // data bytes in all blocks
+};
+
+// the common case is inline: bump the offset within the current block
+
+inline void* Arena::alloc(Size size, Size align)
+{
+    Size at;
+
+    if ( mBlock != 0 )
+    {
+        at = ( mUsed + align - 1 ) & ~( align - 1 );
+
+        if ( at <= mBlock->size && size <= mBlock->size - at )
+        {
+            mUsed = at + size;
+            return (Uint8*) (mBlock + 1) + at;
+        }
+    }
+
+    return grow(size, align);
+}
+
+const Size POOLS_MAX = 16;              // pools in existence at once
+const Size POOL_BATCH = 64;             // items moved to or from a thread cache
+const Size POOL_SLAB_BATCHES = 16;      // batches allocated at once
+
+struct PoolItem
+{
+    PoolItem*   next;
+};
+
+struct PoolCache
+{
+    PoolItem*   items;                  // free items held by one thread
+    Size        count;
+    Int64       net;                    // items taken less items given
+    Size        gen;                    // of the pool the items came from
+};
+
+extern thread_local PoolCache poolCaches[POOLS_MAX];
+
+extern void poolThreadExit();
+
+class PoolBase
+{
+public:
+    PoolBase(Size itemSize);
+    ~PoolBase();
+    PoolBase(const PoolBase&) = delete;
+    PoolBase& operator=(const PoolBase&) = delete;
+    void* take();
+    void give(void* p);
+    void release();
+    Int64 inUse();
+
+    friend void poolThreadExit();
+
+private:
+    PoolCache& cache();
+    void refill(PoolCache& c);
+    void spill(PoolCache& c, Size keep);
+
+    Size        mSlot;                  // of thread caches
+    Size        mGen;                   // renewed as all items are freed
+    Size        mItemSize;
+    Mutex       mMutex;                 // guards all below
+    PoolItem*   mFree;                  // items given back by threads
+    Size        mFreeCount;
+    PoolItem*   mSlabs;                 // linked through their first item
+    Int64       mInUse;                 // net taken by exited threads
+};
+
+// a thread's cache is emptied (not given back) on first use after the
+// pool's items were freed, or its slot passed to another pool
+
+inline PoolCache& PoolBase::cache()
+{
+    PoolCache& c = poolCaches[mSlot];
+
+    if ( c.gen != mGen )
+    {
+        c.items = 0;
+        c.count = 0;
+        c.net = 0;
+        c.gen = mGen;
+    }
+
+    return c;
+}
+
+// items come from and go to the calling thread's cache without locking;
+// the pool is only visited a batch at a time
+
+inline void* PoolBase::take()
+{
+    PoolCache&  c = cache();
+    PoolItem*   p;
+
+    if ( c.items == 0 ) refill(c);
+
+    p = c.items;
+    c.items = p->next;
+    c.count--;
+    c.net++;
+
+    return p;
+}
+
+inline void PoolBase::give(void* p)
+{
+    PoolCache&  c = cache();
+    PoolItem*   item = (PoolItem*) p;
+
+    item->next = c.items;
+    c.items = item;
+    c.count++;
+    c.net--;
+
+    if ( c.count >= 2 * POOL_BATCH ) spill(c, POOL_BATCH);
+}
+
+// typed front end: items are raw storage (no construction or destruction)
+
+template <typename T>
+class Pool : public PoolBase
+{
+public:
+    Pool() : PoolBase(sizeof(T)) {}
+    T* take() { return (T*) PoolBase::take(); }
+    void give(T* p) { PoolBase::give(p); }
+};
 
 #define memAlloc(a, s) memAlloc_(a, s, CUR_FUNC, CUR_FILE, CUR_LINE)
 
@@ -23,10 +242,6 @@ void memAlloc_(    T** addr_ptr,
                     const char* file,
                     int line )
 {
-    extern Allocs allocs_m;
-
-    size >>= sizeof(T) - 1;
-
     if ( size == 0 )
     {
         panic(func, file, line, "memory allocation size is zero");
@@ -44,12 +259,9 @@ void memAlloc_(    T** addr_ptr,
         xer(XE_MEMOUT);
     }
 
-    allocs_m.cur += size;
+    allocsAdd((Int64) size);
 
-    if ( allocs_m.cur > allocs_m.max )
-    {
-        allocs_m.max = allocs_m.cur;
-    }
+    if ( allocsProfiling ) allocsProfileAdd(*addr_ptr, size, func, file, line);
 }
 
 #define memRealloc(a, n, o) memRealloc_(a, n, o, CUR_FUNC, CUR_FILE, CUR_LINE)
@@ -62,16 +274,12 @@ void memRealloc_(  T** addr_ptr,
                     const char* file,
                     int line )
 {
-    extern Allocs allocs_m;
     void*  ptr;
     Size   old_size;
 
     ptr = (void*) *addr_ptr;
     old_size = mallocSize(ptr);
 
-    new_size >>= sizeof(T) - 1;
-    old_size_chk >>= sizeof(T) - 1;
-
     if ( new_size == 0 )
     {
         panic(func, file, line, "memory realloc size is zero");
@@ -82,11 +290,13 @@ void memRealloc_(  T** addr_ptr,
         panic(func, file, line, "realloc memory already freed (or pointer illegally cleared)");
     }
 
-    if ( old_size != old_size_chk )
+    if ( MALLOC_SIZE_EXACT ? old_size != old_size_chk : old_size < old_size_chk )
     {
         panic(func, file, line, "realloc memory size check failed");
     }
 
+    if ( allocsProfiling ) allocsProfileRemove(ptr);
+
     *addr_ptr = (T*) realloc(ptr, new_size);
 
     if (*addr_ptr == 0)
@@ -94,12 +304,9 @@ void memRealloc_(  T** addr_ptr,
         xer(XE_MEMOUT);
     }
 
-    allocs_m.cur += (new_size - old_size);
+    allocsAdd((Int64) new_size - (Int64) old_size_chk);
 
-    if ( allocs_m.cur > allocs_m.max )
-    {
-        allocs_m.max = allocs_m.cur;
-    }
+    if ( allocsProfiling ) allocsProfileAdd(*addr_ptr, new_size, func, file, line);
 }
 
 #define memFree(a, s) memFree_(a, s, CUR_FUNC, CUR_FILE, CUR_LINE)
@@ -111,12 +318,9 @@ void memFree_( T** addr_ptr,
                 const char* file,
                 int line )
 {
-    extern Allocs allocs_m;
     Size    size;
     void*   ptr;
 
-    size_chk >>= sizeof(T) - 1;
-
     ptr = (void*) *addr_ptr;
 
     if ( ptr == 0 )
@@ -127,17 +331,75 @@ void memFree_( T** addr_ptr,
 
     size = mallocSize(ptr);
 
-    if ( size_chk != 0 && size != size_chk )
+    if ( size_chk != 0 && ( MALLOC_SIZE_EXACT ? size != size_chk : size < size_chk ) )
     {
         panic(func, file, line, "free memory size check failed");
     }
 
+    if ( allocsProfiling ) allocsProfileRemove(ptr);
+
     free(ptr);
     *addr_ptr = 0;
 
-    allocs_m.cur -= size;
+    allocsAdd(-(Int64) ( size_chk != 0 ? size_chk : size ));
+}
+
+const Size BUFS_MAX = 4 * THREADS_MAX;  // I/O buffers mapped at once
+const Size BUF_PAGED_MIN = 256 * 1024;  // smaller I/O buffers come from the heap
+
+struct BufStats
+{
+    BufStats();
+    Size        count;                  // buffers mapped and since freed
+    Size        bytes;                  // bytes mapped for them
+    Size        huge;                   // bytes of those on huge pages
+    Size        page;                   // largest page size obtained
+    Uint64      nodes;                  // NUMA nodes obtained (bit per node)
+};
+
+extern void bufsConfigure(Uint32 flags, bool query);
+extern BufStats bufsTotal();
+extern void* bufMap(Size size, const char* func, const char* file, int line);
+extern void bufUnmap(void* ptr, Size size, const char* func, const char* file, int line);
+
+#define bufAlloc(a, s) bufAlloc_(a, s, CUR_FUNC, CUR_FILE, CUR_LINE)
 
-    ASSERT(allocs_m.cur >= 0);
+template <typename T>
+void bufAlloc_(    T** addr_ptr,
+                    Size size,
+                    const char* func,
+                    const char* file,
+                    int line )
+{
+    if ( size == 0 )
+    {
+        panic(func, file, line, "buffer allocation size is zero");
+    }
+
+    if ( *addr_ptr != 0 )
+    {
+        panic(func, file, line, "buffer already allocated (or pointer illegally set)");
+    }
+
+    *addr_ptr = (T*) bufMap(size, func, file, line);
+}
+
+#define bufFree(a, s) bufFree_(a, s, CUR_FUNC, CUR_FILE, CUR_LINE)
+
+template <typename T>
+void bufFree_( T** addr_ptr,
+                Size size,
+                const char* func,
+                const char* file,
+                int line )
+{
+    if ( *addr_ptr == 0 )
+    {
+        panic(func, file, line, "buffer already freed (or pointer illegally cleared)");
+    }
+
+    bufUnmap((void*) *addr_ptr, size, func, file, line);
+    *addr_ptr = 0;
 }
 
 // EOF
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include "core.h"
 
 static void per(Pen e, ...);
+static bool viewz(char* t, StrView s);
 
 static Pen  penMutable = PE_OK;
 const Pen&  pen = penMutable;
@@ -354,6 +355,51 @@ void parse(const char* s, QtyNum qtynum, Int32& val)
     ASSERT(!pen);
 }
 
+// A view is copied to a terminated buffer for the conversions beneath, so
+// one longer than PARSE_MAX chars is rejected.
+
+void parse(StrView s, QtyNum qtynum, bool& val)
+{
+    char t[PARSE_MAX+1];
+
+    if ( viewz(t, s) ) parse(t, qtynum, val);
+}
+
+void parse(StrView s, QtyNum qtynum, double& val)
+{
+    char t[PARSE_MAX+1];
+
+    if ( viewz(t, s) ) parse(t, qtynum, val);
+}
+
+void parse(StrView s, QtyNum qtynum, Uint64& val)
+{
+    char t[PARSE_MAX+1];
+
+    if ( viewz(t, s) ) parse(t, qtynum, val);
+}
+
+void parse(StrView s, QtyNum qtynum, Int64& val)
+{
+    char t[PARSE_MAX+1];
+
+    if ( viewz(t, s) ) parse(t, qtynum, val);
+}
+
+void parse(StrView s, QtyNum qtynum, Uint32& val)
+{
+    char t[PARSE_MAX+1];
+
+    if ( viewz(t, s) ) parse(t, qtynum, val);
+}
+
+void parse(StrView s, QtyNum qtynum, Int32& val)
+{
+    char t[PARSE_MAX+1];
+
+    if ( viewz(t, s) ) parse(t, qtynum, val);
+}
+
 void parseList(const char* s, QtyNum qtynum, const char* dlm, Size max, bool val[], Size& count)
 {
     Size    i;
@@ -834,6 +880,21 @@ void parsePick(const char* s, const Var* var, Pick& val)
     ASSERT(!pen);
 }
 
+static bool viewz(char* t, StrView s)
+{
+    if ( s.len() > PARSE_MAX )
+    {
+        perClear();
+        per(PE_CHARLESS);
+        return false;
+    }
+
+    memcpy(t, s.cb(), s.len());
+    t[s.len()] = 0;
+
+    return true;
+}
+
 static void per(Pen e, ...)
 {
     char    fmt[PEM_MAX+1];
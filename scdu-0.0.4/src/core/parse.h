@@ -49,6 +49,13 @@ extern void parse(const char* s, QtyNum qtynum, Int64& val);
 extern void parse(const char* s, QtyNum qtynum, Uint32& val);
 extern void parse(const char* s, QtyNum qtynum, Int32& val);
 
+extern void parse(StrView s, QtyNum qtynum, bool& val);
+extern void parse(StrView s, QtyNum qtynum, double& val);
+extern void parse(StrView s, QtyNum qtynum, Uint64& val);
+extern void parse(StrView s, QtyNum qtynum, Int64& val);
+extern void parse(StrView s, QtyNum qtynum, Uint32& val);
+extern void parse(StrView s, QtyNum qtynum, Int32& val);
+
 extern void parseList(const char* s, QtyNum qtynum, const char* dlm, Size max, bool val[], Size& count);
 extern void parseList(const char* s, QtyNum qtynum, const char* dlm, Size max, double val[], Size& count);
 extern void parseList(const char* s, QtyNum qtynum, const char* dlm, Size max, Uint64 val[], Size& count);
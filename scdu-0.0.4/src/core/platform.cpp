@@ -1,9 +1,21 @@
 // Copyright 2015-2016 RVJ Callanan.
 // Released under the GNU General Public License (Version 3).
 
+#include <string.h>
+#include <stdlib.h>
+
+#if !defined SCDU_OS_WINDOWS
+    #include <stdio_ext.h>
+#endif
+
 #include "core.h"
 
 static bool initialised = false;
+static bool hugeAllowed = true;         // huge pages not refused outright
+
+#if defined SCDU_OS_WINDOWS
+    static bool lockPages();
+#endif
 
 static char scduDateMutable[SCDU_DATE_SIZE + 1] = "";
 const char* const scduDate = scduDateMutable;
@@ -89,14 +101,22 @@ void initPlatform()
     // this is faster, more consistent and more flexible
     // however, program is now responsible for text encodings
 
-    errno = 0;
+    #if defined SCDU_OS_WINDOWS
 
-    if ( setMode(STDIN_FILENO,  O_BINARY) < 0 ||
-         setMode(STDOUT_FILENO, O_BINARY) < 0 ||
-         setMode(STDERR_FILENO, O_BINARY) < 0 )
-    {
-        xer(XE_STREAM, strerror(errno));
-    }
+        errno = 0;
+
+        if ( setMode(STDIN_FILENO,  O_BINARY) < 0 ||
+             setMode(STDOUT_FILENO, O_BINARY) < 0 ||
+             setMode(STDERR_FILENO, O_BINARY) < 0 )
+        {
+            xer(XE_STREAM, strerror(errno));
+        }
+
+        // enable large pages once, before any buffer is mapped
+
+        hugeAllowed = lockPages();
+
+    #endif
 
     // SCDU_DATETIME derivatives require simple truncation
 
@@ -129,6 +149,14 @@ bool platformInitialised()
     return initialised;
 }
 
+// false if huge pages are known to be refused whatever is asked (Windows
+// without the "lock pages in memory" privilege); true does not assure them
+
+bool hugePagesAllowed()
+{
+    return hugeAllowed;
+}
+
 File* fileOpen(const char* path, const char* mode)
 {
     return fopen64(path, mode);
@@ -169,25 +197,204 @@ int fileDesc(File *stream)
     return fileno(stream);
 }
 
-Size fileBufCap(File *stream)
+#if defined SCDU_OS_WINDOWS
+
+    Size fileBufCap(File *stream)
+    {
+        return (Size) stream->_bufsiz;
+    }
+
+    Size fileBufLen(File *stream)
+    {
+        return (Size) (stream->_ptr - stream->_base);
+    }
+
+#else
+
+    Size fileBufCap(File *stream)
+    {
+        return __fbufsize(stream);
+    }
+
+    Size fileBufLen(File *stream)
+    {
+        return __fpending(stream);
+    }
+
+#endif
+
+const char* fileGetS(char* line, Size max, File *stream)
 {
-    return (Size) stream->_bufsiz;
+    return fgets(line, (int) max, stream);
 }
 
-Size fileBufLen(File *stream)
+int fileUnbuffer(File* stream)
 {
-    return (Size) (stream->_ptr - stream->_base);
+    // must precede any other operation on the stream
+    return setvbuf(stream, 0, _IONBF, 0);
 }
 
-const char* fileGetS(char* line, Size max, File *stream)
+Thread::Thread()
 {
-    return fgets(line, (int) max, stream);
+    mHandle = 0;
+    mProc = 0;
+    mArg = 0;
+}
+
+Thread::~Thread()
+{
+    ASSERT(mHandle == 0);
+}
+
+bool Thread::isStarted() const
+{
+    return (mHandle != 0);
+}
+
+void threadEntry(Thread* thread)
+{
+    thread->mProc(thread->mArg);
+    memThreadExit();
+}
+
+static void infoClear(FileInfo& info)
+{
+    info.type = ET_NONE;
+    info.size = 0;
+    info.alloc = 0;
+    info.mtime = 0;
+    info.ctime = 0;
+    info.dev = 0;
+    info.ino = 0;
 }
 
 #if defined SCDU_OS_WINDOWS
 
+    // directory listings by handle require Windows Vista or later
+
+    #if !defined _WIN32_WINNT || _WIN32_WINNT < 0x0600
+        #undef  _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
+
     #include <windows.h>
     #include <direct.h>
+    #include <process.h>
+
+    static_assert(  sizeof(CRITICAL_SECTION) <= sizeof(Uint64) * SYNC_DATA_MAX,
+                    "Mutex storage too small" );
+
+    static_assert(  sizeof(CONDITION_VARIABLE) <= sizeof(Uint64) * SYNC_DATA_MAX,
+                    "Cond storage too small" );
+
+    // directory records include size, times and file ids (the volume is
+    // read once per directory); allocation costs an extra call per entry
+
+    const Uint32 FF_LISTED = FF_SIZE | FF_MTIME | FF_CTIME | FF_ID;
+    const bool INO_LISTED = true;
+
+    // a large buffer returns hundreds of records per call; a name of 255
+    // UTF-16 units takes at most 3 bytes per unit in an ANSI code page
+
+    const Size DIR_BUF_SIZE = 64 * 1024;
+    const Size DIR_NAME_MAX = 255 * 3;
+
+    struct DirStream
+    {
+        HANDLE      handle;             // the directory itself
+        Uint64      volume;             // serial number (device of file ids)
+        UINT        codePage;           // that of the ANSI file functions
+        Uint8*      buf;
+        Size        pos;                // offset of next record
+        bool        pending;            // buf holds records not yet read
+        Size        len;                // length of path (with separator)
+        char        path[UPATH_MAX + 1];
+        char        name[DIR_NAME_MAX + 1];
+    };
+
+    static Int64 winWide(DWORD hi, DWORD lo)
+    {
+        return (Int64) ( ((Uint64) hi << 32) | lo );
+    }
+
+    static Int64 winTime(Int64 t)
+    {
+        // 100ns intervals since 1601 to nanoseconds since 1970
+
+        return (t - I64(116444736000000000)) * 100;
+    }
+
+    static void winInfo(DWORD attrs, Int64 size, Int64 mt, Int64 ct, Uint32 fields, FileInfo& info)
+    {
+        if      ( attrs & FILE_ATTRIBUTE_REPARSE_POINT )    info.type = ET_LINK;
+        else if ( attrs & FILE_ATTRIBUTE_DIRECTORY )        info.type = ET_DIR;
+        else if ( attrs & FILE_ATTRIBUTE_DEVICE )           info.type = ET_OTHER;
+        else                                                info.type = ET_FILE;
+
+        if ( (fields & FF_SIZE) && info.type == ET_FILE ) info.size = size;
+
+        if ( fields & FF_MTIME ) info.mtime = winTime(mt);
+        if ( fields & FF_CTIME ) info.ctime = winTime(ct);
+    }
+
+    static void winInfo(const WIN32_FILE_ATTRIBUTE_DATA& fad, Uint32 fields, FileInfo& info)
+    {
+        winInfo(    fad.dwFileAttributes,
+                    winWide(fad.nFileSizeHigh, fad.nFileSizeLow),
+                    winWide(fad.ftLastWriteTime.dwHighDateTime, fad.ftLastWriteTime.dwLowDateTime),
+                    winWide(fad.ftCreationTime.dwHighDateTime, fad.ftCreationTime.dwLowDateTime),
+                    fields,
+                    info );
+    }
+
+    static int winExtra(const char* path, Uint32 fields, FileInfo& info)
+    {
+        BY_HANDLE_FILE_INFORMATION  bhfi;
+        HANDLE                      h;
+        DWORD                       hi, lo;
+        BOOL                        ok;
+
+        if ( fields & FF_ALLOC )
+        {
+            // compressed size reflects sparse and compressed files
+            // but not cluster slack (which would need the volume geometry)
+
+            lo = GetCompressedFileSizeA(path, &hi);
+
+            if ( lo == INVALID_FILE_SIZE && GetLastError() != NO_ERROR ) return -1;
+
+            info.alloc = winWide(hi, lo);
+        }
+
+        if ( fields & FF_ID )
+        {
+            h = CreateFileA(    path,
+                                0,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                0,
+                                OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT,
+                                0 );
+
+            if ( h == INVALID_HANDLE_VALUE ) return -1;
+
+            ok = GetFileInformationByHandle(h, &bhfi);
+            CloseHandle(h);
+
+            if ( !ok ) return -1;
+
+            info.dev = bhfi.dwVolumeSerialNumber;
+            info.ino = ((Uint64) bhfi.nFileIndexHigh << 32) | bhfi.nFileIndexLow;
+        }
+
+        return 0;
+    }
+
+    static unsigned __stdcall threadStart(void* arg)
+    {
+        threadEntry((Thread*) arg);
+        return 0;
+    }
 
     int setMode(int fd, int mode)
     {
@@ -216,21 +423,659 @@ const char* fileGetS(char* line, Size max, File *stream)
         Sleep((unsigned int) milliseconds);
     }
 
+    const bool MALLOC_SIZE_EXACT = true;
+
     Size mallocSize(void* ptr)
     {
         return _msize(ptr);
     }
 
+    Size cpuCount()
+    {
+        SYSTEM_INFO si;
+
+        GetSystemInfo(&si);
+        return si.dwNumberOfProcessors == 0 ? 1 : si.dwNumberOfProcessors;
+    }
+
+    void Thread::start(ThreadProc proc, void* arg)
+    {
+        ASSERT(mHandle == 0);
+
+        mProc = proc;
+        mArg = arg;
+        mHandle = (void*) _beginthreadex(0, 0, threadStart, this, 0, 0);
+
+        if ( mHandle == 0 ) xer(XE_THREAD);
+    }
+
+    void Thread::join()
+    {
+        ASSERT(mHandle != 0);
+
+        WaitForSingleObject((HANDLE) mHandle, INFINITE);
+        CloseHandle((HANDLE) mHandle);
+        mHandle = 0;
+    }
+
+    Mutex::Mutex()
+    {
+        InitializeCriticalSection((CRITICAL_SECTION*) mData);
+    }
+
+    Mutex::~Mutex()
+    {
+        DeleteCriticalSection((CRITICAL_SECTION*) mData);
+    }
+
+    void Mutex::lock()
+    {
+        EnterCriticalSection((CRITICAL_SECTION*) mData);
+    }
+
+    void Mutex::unlock()
+    {
+        LeaveCriticalSection((CRITICAL_SECTION*) mData);
+    }
+
+    Cond::Cond()
+    {
+        InitializeConditionVariable((CONDITION_VARIABLE*) mData);
+    }
+
+    Cond::~Cond()
+    {
+        ;   // nothing to release
+    }
+
+    void Cond::wait(Mutex& mutex)
+    {
+        SleepConditionVariableCS(   (CONDITION_VARIABLE*) mData,
+                                    (CRITICAL_SECTION*) mutex.mData,
+                                    INFINITE );
+    }
+
+    void Cond::signal()
+    {
+        WakeConditionVariable((CONDITION_VARIABLE*) mData);
+    }
+
+    void Cond::broadcast()
+    {
+        WakeAllConditionVariable((CONDITION_VARIABLE*) mData);
+    }
+
+    int fileInfo(const char* path, FileInfo& info, Uint32 fields)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA fad;
+
+        infoClear(info);
+
+        if ( !GetFileAttributesExA(path, GetFileExInfoStandard, &fad) )
+        {
+            return -1;
+        }
+
+        winInfo(fad, fields, info);
+
+        // a single entry has no directory record, so its id is extra here
+
+        return winExtra(path, fields & ( FF_ALLOC | FF_ID ), info);
+    }
+
+    DirStream* dirOpen(const char* path)
+    {
+        BY_HANDLE_FILE_INFORMATION  bhfi;
+        DirStream*                  dir;
+        HANDLE                      h;
+        Size                        n;
+
+        n = strlen(path);
+        if ( n == 0 || n + 1 > UPATH_MAX ) return 0;
+
+        h = CreateFileA(    path,
+                            FILE_LIST_DIRECTORY,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            0,
+                            OPEN_EXISTING,
+                            FILE_FLAG_BACKUP_SEMANTICS,
+                            0 );
+
+        if ( h == INVALID_HANDLE_VALUE ) return 0;
+
+        if ( !GetFileInformationByHandle(h, &bhfi) )
+        {
+            CloseHandle(h);
+            return 0;
+        }
+
+        dir = 0;
+        memAlloc(&dir, sizeof(DirStream));
+
+        dir->handle = h;
+        dir->volume = bhfi.dwVolumeSerialNumber;
+        dir->codePage = AreFileApisANSI() ? CP_ACP : CP_OEMCP;
+
+        dir->buf = 0;
+        memAlloc(&dir->buf, DIR_BUF_SIZE);
+        dir->pos = 0;
+        dir->pending = false;
+
+        strcpy(dir->path, path);
+
+        if ( dir->path[n-1] != '\\' && dir->path[n-1] != '/' )
+        {
+            dir->path[n++] = '\\';
+        }
+
+        dir->path[n] = 0;
+        dir->len = n;
+
+        return dir;
+    }
+
+    // each call fills the buffer with a chain of records, the last of
+    // which has no offset to the next; the end of the listing is an error
+
+    static const FILE_ID_BOTH_DIR_INFO* winNext(DirStream* dir)
+    {
+        const FILE_ID_BOTH_DIR_INFO* rec;
+
+        if ( !dir->pending )
+        {
+            if ( !GetFileInformationByHandleEx( dir->handle,
+                                                FileIdBothDirectoryInfo,
+                                                dir->buf,
+                                                (DWORD) DIR_BUF_SIZE ) )
+            {
+                return 0;
+            }
+
+            dir->pos = 0;
+            dir->pending = true;
+        }
+
+        rec = (const FILE_ID_BOTH_DIR_INFO*) (dir->buf + dir->pos);
+
+        if ( rec->NextEntryOffset == 0 ) dir->pending = false;
+        else dir->pos += rec->NextEntryOffset;
+
+        return rec;
+    }
+
+    bool dirRead(DirStream* dir, DirEntry& entry, Uint32 fields)
+    {
+        const FILE_ID_BOTH_DIR_INFO*    rec;
+        const char*                     name;
+        int                             n;
+
+        while ( (rec = winNext(dir)) != 0 )
+        {
+            // names are converted as the ANSI find functions would convert
+            // them; one which does not fit could not be opened by them either
+
+            n = WideCharToMultiByte(    dir->codePage,
+                                        0,
+                                        rec->FileName,
+                                        (int) ( rec->FileNameLength / sizeof(WCHAR) ),
+                                        dir->name,
+                                        (int) DIR_NAME_MAX,
+                                        0,
+                                        0 );
+
+            if ( n <= 0 ) continue;
+
+            dir->name[n] = 0;
+            name = dir->name;
+
+            if ( name[0] == '.' && ( name[1] == 0 || ( name[1] == '.' && name[2] == 0 ) ) )
+            {
+                continue;
+            }
+
+            entry.name = name;
+            entry.len = (Size) n;
+
+            infoClear(entry.info);
+            entry.info.ino = (Uint64) rec->FileId.QuadPart;
+
+            winInfo(    rec->FileAttributes,
+                        rec->EndOfFile.QuadPart,
+                        rec->LastWriteTime.QuadPart,
+                        rec->CreationTime.QuadPart,
+                        fields,
+                        entry.info );
+
+            if ( fields & FF_ID ) entry.info.dev = dir->volume;
+
+            // unlisted fields are best effort: entries are not skipped
+            // just because they are locked or access is denied
+
+            if ( fields & ~FF_LISTED )
+            {
+                if ( dir->len + (Size) n <= UPATH_MAX )
+                {
+                    strcpy(dir->path + dir->len, name);
+                    winExtra(dir->path, fields & ~FF_LISTED, entry.info);
+                    dir->path[dir->len] = 0;
+                }
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    int dirInfo(DirStream* dir, const char* name, FileInfo& info, Uint32 fields)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA   fad;
+        int                         r;
+
+        if ( dir->len + strlen(name) > UPATH_MAX ) return -1;
+
+        strcpy(dir->path + dir->len, name);
+
+        r = -1;
+
+        if ( GetFileAttributesExA(dir->path, GetFileExInfoStandard, &fad) )
+        {
+            winInfo(fad, fields, info);
+
+            r = winExtra(dir->path, fields & ( FF_ALLOC | FF_ID ), info);
+        }
+
+        dir->path[dir->len] = 0;
+        return r;
+    }
+
+    int dirClose(DirStream* dir)
+    {
+        int r;
+
+        r = CloseHandle(dir->handle) ? 0 : -1;
+        memFree(&dir->buf, DIR_BUF_SIZE);
+        memFree(&dir, sizeof(DirStream));
+
+        return r;
+    }
+
+    const void* fileMap(const char* path, Size& size)
+    {
+        HANDLE          f, m;
+        LARGE_INTEGER   n;
+        void*           addr;
+
+        size = 0;
+
+        f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+        if ( f == INVALID_HANDLE_VALUE ) return 0;
+
+        if ( !GetFileSizeEx(f, &n) || n.QuadPart <= 0 || (Uint64) n.QuadPart > SIZE_VAL_MAX )
+        {
+            CloseHandle(f);
+            return 0;
+        }
+
+        m = CreateFileMappingA(f, 0, PAGE_READONLY, 0, 0, 0);
+        CloseHandle(f);
+
+        if ( m == 0 ) return 0;
+
+        // the view keeps the mapping alive after its handle is closed
+
+        addr = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(m);
+
+        if ( addr == 0 ) return 0;
+
+        size = (Size) n.QuadPart;
+        return addr;
+    }
+
+    void fileUnmap(const void* addr, Size size)
+    {
+        (void) size;
+
+        UnmapViewOfFile(addr);
+    }
+
+    // Large pages need the "lock pages in memory" privilege, which few
+    // accounts hold and which must also be enabled in the process token
+    // before VirtualAlloc() will grant any. Enabling it has no other effect;
+    // false is returned if the account does not hold it.
+
+    static bool lockPages()
+    {
+        HANDLE              token;
+        TOKEN_PRIVILEGES    tp;
+        bool                held = false;
+
+        if ( !OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token) )
+        {
+            return false;
+        }
+
+        tp.PrivilegeCount = 1;
+        tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+        // succeeds even if the privilege is not held (ERROR_NOT_ALL_ASSIGNED)
+
+        if ( LookupPrivilegeValueA(0, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid) &&
+             AdjustTokenPrivileges(token, FALSE, &tp, 0, 0, 0) )
+        {
+            held = GetLastError() == ERROR_SUCCESS;
+        }
+
+        CloseHandle(token);
+
+        return held;
+    }
+
+    // Large pages need the "lock pages in memory" privilege (enabled, where
+    // held, by initPlatform()), without which they are refused and ordinary
+    // pages are used instead. They are only
+    // used for whole large pages, since they are committed (and locked) at
+    // once, and so are known to have been obtained. The node is preferred
+    // rather than required, as VirtualAllocExNuma() falls back to others.
+
+    void* pageAlloc(Size size, Uint32 flags, PageInfo& info)
+    {
+        SYSTEM_INFO     si;
+        PROCESSOR_NUMBER pn;
+        USHORT          node;
+        DWORD           preferred = NUMA_NO_PREFERRED_NODE;
+        Size            large, n;
+        void*           addr = 0;
+
+        GetSystemInfo(&si);
+
+        info.page = si.dwPageSize;
+        info.size = ( size + info.page - 1 ) / info.page * info.page;
+        info.node = PG_NODE_NONE;
+        info.huge = false;
+        info.advised = false;
+
+        if ( flags & PG_LOCAL )
+        {
+            GetCurrentProcessorNumberEx(&pn);
+
+            if ( GetNumaProcessorNodeEx(&pn, &node) && node != 0xffff )
+            {
+                preferred = node;
+                info.node = node;
+            }
+        }
+
+        large = (flags & PG_HUGE) ? GetLargePageMinimum() : 0;
+
+        if ( large != 0 && size >= large )
+        {
+            n = ( size + large - 1 ) / large * large;
+
+            addr = VirtualAllocExNuma(  GetCurrentProcess(), 0, n,
+                                        MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                        PAGE_READWRITE, preferred );
+
+            if ( addr != 0 )
+            {
+                info.size = n;
+                info.page = large;
+                info.huge = true;
+                return addr;
+            }
+        }
+
+        return VirtualAllocExNuma(  GetCurrentProcess(), 0, info.size,
+                                    MEM_RESERVE | MEM_COMMIT,
+                                    PAGE_READWRITE, preferred );
+    }
+
+    void pageFree(void* addr, const PageInfo& info)
+    {
+        (void) info;
+
+        VirtualFree(addr, 0, MEM_RELEASE);
+    }
+
+    // what was obtained is known at allocation, so nothing is looked up:
+    // large pages are committed and locked at once, or not at all
+
+    void pageQuery(const void* addr, PageInfo& info)
+    {
+        (void) addr;
+        (void) info;
+    }
+
+    int fileReplace(const char* src, const char* dst)
+    {
+        return MoveFileExA(src, dst, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+    }
+
+    int makeDir(const char* path)
+    {
+        return CreateDirectoryA(path, 0) ? 0 : -1;
+    }
+
+    int fileRemove(const char* path)
+    {
+        return DeleteFileA(path) ? 0 : -1;
+    }
+
+    int dirRemove(const char* path)
+    {
+        return RemoveDirectoryA(path) ? 0 : -1;
+    }
+
+    // Copies times and attributes (e.g. read-only) of src to dst. Times are
+    // set first as a read-only file can no longer be opened for writing.
+
+    int fileCopyAttrs(const char* src, const char* dst)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA fad;
+        HANDLE  h;
+        BOOL    ok;
+
+        if ( !GetFileAttributesExA(src, GetFileExInfoStandard, &fad) ) return -1;
+
+        // backup semantics allow directories to be opened too
+
+        h = CreateFileA(    dst,
+                            FILE_WRITE_ATTRIBUTES,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            0,
+                            OPEN_EXISTING,
+                            FILE_FLAG_BACKUP_SEMANTICS,
+                            0 );
+
+        if ( h == INVALID_HANDLE_VALUE ) return -1;
+
+        ok = SetFileTime(h, &fad.ftCreationTime, &fad.ftLastAccessTime, &fad.ftLastWriteTime);
+        CloseHandle(h);
+
+        if ( !ok ) return -1;
+
+        return SetFileAttributesA(dst, fad.dwFileAttributes) ? 0 : -1;
+    }
+
 #else
 
+    #include <errno.h>
+    #include <fcntl.h>
     #include <unistd.h>
+    #include <dirent.h>
+    #include <pthread.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+
+    #if defined __linux__
+        #include <stddef.h>
+        #include <sys/syscall.h>
+        #include <sys/sysmacros.h>
+        #include <linux/mempolicy.h>
+    #endif
+
+    static_assert(  sizeof(pthread_mutex_t) <= sizeof(Uint64) * SYNC_DATA_MAX,
+                    "Mutex storage too small" );
+
+    static_assert(  sizeof(pthread_cond_t) <= sizeof(Uint64) * SYNC_DATA_MAX,
+                    "Cond storage too small" );
+
+    // listings only provide type and inode; everything else needs a stat
+
+    const Uint32 FF_LISTED = 0;
+    const bool INO_LISTED = true;
+
+    #if defined __linux__
+
+        // a large buffer returns thousands of entries per getdents64 call
+        // (glibc's readdir uses 32KB)
+
+        const Size DIR_BUF_SIZE = 256 * 1024;
+
+        struct LinuxDirent64
+        {
+            Uint64          d_ino;
+            Int64           d_off;
+            unsigned short  d_reclen;
+            unsigned char   d_type;
+            char            d_name[1];
+        };
+
+        struct DirStream
+        {
+            int     fd;
+            Uint8*  buf;
+            Size    len;                // bytes returned by last call
+            Size    pos;                // offset of next record
+        };
+
+    #else
+
+        struct DirStream
+        {
+            int     fd;
+            DIR*    dir;
+        };
+
+    #endif
+
+    static void nixInfo(const struct stat& st, Uint32 fields, FileInfo& info)
+    {
+        if      ( S_ISREG(st.st_mode) ) info.type = ET_FILE;
+        else if ( S_ISDIR(st.st_mode) ) info.type = ET_DIR;
+        else if ( S_ISLNK(st.st_mode) ) info.type = ET_LINK;
+        else                            info.type = ET_OTHER;
+
+        if ( (fields & FF_SIZE) && info.type == ET_FILE )
+        {
+            info.size = (Int64) st.st_size;
+        }
+
+        if ( fields & FF_ALLOC ) info.alloc = (Int64) st.st_blocks * 512;
+
+        #if defined __linux__
+            if ( fields & FF_MTIME ) info.mtime = (Int64) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+            if ( fields & FF_CTIME ) info.ctime = (Int64) st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+        #else
+            if ( fields & FF_MTIME ) info.mtime = (Int64) st.st_mtime * 1000000000;
+            if ( fields & FF_CTIME ) info.ctime = (Int64) st.st_ctime * 1000000000;
+        #endif
+
+        if ( fields & FF_ID )
+        {
+            info.dev = (Uint64) st.st_dev;
+            info.ino = (Uint64) st.st_ino;
+        }
+    }
+
+    static int nixStat(int dirfd, const char* name, Uint32 fields, FileInfo& info)
+    {
+        struct stat st;
+
+        #if defined STATX_BASIC_STATS
+
+            // statx lets the file system skip fields we have not asked for
+            // (which matters for network file systems in particular)
+
+            static bool noStatx = false;
+
+            struct statx    stx;
+            unsigned int    mask;
+
+            if ( !__atomic_load_n(&noStatx, __ATOMIC_RELAXED) )
+            {
+                mask = STATX_TYPE;
+
+                if ( fields & FF_SIZE )     mask |= STATX_SIZE;
+                if ( fields & FF_ALLOC )    mask |= STATX_BLOCKS;
+                if ( fields & FF_MTIME )    mask |= STATX_MTIME;
+                if ( fields & FF_CTIME )    mask |= STATX_CTIME;
+                if ( fields & FF_ID )       mask |= STATX_INO;
+
+                if ( statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &stx) == 0 )
+                {
+                    if      ( S_ISREG(stx.stx_mode) ) info.type = ET_FILE;
+                    else if ( S_ISDIR(stx.stx_mode) ) info.type = ET_DIR;
+                    else if ( S_ISLNK(stx.stx_mode) ) info.type = ET_LINK;
+                    else                              info.type = ET_OTHER;
+
+                    if ( (fields & FF_SIZE) && info.type == ET_FILE )
+                    {
+                        info.size = (Int64) stx.stx_size;
+                    }
+
+                    if ( fields & FF_ALLOC ) info.alloc = (Int64) stx.stx_blocks * 512;
+                    if ( fields & FF_MTIME ) info.mtime = (Int64) stx.stx_mtime.tv_sec * 1000000000 + stx.stx_mtime.tv_nsec;
+                    if ( fields & FF_CTIME ) info.ctime = (Int64) stx.stx_ctime.tv_sec * 1000000000 + stx.stx_ctime.tv_nsec;
+
+                    if ( fields & FF_ID )
+                    {
+                        info.dev = (Uint64) makedev(stx.stx_dev_major, stx.stx_dev_minor); // as st_dev
+                        info.ino = stx.stx_ino;
+                    }
+
+                    return 0;
+                }
+
+                if ( errno != ENOSYS ) return -1;
+
+                __atomic_store_n(&noStatx, true, __ATOMIC_RELAXED);
+            }
+
+        #endif
+
+        if ( fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0 ) return -1;
+
+        nixInfo(st, fields, info);
+        return 0;
+    }
+
+    static bool nixNeedStat(EntType type, Uint32 fields)
+    {
+        if ( type == ET_NONE ) return true;         // file system gave no type
+        if ( type == ET_FILE ) return fields != 0;
+
+        return (fields & ~FF_SIZE) != 0;            // only files have a size
+    }
+
+    static void* threadStart(void* arg)
+    {
+        threadEntry((Thread*) arg);
+        return 0;
+    }
 
     int setMode(int fd, int mode)
     {
-        return setmode (fd, mode);
+        // there is no text mode to leave
+
+        (void) fd;
+        (void) mode;
+
+        return 0;
     }
 
-    int setDir(char* path)
+    int setDir(const char* path)
     {
         return chdir(path);
     }
@@ -252,11 +1097,524 @@ const char* fileGetS(char* line, Size max, File *stream)
         usleep((useconds_t) (milliseconds * 1000));
     }
 
+    // glibc rounds blocks up and only reports the usable size
+
+    const bool MALLOC_SIZE_EXACT = false;
+
     Size mallocSize(void* ptr)
     {
         return malloc_usable_size(ptr);
     }
 
+    Size cpuCount()
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        return n < 1 ? 1 : (Size) n;
+    }
+
+    void Thread::start(ThreadProc proc, void* arg)
+    {
+        pthread_t t;
+
+        ASSERT(mHandle == 0);
+
+        mProc = proc;
+        mArg = arg;
+
+        if ( pthread_create(&t, 0, threadStart, this) != 0 ) xer(XE_THREAD);
+
+        mHandle = (void*) t;
+    }
+
+    void Thread::join()
+    {
+        ASSERT(mHandle != 0);
+
+        pthread_join((pthread_t) mHandle, 0);
+        mHandle = 0;
+    }
+
+    Mutex::Mutex()
+    {
+        pthread_mutex_init((pthread_mutex_t*) mData, 0);
+    }
+
+    Mutex::~Mutex()
+    {
+        pthread_mutex_destroy((pthread_mutex_t*) mData);
+    }
+
+    void Mutex::lock()
+    {
+        pthread_mutex_lock((pthread_mutex_t*) mData);
+    }
+
+    void Mutex::unlock()
+    {
+        pthread_mutex_unlock((pthread_mutex_t*) mData);
+    }
+
+    Cond::Cond()
+    {
+        pthread_cond_init((pthread_cond_t*) mData, 0);
+    }
+
+    Cond::~Cond()
+    {
+        pthread_cond_destroy((pthread_cond_t*) mData);
+    }
+
+    void Cond::wait(Mutex& mutex)
+    {
+        pthread_cond_wait((pthread_cond_t*) mData, (pthread_mutex_t*) mutex.mData);
+    }
+
+    void Cond::signal()
+    {
+        pthread_cond_signal((pthread_cond_t*) mData);
+    }
+
+    void Cond::broadcast()
+    {
+        pthread_cond_broadcast((pthread_cond_t*) mData);
+    }
+
+    int fileInfo(const char* path, FileInfo& info, Uint32 fields)
+    {
+        infoClear(info);
+
+        return nixStat(AT_FDCWD, path, fields, info);
+    }
+
+    DirStream* dirOpen(const char* path)
+    {
+        DirStream*  dir;
+        int         fd;
+
+        fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if ( fd < 0 ) return 0;
+
+        dir = 0;
+        memAlloc(&dir, sizeof(DirStream));
+        dir->fd = fd;
+
+        #if defined __linux__
+
+            dir->buf = 0;
+            memAlloc(&dir->buf, DIR_BUF_SIZE);
+            dir->len = 0;
+            dir->pos = 0;
+
+        #else
+
+            dir->dir = fdopendir(fd);
+
+            if ( dir->dir == 0 )
+            {
+                close(fd);
+                memFree(&dir, sizeof(DirStream));
+                return 0;
+            }
+
+        #endif
+
+        return dir;
+    }
+
+    // on Linux the length of a name is found from the length of its record,
+    // which is padded to 8 bytes after the terminator, so only the last few
+    // bytes need scanning (the padding itself is not necessarily zero)
+
+    static bool nixNext(DirStream* dir, const char*& name, Size& len, Uint64& ino, unsigned char& type)
+    {
+        #if defined __linux__
+
+            LinuxDirent64*  de;
+            long            n;
+            Size            at, end;
+
+            if ( dir->pos >= dir->len )
+            {
+                n = syscall(SYS_getdents64, dir->fd, dir->buf, DIR_BUF_SIZE);
+                if ( n <= 0 ) return false;
+
+                dir->len = (Size) n;
+                dir->pos = 0;
+            }
+
+            de = (LinuxDirent64*) (dir->buf + dir->pos);
+            dir->pos += de->d_reclen;
+
+            at = offsetof(LinuxDirent64, d_name);
+            end = de->d_reclen;
+            if ( end - at > 8 ) at = end - 8;
+
+            while ( at < end && ((char*) de)[at] != 0 ) at++;
+
+            len = at - offsetof(LinuxDirent64, d_name);
+
+        #else
+
+            struct dirent* de;
+
+            de = readdir(dir->dir);
+            if ( de == 0 ) return false;
+
+            len = strlen(de->d_name);
+
+        #endif
+
+        name = de->d_name;
+        ino = (Uint64) de->d_ino;
+        type = de->d_type;
+
+        return true;
+    }
+
+    bool dirRead(DirStream* dir, DirEntry& entry, Uint32 fields)
+    {
+        const char*     name;
+        Size            len;
+        Uint64          ino;
+        unsigned char   type;
+
+        while ( nixNext(dir, name, len, ino, type) )
+        {
+            if ( name[0] == '.' && ( name[1] == 0 || ( name[1] == '.' && name[2] == 0 ) ) )
+            {
+                continue;
+            }
+
+            entry.name = name;
+            entry.len = len;
+
+            infoClear(entry.info);
+            entry.info.ino = ino;
+
+            switch ( type )
+            {
+                case DT_REG:        entry.info.type = ET_FILE;  break;
+                case DT_DIR:        entry.info.type = ET_DIR;   break;
+                case DT_LNK:        entry.info.type = ET_LINK;  break;
+                case DT_UNKNOWN:    entry.info.type = ET_NONE;  break;
+                default:            entry.info.type = ET_OTHER; break;
+            }
+
+            // d_type avoids a stat unless fields are wanted that it lacks
+
+            if ( nixNeedStat(entry.info.type, fields) )
+            {
+                if ( nixStat(dir->fd, name, fields, entry.info) < 0 )
+                {
+                    continue;   // entry vanished since it was listed
+                }
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    int dirInfo(DirStream* dir, const char* name, FileInfo& info, Uint32 fields)
+    {
+        return nixStat(dir->fd, name, fields, info);
+    }
+
+    int dirClose(DirStream* dir)
+    {
+        int r;
+
+        #if defined __linux__
+            memFree(&dir->buf, DIR_BUF_SIZE);
+            r = close(dir->fd);
+        #else
+            r = closedir(dir->dir);
+        #endif
+
+        memFree(&dir, sizeof(DirStream));
+
+        return r;
+    }
+
+    const void* fileMap(const char* path, Size& size)
+    {
+        struct stat st;
+        void*       addr;
+        int         fd;
+
+        size = 0;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if ( fd < 0 ) return 0;
+
+        if ( fstat(fd, &st) < 0 || st.st_size <= 0 )
+        {
+            close(fd);
+            return 0;
+        }
+
+        // the mapping remains valid after the descriptor is closed
+
+        addr = mmap(0, (Size) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if ( addr == MAP_FAILED ) return 0;
+
+        size = (Size) st.st_size;
+        return addr;
+    }
+
+    void fileUnmap(const void* addr, Size size)
+    {
+        munmap((void*) addr, size);
+    }
+
+    #if defined __linux__
+
+        // Huge pages are the default size given in /proc/meminfo (2MB on
+        // x86-64), which transparent huge pages share. Threads may race to
+        // find it but all find the same.
+
+        static Size hugePageSize()
+        {
+            static Size size = 0;
+            FILE*       f;
+            char        line[128];
+            unsigned long kb;
+
+            if ( atomicGet(&size) != 0 ) return atomicGet(&size);
+
+            kb = 2048;
+            f = fopen("/proc/meminfo", "r");
+
+            if ( f != 0 )
+            {
+                while ( fgets(line, sizeof(line), f) != 0 )
+                {
+                    if ( sscanf(line, "Hugepagesize: %lu kB", &kb) == 1 ) break;
+                }
+
+                fclose(f);
+            }
+
+            atomicMax(&size, (Size) kb * 1024);
+
+            return atomicGet(&size);
+        }
+
+        // The range is bound to the node of the CPU the thread runs on now;
+        // the policy is preferred, so pages come from elsewhere rather than
+        // fail when the node is short of memory.
+
+        static int nodeBind(void* addr, Size size)
+        {
+            unsigned        cpu, node;
+            unsigned long   mask;
+
+            if ( syscall(SYS_getcpu, &cpu, &node, 0) != 0 ) return PG_NODE_NONE;
+            if ( node >= 8 * sizeof(mask) ) return PG_NODE_NONE;
+
+            mask = 1UL << node;
+
+            // the kernel counts one bit fewer than it is told
+
+            if ( syscall(SYS_mbind, addr, size, MPOL_PREFERRED, &mask, 8 * sizeof(mask) + 1, 0) != 0 )
+            {
+                return PG_NODE_NONE;
+            }
+
+            return (int) node;
+        }
+
+        // true if the mapping holding addr has any transparent huge pages
+
+        static bool isHugeBacked(const void* addr)
+        {
+            FILE*           f;
+            char            line[256];
+            unsigned long   lo, hi, kb;
+            unsigned long   a = (unsigned long) (Size) addr;
+            bool            in = false;
+            bool            whole = true;
+            bool            start;
+
+            f = fopen("/proc/self/smaps", "r");
+            if ( f == 0 ) return false;
+
+            kb = 0;
+
+            while ( fgets(line, sizeof(line), f) != 0 )
+            {
+                // the rest of a long line (e.g. a path) is skipped
+
+                start = whole;
+                whole = strchr(line, '\n') != 0;
+                if ( !start ) continue;
+
+                if ( sscanf(line, "%lx-%lx ", &lo, &hi) == 2 ) in = lo <= a && a < hi;
+                else if ( in && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ) break;
+            }
+
+            fclose(f);
+
+            return kb != 0;
+        }
+
+    #endif
+
+    // Reserved huge pages (hugetlbfs) are taken first, if the system has any
+    // spare. Otherwise the kernel is advised to use transparent huge pages,
+    // which it can only do for aligned ranges, so a huge page more is mapped
+    // and trimmed to alignment. Huge pages are only used for buffers of at
+    // least one of them, since a part-used huge page is all wasted.
+
+    void* pageAlloc(Size size, Uint32 flags, PageInfo& info)
+    {
+        void*   addr = MAP_FAILED;
+
+        info.page = (Size) sysconf(_SC_PAGESIZE);
+        info.size = ( size + info.page - 1 ) / info.page * info.page;
+        info.node = PG_NODE_NONE;
+        info.huge = false;
+        info.advised = false;
+
+        #if defined __linux__
+
+            Size    huge, n, lead;
+            Uint8*  p;
+
+            huge = (flags & PG_HUGE) ? hugePageSize() : 0;
+
+            if ( huge != 0 && size >= huge )
+            {
+                n = ( size + huge - 1 ) / huge * huge;
+
+                addr = mmap(0, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+                if ( addr != MAP_FAILED )
+                {
+                    info.size = n;
+                    info.page = huge;
+                    info.huge = true;
+                }
+                else
+                {
+                    p = (Uint8*) mmap(0, n + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+                    if ( p != MAP_FAILED )
+                    {
+                        lead = ( huge - (Size) p % huge ) % huge;
+
+                        if ( lead != 0 ) munmap(p, lead);
+                        munmap(p + lead + n, huge - lead);
+
+                        addr = p + lead;
+                        info.size = n;
+                        info.advised = madvise(addr, n, MADV_HUGEPAGE) == 0;
+                    }
+                }
+            }
+
+        #else
+
+            (void) flags;
+
+        #endif
+
+        if ( addr == MAP_FAILED )
+        {
+            addr = mmap(0, info.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+
+        if ( addr == MAP_FAILED ) return 0;
+
+        #if defined __linux__
+            if ( flags & PG_LOCAL ) info.node = nodeBind(addr, info.size);
+        #endif
+
+        return addr;
+    }
+
+    void pageFree(void* addr, const PageInfo& info)
+    {
+        munmap(addr, info.size);
+    }
+
+    // Finds the node of the first page (faulting it in if need be) and
+    // whether transparent huge pages were granted. This reads the process's
+    // memory map, so is only worth doing once a buffer has been used.
+
+    void pageQuery(const void* addr, PageInfo& info)
+    {
+        #if defined __linux__
+
+            int node;
+
+            if ( syscall(SYS_get_mempolicy, &node, 0, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) == 0 )
+            {
+                info.node = node;
+            }
+
+            if ( info.advised && isHugeBacked(addr) )
+            {
+                info.page = hugePageSize();
+                info.huge = true;
+            }
+
+        #else
+
+            (void) addr;
+            (void) info;
+
+        #endif
+    }
+
+    int fileReplace(const char* src, const char* dst)
+    {
+        return rename(src, dst);
+    }
+
+    int makeDir(const char* path)
+    {
+        return mkdir(path, 0777);
+    }
+
+    int fileRemove(const char* path)
+    {
+        return unlink(path);
+    }
+
+    int dirRemove(const char* path)
+    {
+        return rmdir(path);
+    }
+
+    // Copies access and modification times and permissions of src to dst.
+
+    int fileCopyAttrs(const char* src, const char* dst)
+    {
+        struct stat     st;
+        struct timespec ts[2];
+
+        if ( stat(src, &st) < 0 ) return -1;
+
+        #if defined __linux__
+            ts[0] = st.st_atim;
+            ts[1] = st.st_mtim;
+        #else
+            ts[0].tv_sec = st.st_atime;
+            ts[0].tv_nsec = 0;
+            ts[1].tv_sec = st.st_mtime;
+            ts[1].tv_nsec = 0;
+        #endif
+
+        if ( utimensat(AT_FDCWD, dst, ts, 0) < 0 ) return -1;
+
+        return chmod(dst, st.st_mode & 07777);
+    }
+
 #endif
 
 Uint64 strtoUint64(const char* str, char** endptr, int base)
@@ -81,7 +81,55 @@
 
 #elif defined SCDU_OS_LINUX
 
-    #error "-D SCDU_OS_LINUX compile option supported but not yet implemented"
+    const char* const SCDU_OS = "linux";
+
+    #if defined SCDU_ARCH_I386
+
+        #if defined __x86_64__
+            #error "linux compiler does not support i386 arch"
+        #endif
+
+        #define SCDU_M32
+
+        const char* const SCDU_ARCH = "i386";
+
+    #elif defined SCDU_ARCH_AMD64
+
+        #if !defined __x86_64__
+            #error "linux compiler does not support amd64 arch"
+        #endif
+
+        #define SCDU_M64
+
+        const char* const SCDU_ARCH = "amd64";
+
+    #else
+
+        #error "missing or invalid -D SCDU_ARCH_* compile option (linux)"
+
+    #endif
+
+    #if defined SCDU_MODE_DEBUG
+
+        #if defined NDEBUG
+            #error "invalid -D NDEBUG (No Debug) compile option in linux DEBUG build"
+        #endif
+
+        const char* const SCDU_MODE = "debug";
+
+    #elif defined SCDU_MODE_RELEASE
+
+        #if !defined NDEBUG
+            #error "missing -D NDEBUG (No Debug) compile option in linux RELEASE build"
+        #endif
+
+        const char* const SCDU_MODE = "release";
+
+    #else
+
+        #error "missing or invalid -D SCDU_MODE_* compile option (linux)"
+
+    #endif
 
 #elif defined SCDU_OS_DARWIN
 
@@ -109,21 +157,45 @@ typedef __INT64_TYPE__  Int64;
 
 // portable 64-bit and 32-bit literal and formatter macros
 
-#define U64(val) val ## ULL         // unsigned integer
-#define I64(val) val ## LL          // signed integer
+#if defined SCDU_OS_WINDOWS
+
+    #define U64(val) val ## ULL         // unsigned integer
+    #define I64(val) val ## LL          // signed integer
 
-#define F64u(mod) "%" #mod "I64u"   // unsigned decimal
-#define F64d(mod) "%" #mod "I64d"   // signed decimal
-#define F64x(mod) "%" #mod "I64x"   // hex (lowercase)
-#define F64X(mod) "%" #mod "I64X"   // HEX (UPPERCASE)
+    #define F64u(mod) "%" #mod "I64u"   // unsigned decimal
+    #define F64d(mod) "%" #mod "I64d"   // signed decimal
+    #define F64x(mod) "%" #mod "I64x"   // hex (lowercase)
+    #define F64X(mod) "%" #mod "I64X"   // HEX (UPPERCASE)
 
-#define U32(val) val ## UL          // unsigned integer
-#define I32(val) val ## L           // signed integer
+    #define U32(val) val ## UL          // unsigned integer
+    #define I32(val) val ## L           // signed integer
 
-#define F32u(mod) "%" #mod "I32u"   // unsigned decimal
-#define F32d(mod) "%" #mod "I32d"   // signed decimal
-#define F32x(mod) "%" #mod "I32x"   // hex (lowercase)
-#define F32X(mod) "%" #mod "I32X"   // HEX (UPPERCASE)
+    #define F32u(mod) "%" #mod "I32u"   // unsigned decimal
+    #define F32d(mod) "%" #mod "I32d"   // signed decimal
+    #define F32x(mod) "%" #mod "I32x"   // hex (lowercase)
+    #define F32X(mod) "%" #mod "I32X"   // HEX (UPPERCASE)
+
+#else
+
+    // 64-bit integers are long on 64-bit targets so C99 forms are used
+
+    #define U64(val) UINT64_C(val)      // unsigned integer
+    #define I64(val) INT64_C(val)       // signed integer
+
+    #define F64u(mod) "%" #mod PRIu64   // unsigned decimal
+    #define F64d(mod) "%" #mod PRId64   // signed decimal
+    #define F64x(mod) "%" #mod PRIx64   // hex (lowercase)
+    #define F64X(mod) "%" #mod PRIX64   // HEX (UPPERCASE)
+
+    #define U32(val) UINT32_C(val)      // unsigned integer
+    #define I32(val) INT32_C(val)       // signed integer
+
+    #define F32u(mod) "%" #mod PRIu32   // unsigned decimal
+    #define F32d(mod) "%" #mod PRId32   // signed decimal
+    #define F32x(mod) "%" #mod PRIx32   // hex (lowercase)
+    #define F32X(mod) "%" #mod PRIX32   // HEX (UPPERCASE)
+
+#endif
 
 // limits
 
@@ -196,10 +268,10 @@ typedef size_t  Size;
 
     #define SZ(val) val ## UL
 
-    #define FSu(mod) "%" #mod "I32u"   // signed decimal
-    #define FSd(mod) "%" #mod "I32d"   // unsigned decimal
-    #define FSx(mod) "%" #mod "I32x"   // hex (lowercase)
-    #define FSX(mod) "%" #mod "I32X"   // HEX (UPPERCASE)
+    #define FSu(mod) F32u(mod)          // signed decimal
+    #define FSd(mod) F32d(mod)          // unsigned decimal
+    #define FSx(mod) F32x(mod)          // hex (lowercase)
+    #define FSX(mod) F32X(mod)          // HEX (UPPERCASE)
 
 #elif defined SCDU_M64
 
@@ -210,12 +282,16 @@ typedef size_t  Size;
     const Size SIZE_DEC_MAX = UINT64_DEC_MAX;
     const Size SIZE_CSD_MAX = UINT64_CSD_MAX;
 
-    #define SZ(val) val ## ULL
+    #if defined SCDU_OS_WINDOWS
+        #define SZ(val) val ## ULL
+    #else
+        #define SZ(val) val ## UL
+    #endif
 
-    #define FSu(mod) "%" #mod "I64u"   // signed decimal
-    #define FSd(mod) "%" #mod "I64d"   // unsigned decimal
-    #define FSx(mod) "%" #mod "I64x"   // hex (lowercase)
-    #define FSX(mod) "%" #mod "I64X"   // HEX (UPPERCASE)
+    #define FSu(mod) F64u(mod)          // signed decimal
+    #define FSd(mod) F64d(mod)          // unsigned decimal
+    #define FSx(mod) F64x(mod)          // hex (lowercase)
+    #define FSX(mod) F64X(mod)          // HEX (UPPERCASE)
 
 #else
 
@@ -287,8 +363,179 @@ const Size UPATH_MAX = 2048;
 
 typedef FILE File;
 
+#if defined SCDU_OS_WINDOWS
+    const char PATH_SEP = '\\';
+#else
+    const char PATH_SEP = '/';
+#endif
+
+// directory entry types are deliberately coarse (links are never followed)
+
+enum EntType
+{
+    ET_NONE = -1,
+    ET_FILE = 0,
+    ET_DIR,
+    ET_LINK,
+    ET_OTHER,
+    ET_COUNT
+};
+
+// optional file information fields (type is always available)
+// only requested fields are gathered; others are left zero
+
+const Uint32 FF_SIZE    = 0x01;         // content size (regular files only)
+const Uint32 FF_ALLOC   = 0x02;         // space allocated on disk
+const Uint32 FF_MTIME   = 0x04;         // modification time
+const Uint32 FF_CTIME   = 0x08;         // status change time (Windows: creation)
+const Uint32 FF_ID      = 0x10;         // device and inode (Windows: volume and index)
+const Uint32 FF_ALL     = 0x1f;
+
+extern const Uint32 FF_LISTED;          // fields which dirRead() gets for free
+extern const bool INO_LISTED;           // dirRead() gets the inode for free
+
+struct FileInfo
+{
+    EntType     type;
+    Int64       size;                   // bytes
+    Int64       alloc;                  // bytes
+    Int64       mtime;                  // nanoseconds since 1970
+    Int64       ctime;                  // nanoseconds since 1970
+    Uint64      dev;
+    Uint64      ino;                    // also set by dirRead() where free
+};
+
+struct DirEntry
+{
+    const char* name;                   // valid until next dirRead()
+    Size        len;                    // length of name
+    FileInfo    info;
+};
+
+struct DirStream;                       // opaque, platform-specific
+
+// atomic operations are used sparingly for cross-thread counters
+// relaxed ordering is sufficient since threads are always joined
+// before their results are consumed
+
+inline Size atomicGet(const Size* p)            { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+inline Int64 atomicGet(const Int64* p)          { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+inline Size atomicAdd(Size* p, Size v)          { return __atomic_add_fetch(p, v, __ATOMIC_RELAXED); }
+inline Int64 atomicAdd(Int64* p, Int64 v)       { return __atomic_add_fetch(p, v, __ATOMIC_RELAXED); }
+inline Size atomicSub(Size* p, Size v)          { return __atomic_sub_fetch(p, v, __ATOMIC_RELAXED); }
+inline Int64 atomicSub(Int64* p, Int64 v)       { return __atomic_sub_fetch(p, v, __ATOMIC_RELAXED); }
+
+// stores v only if the value is still cur (true if it was)
+
+inline bool atomicCas(Size* p, Size cur, Size v)
+{
+    return __atomic_compare_exchange_n(p, &cur, v, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+inline void atomicMax(Size* p, Size v)
+{
+    Size cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+    while ( v > cur &&
+            !__atomic_compare_exchange_n(p, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+    {
+        ;   // cur is refreshed on failure
+    }
+}
+
+inline void atomicMax(Int64* p, Int64 v)
+{
+    Int64 cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+    while ( v > cur &&
+            !__atomic_compare_exchange_n(p, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+    {
+        ;   // cur is refreshed on failure
+    }
+}
+
+const Size THREADS_MAX = 64;
+
+typedef void (*ThreadProc)(void* arg);
+
+class Thread
+{
+public:
+    Thread();
+    ~Thread();
+    Thread(const Thread&) = delete;
+    Thread& operator=(const Thread&) = delete;
+    void start(ThreadProc proc, void* arg);
+    void join();
+    bool isStarted() const;
+
+    friend void threadEntry(Thread* thread);
+
+private:
+    void*       mHandle;
+    ThreadProc  mProc;
+    void*       mArg;
+};
+
+// mutexes and condition variables are kept in-place so they can be used
+// in static objects without heap allocation; storage is sized generously
+// for the native types of all supported platforms
+
+const Size SYNC_DATA_MAX = 8;
+
+class Mutex
+{
+friend class Cond;
+
+public:
+    Mutex();
+    ~Mutex();
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
+    void lock();
+    void unlock();
+
+private:
+    Uint64 mData[SYNC_DATA_MAX];
+};
+
+class Cond
+{
+public:
+    Cond();
+    ~Cond();
+    Cond(const Cond&) = delete;
+    Cond& operator=(const Cond&) = delete;
+    void wait(Mutex& mutex);
+    void signal();
+    void broadcast();
+
+private:
+    Uint64 mData[SYNC_DATA_MAX];
+};
+
+// I/O buffers are mapped whole pages at a time directly from the OS; the
+// flags only ask, so callers should look at what PageInfo says they got
+
+const Uint32 PG_HUGE    = 0x01;         // huge (large) pages where possible
+const Uint32 PG_LOCAL   = 0x02;         // NUMA node of calling thread
+
+const int PG_NODE_NONE  = -1;           // node unknown or not chosen
+
+struct PageInfo
+{
+    Size        size;                   // bytes mapped (whole pages)
+    Size        page;                   // page size obtained
+    int         node;                   // NUMA node
+    bool        huge;                   // on huge pages
+    bool        advised;                // huge pages advised (not assured)
+};
+
+extern const bool MALLOC_SIZE_EXACT;    // mallocSize() is the size asked for
+
 extern void initPlatform();
 extern bool platformInitialised();
+extern bool hugePagesAllowed();
 extern File* fileOpen(const char* path, const char* mode);
 extern int fileClose(File* stream);
 extern int fileFlush(File* stream);
@@ -300,12 +547,29 @@ extern int fileDesc(File *stream);
 extern Size fileBufCap(File *stream);
 extern Size fileBufLen(File *stream);
 extern const char* fileGetS(char* s, Size max, File *stream);
+extern int fileUnbuffer(File* stream);
 extern int setMode(int fd, int mode);
 extern int setDir(const char* path);
 extern const char* getDir();
 extern bool isConsole(int fd);
 extern Size mallocSize(void* ptr);
 extern void milliSleep(Size milliseconds);
+extern Size cpuCount();
+extern int fileInfo(const char* path, FileInfo& info, Uint32 fields = FF_SIZE);
+extern DirStream* dirOpen(const char* path);
+extern bool dirRead(DirStream* dir, DirEntry& entry, Uint32 fields = FF_SIZE);
+extern int dirInfo(DirStream* dir, const char* name, FileInfo& info, Uint32 fields);
+extern int dirClose(DirStream* dir);
+extern const void* fileMap(const char* path, Size& size);
+extern void fileUnmap(const void* addr, Size size);
+extern void* pageAlloc(Size size, Uint32 flags, PageInfo& info);
+extern void pageFree(void* addr, const PageInfo& info);
+extern void pageQuery(const void* addr, PageInfo& info);
+extern int fileReplace(const char* src, const char* dst);
+extern int makeDir(const char* path);
+extern int fileRemove(const char* path);
+extern int dirRemove(const char* path);
+extern int fileCopyAttrs(const char* src, const char* dst);
 extern Uint64 strtoUint64(const char* str, char** endptr, int base);
 
 // EOF
\ No newline at end of file
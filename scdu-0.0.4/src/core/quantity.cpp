@@ -57,7 +57,11 @@ const QtyDef qtyDefs[] =
 
     { QN_FILES,      "file",         "files",        "",     QF_DCS,  QR_ANY  },
     { QN_DIRS,       "directory",    "directories",  "",     QF_DCS,  QR_ANY  },
+    { QN_LINKS,      "link",         "links",        "",     QF_DCS,  QR_ANY  },
+    { QN_ITEMS,      "item",         "items",        "",     QF_DCS,  QR_ANY  },
+    { QN_LINES,      "line",         "lines",        "",     QF_DCS,  QR_ANY  },
     { QN_MATCHES,    "match",        "matches",      "",     QF_DCS,  QR_ANY  },
+    { QN_RANGES,     "range",        "ranges",       "",     QF_DCS,  QR_ANY  },
     { QN_CONFLICTS,  "conflict",     "conflicts",    "",     QF_DCS,  QR_ANY  },
     { QN_ERRORS,     "error",        "errors",       "",     QF_DCS,  QR_ANY  }
 };
@@ -82,7 +82,11 @@ enum QtyNum
     QN_CHARS,
     QN_FILES,
     QN_DIRS,
+    QN_LINKS,
+    QN_ITEMS,
+    QN_LINES,
     QN_MATCHES,
+    QN_RANGES,
     QN_CONFLICTS,
     QN_ERRORS,
     QN_COUNT
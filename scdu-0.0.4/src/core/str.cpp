@@ -5,17 +5,29 @@
 #include <ctype.h>
 #include <stdarg.h>
 
+#if defined __SSE2__
+    #include <immintrin.h>
+#endif
+
 #include "core.h"
 
-Str::Str()
+// AVX2 kernels are built alongside SSE2 ones and chosen at run time
+
+#if defined __SSE2__ && defined __GNUC__
+    #define CASE_AVX2
+#endif
+
+template <Size SIZE>
+StrT<SIZE>::StrT()
 {
     mLen = 0;
-    mCap = STRBUF_SIZE - 1;
+    mCap = sizeof(mBuf) - 1;
     mBuf[0] = 0;
     mC = mBuf;
 }
 
-Str::~Str()
+template <Size SIZE>
+StrT<SIZE>::~StrT()
 {
     if ( mC != mBuf )
     {
@@ -23,404 +35,510 @@ Str::~Str()
     }
 }
 
-Str::Str(const Str& str)
+template <Size SIZE>
+StrT<SIZE>::StrT(const StrT& str) : StrT()
 {
-    mLen = (Uint16) str.mLen;
+    assign(str.mC, str.mLen);
+}
+
+// a heap string is taken over rather than copied, leaving the source empty
 
-    if ( mLen < STRBUF_SIZE)
+template <Size SIZE>
+StrT<SIZE>::StrT(StrT&& str) : StrT()
+{
+    if ( str.mC == str.mBuf )
     {
-        mCap = STRBUF_SIZE - 1;
-        mC = mBuf;
+        assign(str.mC, str.mLen);
     }
     else
     {
-        mCap = mLen;
-        mC = 0;
-        memAlloc(&mC, mCap + 1);
+        mLen = str.mLen;
+        mCap = str.mCap;
+        mC = str.mC;
+
+        str.mCap = sizeof(mBuf) - 1;
+        str.mC = str.mBuf;
     }
 
-    strcpy(mC, str.mC);
+    str.mLen = 0;
+    str.mC[0] = 0;
 }
 
-Str::Str(const char c)
+template <Size SIZE>
+StrT<SIZE>::StrT(const char c) : StrT()
 {
-    mLen = c == 0 ? 0 : 1;
-    mCap = STRBUF_SIZE - 1;
-    mC = mBuf;
-
-    if ( mLen == 0)
-    {
-        mC[0] = 0;
-    }
-    else
-    {
-        mC[0] = c;
-        mC[1] = 0;
-    }
+    assign(&c, c == 0 ? 0 : 1);
 }
 
-Str::Str(const char* s)
+template <Size SIZE>
+StrT<SIZE>::StrT(const char* s) : StrT()
 {
-    mLen = (Uint16) strlen(s);
+    assign(s, strlen(s));
+}
 
-    if ( mLen < STRBUF_SIZE)
-    {
-        mCap = STRBUF_SIZE - 1;
-        mC = mBuf;
-    }
-    else
-    {
-        mCap = mLen;
-        mC = 0;
-        memAlloc(&mC, mCap + 1);
-    }
+template <Size SIZE>
+StrT<SIZE>::StrT(StrView v) : StrT()
+{
+    assign(v.cb(), v.len());
+}
 
-    strcpy(mC, s);
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator=(const StrT& rhs)
+{
+    if ( this != &rhs ) assign(rhs.mC, rhs.mLen);
+    return *this;
 }
 
-Str& Str::operator=(const Str& rhs)
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator=(StrT&& rhs)
 {
-    mLen = rhs.mLen;
+    if ( this == &rhs ) return *this;
 
-    if ( mC == mBuf )
+    if ( rhs.mC == rhs.mBuf )
     {
-        if ( mLen >= STRBUF_SIZE )
-        {
-            mCap = mLen;
-            mC = 0;
-            memAlloc(&mC, mCap + 1);
-        }
+        assign(rhs.mC, rhs.mLen);
     }
     else
     {
-        if ( mLen < STRBUF_SIZE )
-        {
-            memFree(&mC, mCap + 1);
-            mCap = STRBUF_SIZE - 1;
-            mC = mBuf;
-        }
-        else
-        {
-            memRealloc(&mC, mLen + 1, mCap + 1);
-            mCap = mLen;
-        }
+        if ( mC != mBuf ) memFree(&mC, mCap + 1);
+
+        mLen = rhs.mLen;
+        mCap = rhs.mCap;
+        mC = rhs.mC;
+
+        rhs.mCap = sizeof(mBuf) - 1;
+        rhs.mC = rhs.mBuf;
     }
 
-    strcpy(mC, rhs.mC);
+    rhs.mLen = 0;
+    rhs.mC[0] = 0;
+
     return *this;
 }
 
-Str& Str::operator=(const char* rhs)
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator=(const char* rhs)
 {
-    mLen = (Uint16) strlen(rhs);
+    assign(rhs, strlen(rhs));
+    return *this;
+}
 
-    if ( mC == mBuf )
-    {
-        if ( mLen >= STRBUF_SIZE )
-        {
-            mCap = mLen;
-            mC = 0;
-            memAlloc(&mC, mCap + 1);
-        }
-    }
-    else
-    {
-        if ( mLen < STRBUF_SIZE )
-        {
-            memFree(&mC, mCap + 1);
-            mCap = STRBUF_SIZE - 1;
-            mC = mBuf;
-        }
-        else
-        {
-            memRealloc(&mC, mLen + 1, mCap + 1);
-            mCap = mLen;
-        }
-    }
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator=(const char rhs)
+{
+    assign(&rhs, rhs == 0 ? 0 : 1);
+    return *this;
+}
 
-    strcpy(mC, rhs);
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator=(StrView rhs)
+{
+    assign(rhs.cb(), rhs.len());
     return *this;
 }
 
-Str& Str::operator=(const char rhs)
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator+=(const StrT& rhs)
 {
-    mLen = rhs == 0 ? 0 : 1;
+    append(rhs.mC, rhs.mLen);
+    return *this;
+}
 
-    if ( mC != mBuf )
-    {
-        memFree(&mC, mCap + 1);
-    }
-    else
-    {
-        mCap = STRBUF_SIZE - 1;
-        mC = mBuf;
-    }
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator+=(const char* rhs)
+{
+    append(rhs, strlen(rhs));
+    return *this;
+}
 
-    if ( mLen == 0)
-    {
-        mC[0] = 0;
-    }
-    else
-    {
-        mC[0] = rhs;
-        mC[1] = 0;
-    }
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator+=(const char rhs)
+{
+    if ( rhs != 0 ) append(&rhs, 1);
+    return *this;
+}
 
+template <Size SIZE>
+StrT<SIZE>& StrT<SIZE>::operator+=(StrView rhs)
+{
+    append(rhs.cb(), rhs.len());
     return *this;
 }
 
-Str& Str::operator+=(const Str& rhs)
+template <Size SIZE>
+bool StrT<SIZE>::operator==(const StrT& rhs) const
 {
-    Uint16 old_len, rhs_len;
+    return ( strcmp(mC, rhs.mC) == 0 );
+}
 
-    rhs_len = rhs.mLen;
+template <Size SIZE>
+bool StrT<SIZE>::operator==(const char* rhs) const
+{
+    return ( strcmp(mC, rhs) == 0 );
+}
 
-    if ( rhs_len == 0 )
-    {
-        return *this;
-    }
+template <Size SIZE>
+bool StrT<SIZE>::operator==(const char rhs) const
+{
+    return ( mC[0] == rhs && mC[1] == 0 );
+}
 
-    old_len = mLen;
-    mLen = (Uint16) (old_len + rhs_len);
+template <Size SIZE>
+bool StrT<SIZE>::operator==(StrView rhs) const
+{
+    return ( mLen == rhs.len() && memcmp(mC, rhs.cb(), mLen) == 0 );
+}
 
-    if ( mC == mBuf )
-    {
-        if ( mLen >= STRBUF_SIZE )
-        {
-            mCap = mLen;
-            mC = 0;
-            memAlloc(&mC, mCap + 1);
-            strcpy(mC, mBuf);
-        }
-    }
-    else
-    {
-        memRealloc(&mC, mLen + 1, mCap + 1);
-        mCap = mLen;
-    }
+template <Size SIZE>
+Size StrT<SIZE>::len() const
+{
+    return mLen;
+}
 
-    strcpy(mC + old_len, rhs.mC);
-    return *this;
+template <Size SIZE>
+Size StrT<SIZE>::cap() const
+{
+    return mCap;
+}
+
+template <Size SIZE>
+const char* StrT<SIZE>::cb() const
+{
+    return mC;
 }
 
-Str& Str::operator+=(const char* rhs)
+template <Size SIZE>
+const char* StrT<SIZE>::ce() const
 {
-    Uint16 old_len, rhs_len;
+    return mC + mLen;
+}
 
-    rhs_len = (Uint16) strlen(rhs);
+template <Size SIZE>
+int StrT<SIZE>::cmp(const StrT& str) const
+{
+    return strcmp(mC, str.mC);
+}
 
-    if ( rhs_len == 0 )
-    {
-        return *this;
-    }
+template <Size SIZE>
+int StrT<SIZE>::cmp(const char* s) const
+{
+    return strcmp(mC, s);
+}
+
+// makes room for at least len chars (and terminator) without ever shrinking
+
+template <Size SIZE>
+void StrT<SIZE>::reserve(Size len)
+{
+    char* c = 0;
+
+    if ( len <= mCap ) return;
 
-    old_len = mLen;
-    mLen = (Uint16) (old_len + rhs_len);
+    ASSERT_ALWAYS(len <= STR_LEN_MAX);
 
     if ( mC == mBuf )
     {
-        if ( mLen >= STRBUF_SIZE )
-        {
-            mCap = mLen;
-            mC = 0;
-            memAlloc(&mC, mCap + 1);
-            strcpy(mC, mBuf);
-        }
+        memAlloc(&c, len + 1);
+        memcpy(c, mBuf, mLen + 1);
+        mC = c;
     }
     else
     {
-        memRealloc(&mC, mLen + 1, mCap + 1);
-        mCap = mLen;
+        memRealloc(&mC, len + 1, mCap + 1);
     }
 
-    strcpy(mC + old_len, rhs);
-    return *this;
+    mCap = (Uint16) len;
 }
 
-Str& Str::operator+=(const char rhs)
+// capacity grows geometrically so that building a string piece by piece
+// takes a logarithmic number of reallocations
+
+template <Size SIZE>
+void StrT<SIZE>::fit(Size len)
 {
-    if ( rhs == 0 )
-    {
-        return *this;
-    }
+    Size cap;
 
-    mLen = (Uint16) (mLen + 1);
+    if ( len <= mCap ) return;
 
-    if ( mC == mBuf )
-    {
-        if ( mLen >= STRBUF_SIZE )
-        {
-            mCap = mLen;
-            mC = 0;
-            memAlloc(&mC, mCap + 1);
-            strcpy(mC, mBuf);
-        }
-    }
-    else
-    {
-        memRealloc(&mC, mLen + 1, mCap + 1);
-        mCap = mLen;
-    }
+    cap = 2 * (Size) mCap;
+    if ( cap > STR_LEN_MAX ) cap = STR_LEN_MAX;
+    if ( cap < len ) cap = len;
 
-    mC[mLen-1] = rhs;
-    mC[mLen] = 0;
+    reserve(cap);
+}
 
-    return *this;
+// the source may lie within the string itself (and move as it grows)
+
+template <Size SIZE>
+void StrT<SIZE>::assign(const char* s, Size n)
+{
+    Size off = s >= mC && s <= mC + mLen ? (Size) (s - mC) : SIZE_VAL_MAX;
+
+    fit(n);
+    if ( off != SIZE_VAL_MAX ) s = mC + off;
+
+    memmove(mC, s, n);
+    mLen = (Uint16) n;
+    mC[mLen] = 0;
 }
 
-bool Str::operator==(const Str& rhs) const
+template <Size SIZE>
+void StrT<SIZE>::append(const char* s, Size n)
 {
-    return ( strcmp(mC, rhs.mC) == 0 );
+    Size off = s >= mC && s <= mC + mLen ? (Size) (s - mC) : SIZE_VAL_MAX;
+
+    if ( n == 0 ) return;
+
+    fit(mLen + n);
+    if ( off != SIZE_VAL_MAX ) s = mC + off;
+
+    memmove(mC + mLen, s, n);
+    mLen = (Uint16) (mLen + n);
+    mC[mLen] = 0;
 }
 
-bool Str::operator==(const char* rhs) const
+// only these are built, so the code above need not be in the header
+
+template class StrT<STR_SIZE>;
+template class StrT<PATHSTR_SIZE>;
+
+// The result is sized once for both operands. Where the left operand is a
+// temporary (as in all but the first step of a chain like "a" + s + "/" + n)
+// it is appended to in place and passed on, so a chain builds one string.
+
+template <Size SIZE>
+StrT<SIZE> operator+(const StrT<SIZE>& lhs, const StrT<SIZE>& rhs)
 {
-    return ( strcmp(mC, rhs) == 0 );
+    StrT<SIZE> str;
+
+    str.reserve(lhs.len() + rhs.len());
+    str += lhs;
+    str += rhs;
+
+    return str;
 }
 
-bool Str::operator==(const char rhs) const
+template <Size SIZE>
+StrT<SIZE> operator+(const StrT<SIZE>& lhs, const char* rhs)
 {
-    return ( mC[0] == rhs && mC[1] == 0 );
+    StrT<SIZE>  str;
+    Size        rhs_len = strlen(rhs);
+
+    str.reserve(lhs.len() + rhs_len);
+    str += lhs;
+    str += StrView(rhs, rhs_len);
+
+    return str;
 }
 
-Size Str::len() const
+template <Size SIZE>
+StrT<SIZE> operator+(const char* lhs, const StrT<SIZE>& rhs)
 {
-    return mLen;
+    StrT<SIZE>  str;
+    Size        lhs_len = strlen(lhs);
+
+    str.reserve(lhs_len + rhs.len());
+    str += StrView(lhs, lhs_len);
+    str += rhs;
+
+    return str;
 }
 
-const char* Str::cb() const
+// as with +=, a null char adds nothing
+
+template <Size SIZE>
+StrT<SIZE> operator+(const StrT<SIZE>& lhs, const char rhs)
 {
-    return mC;
+    StrT<SIZE> str;
+
+    str.reserve(lhs.len() + 1);
+    str += lhs;
+    str += rhs;
+
+    return str;
 }
 
-const char* Str::ce() const
+template <Size SIZE>
+StrT<SIZE> operator+(const char lhs, const StrT<SIZE>& rhs)
 {
-    return mC + mLen;
+    StrT<SIZE> str;
+
+    str.reserve(rhs.len() + 1);
+    str += lhs;
+    str += rhs;
+
+    return str;
 }
 
-int Str::cmp(const Str& str) const
+template <Size SIZE>
+StrT<SIZE> operator+(StrT<SIZE>&& lhs, const StrT<SIZE>& rhs)
 {
-    return strcmp(mC, str.mC);
+    lhs += rhs;
+    return static_cast<StrT<SIZE>&&>(lhs);
 }
 
-int Str::cmp(const char* s) const
+template <Size SIZE>
+StrT<SIZE> operator+(StrT<SIZE>&& lhs, const char* rhs)
 {
-    return strcmp(mC, s);
+    lhs += rhs;
+    return static_cast<StrT<SIZE>&&>(lhs);
 }
 
-Str operator+(const Str& lhs, const Str& rhs)
+template <Size SIZE>
+StrT<SIZE> operator+(StrT<SIZE>&& lhs, const char rhs)
 {
-    Str str;
+    lhs += rhs;
+    return static_cast<StrT<SIZE>&&>(lhs);
+}
 
-    Uint16 lhs_len = lhs.mLen;
-    Uint16 rhs_len = rhs.mLen;
+template <Size SIZE>
+StrT<SIZE> operator+(StrT<SIZE>&& lhs, StrView rhs)
+{
+    lhs += rhs;
+    return static_cast<StrT<SIZE>&&>(lhs);
+}
 
-    str.mLen = (Uint16) (lhs_len + rhs_len);
+// built for the same types as StrT itself
+
+template Str operator+(const Str& lhs, const Str& rhs);
+template Str operator+(const Str& lhs, const char* rhs);
+template Str operator+(const char* lhs, const Str& rhs);
+template Str operator+(const Str& lhs, const char rhs);
+template Str operator+(const char lhs, const Str& rhs);
+template Str operator+(Str&& lhs, const Str& rhs);
+template Str operator+(Str&& lhs, const char* rhs);
+template Str operator+(Str&& lhs, const char rhs);
+template Str operator+(Str&& lhs, StrView rhs);
+
+template PathStr operator+(const PathStr& lhs, const PathStr& rhs);
+template PathStr operator+(const PathStr& lhs, const char* rhs);
+template PathStr operator+(const char* lhs, const PathStr& rhs);
+template PathStr operator+(const PathStr& lhs, const char rhs);
+template PathStr operator+(const char lhs, const PathStr& rhs);
+template PathStr operator+(PathStr&& lhs, const PathStr& rhs);
+template PathStr operator+(PathStr&& lhs, const char* rhs);
+template PathStr operator+(PathStr&& lhs, const char rhs);
+template PathStr operator+(PathStr&& lhs, StrView rhs);
+
+// views compare bytewise like strcmp() with the shorter of two otherwise
+// equal views ordered first
+
+int StrView::cmp(StrView v) const
+{
+    Size    n = mLen < v.mLen ? mLen : v.mLen;
+    int     r = n == 0 ? 0 : memcmp(mP, v.mP, n);
 
-    if ( str.mLen >= STRBUF_SIZE)
-    {
-        str.mCap = str.mLen;
-        str.mC = 0;
-        memAlloc(&str.mC, str.mCap + 1);
-    }
+    if ( r != 0 ) return r;
 
-    strcpy(str.mC, lhs.mC);
-    strcpy(str.mC + lhs_len, rhs.mC);
+    return mLen < v.mLen ? -1 : mLen > v.mLen ? 1 : 0;
+}
 
-    return str;
+bool StrView::startsWith(StrView v) const
+{
+    return v.mLen <= mLen && memcmp(mP, v.mP, v.mLen) == 0;
 }
 
-Str operator+(const Str& lhs, const char* rhs)
+bool StrView::endsWith(StrView v) const
 {
-    Str str;
+    return v.mLen <= mLen && memcmp(mP + mLen - v.mLen, v.mP, v.mLen) == 0;
+}
 
-    Uint16 lhs_len = lhs.mLen;
-    Uint16 rhs_len = (Uint16) strlen(rhs);
+// searches return the position found or STR_NONE
 
-    str.mLen = (Uint16) (lhs_len + rhs_len);
+Size StrView::find(char c, Size from) const
+{
+    const char* p;
 
-    if ( str.mLen >= STRBUF_SIZE)
-    {
-        str.mCap = str.mLen;
-        str.mC = 0;
-        memAlloc(&str.mC, str.mCap + 1);
-    }
+    if ( from >= mLen ) return STR_NONE;
 
-    strcpy(str.mC, lhs.mC);
-    strcpy(str.mC + lhs_len, rhs);
+    p = (const char*) memchr(mP + from, c, mLen - from);
 
-    return str;
+    return p == 0 ? STR_NONE : (Size) (p - mP);
 }
 
-Str operator+(const char* lhs, const Str& rhs)
+Size StrView::find(StrView v, Size from) const
 {
-    Str str;
+    const char* p;
+    const char* last;
 
-    Uint16 lhs_len = (Uint16) strlen(lhs);
-    Uint16 rhs_len = rhs.mLen;
+    if ( from > mLen || v.mLen > mLen - from ) return STR_NONE;
+    if ( v.mLen == 0 ) return from;
 
-    str.mLen = (Uint16) (lhs_len + rhs_len);
+    p = mP + from;
+    last = mP + mLen - v.mLen;
 
-    if ( str.mLen >= STRBUF_SIZE)
+    while ( p <= last )
     {
-        str.mCap = str.mLen;
-        str.mC = 0;
-        memAlloc(&str.mC, str.mCap + 1);
-    }
+        p = (const char*) memchr(p, v.mP[0], last - p + 1);
+        if ( p == 0 ) break;
 
-    strcpy(str.mC, lhs);
-    strcpy(str.mC + lhs_len, rhs.mC);
+        if ( memcmp(p + 1, v.mP + 1, v.mLen - 1) == 0 ) return (Size) (p - mP);
+        p++;
+    }
 
-    return str;
+    return STR_NONE;
 }
 
-Str operator+(const Str& lhs, const char rhs)
+Size StrView::findLast(char c) const
 {
-    Str str;
-
-    if ( rhs == 0 )
+    for ( Size i = mLen; i > 0; i-- )
     {
-        return str;
+        if ( mP[i-1] == c ) return i - 1;
     }
 
-    str.mLen = (Uint16) (lhs.mLen + 1);
+    return STR_NONE;
+}
 
-    if ( str.mLen >= STRBUF_SIZE)
-    {
-        str.mCap = str.mLen;
-        str.mC = 0;
-        memAlloc(&str.mC, str.mCap + 1);
-    }
+// out of range positions and lengths are clipped to the view
 
-    strcpy(str.mC, lhs.mC);
-    str.mC[str.mLen-1] = rhs;
-    str.mC[str.mLen] = 0;
+StrView StrView::sub(Size pos, Size len) const
+{
+    if ( pos > mLen ) pos = mLen;
+    if ( len > mLen - pos ) len = mLen - pos;
 
-    return str;
+    return StrView(mP + pos, len);
 }
 
-Str operator+(const char lhs, const Str& rhs)
+// splits at the first separator: head is what precedes it and tail what
+// follows; without one, head is the whole view, tail is empty and false
+// is returned (so a loop on tail visits every field, empty ones included)
+
+bool StrView::split(char sep, StrView& head, StrView& tail) const
 {
-    Str str;
+    Size    at = find(sep);
+    StrView v = *this;
 
-    if ( lhs == 0 )
+    if ( at == STR_NONE )
     {
-        return str;
+        head = v;
+        tail = StrView(v.mP + v.mLen, 0);
+        return false;
     }
 
-    str.mLen = (Uint16) (rhs.mLen + 1);
+    head = StrView(v.mP, at);
+    tail = StrView(v.mP + at + 1, v.mLen - at - 1);
 
-    if ( str.mLen >= STRBUF_SIZE)
-    {
-        str.mCap = str.mLen;
-        str.mC = 0;
-        memAlloc(&str.mC, str.mCap + 1);
-    }
+    return true;
+}
 
-    *str.mC = lhs;
-    strcpy(str.mC + 1, rhs.mC);
+// joins directory and name into buf with a separator between unless the
+// directory is empty or already ends with one (like a root); the result
+// is null terminated and its length returned or -1 if longer than max
 
-    return str;
+int pathJoin(char* buf, Size max, StrView dir, StrView name)
+{
+    Size    n = dir.len();
+    bool    sep = n > 0 && dir[n-1] != '/' && dir[n-1] != PATH_SEP;
+    Size    len = n + ( sep ? 1 : 0 ) + name.len();
+
+    if ( len > max ) return -1;
+
+    memmove(buf, dir.cb(), n);
+    if ( sep ) buf[n++] = PATH_SEP;
+    memmove(buf + n, name.cb(), name.len());
+    buf[len] = 0;
+
+    return (int) len;
 }
 
 // the following is faster than strlen(s) == 0
@@ -538,44 +656,268 @@ bool strIsDec(char* s)
 
 void strToLower(char* s)
 {
-    while ( char c = *s != 0 )
-    {
-        *s++ = (char) tolower(c);
-    }
+    caseToLower(s, s, strlen(s));
 }
 
 void strToUpper(char* s)
 {
-    while ( char c = *s != 0 )
-    {
-        *s++ = (char) toupper(c);
-    }
+    caseToUpper(s, s, strlen(s));
 }
 
 void strnToLower(char* s, Size max)
 {
-    Size i;
     Size len = strlen(s);
 
     if ( len > max ) len = max;
 
-    for (i = 0; i < len; i++)
-    {
-        s[i] = (char) tolower(s[i]);
-    }
+    caseToLower(s, s, len);
 }
 
 void strnToUpper(char* s, Size max)
 {
-    Size i;
     Size len = strlen(s);
 
     if ( len > max ) len = max;
 
-    for (i = 0; i < len; i++)
+    caseToUpper(s, s, len);
+}
+
+// Letters are recognised arithmetically rather than by table or <ctype.h>,
+// so only ASCII letters are ever converted: bytes of 128 and over (e.g. in
+// UTF-8 sequences) always pass through unchanged whatever the sign of char
+// and the locale. The vector forms do the same 16 bytes at a time with SSE2
+// or 32 at a time with AVX2 where the CPU has it.
+
+static inline char caseFlip(char c, char lo)
+{
+    return (Uint8) (c - lo) < 26 ? (char) (c ^ 0x20) : c;
+}
+
+#if defined __SSE2__
+
+    // Flips the case of bytes in lo..lo+25 (the letters of one case): the
+    // add moves that range to the bottom of the signed range so that one
+    // comparison finds it.
+
+    static inline __m128i caseFlip16(__m128i v, char lo)
+    {
+        __m128i t = _mm_add_epi8(v, _mm_set1_epi8((char) (-128 - lo)));
+        __m128i m = _mm_cmplt_epi8(t, _mm_set1_epi8(-128 + 26));
+
+        return _mm_xor_si128(v, _mm_and_si128(m, _mm_set1_epi8(0x20)));
+    }
+
+#endif
+
+#if defined CASE_AVX2
+
+    static bool hasAvx2()
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+
+    // false until initialised, which just means SSE2 is used until then
+
+    static const bool caseAvx2 = hasAvx2();
+
+    __attribute__((target("avx2")))
+    static inline __m256i caseFlip32(__m256i v, char lo)
+    {
+        __m256i t = _mm256_add_epi8(v, _mm256_set1_epi8((char) (-128 - lo)));
+        __m256i m = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), t);
+
+        return _mm256_xor_si256(v, _mm256_and_si256(m, _mm256_set1_epi8(0x20)));
+    }
+
+    __attribute__((target("avx2")))
+    static Size caseConvert32(char* dst, const char* src, Size len, char lo)
+    {
+        Size i;
+
+        for ( i = 0; i + 32 <= len; i += 32 )
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+            _mm256_storeu_si256((__m256i*) (dst + i), caseFlip32(v, lo));
+        }
+
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    static Size caseSame32(const char* a, const char* b, Size len)
+    {
+        Size i;
+
+        for ( i = 0; i + 32 <= len; i += 32 )
+        {
+            __m256i x = caseFlip32(_mm256_loadu_si256((const __m256i*) (a + i)), 'A');
+            __m256i y = caseFlip32(_mm256_loadu_si256((const __m256i*) (b + i)), 'A');
+
+            if ( (Uint32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFF ) break;
+        }
+
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    static bool caseFind32(const char* s, Size last, const char* pat, Size n, Size& i)
+    {
+        const __m256i f = _mm256_set1_epi8(caseFlip(pat[0], 'A'));
+        const __m256i l = _mm256_set1_epi8(caseFlip(pat[n - 1], 'A'));
+
+        for ( ; i + 32 <= last + 1; i += 32 )
+        {
+            __m256i x = caseFlip32(_mm256_loadu_si256((const __m256i*) (s + i)), 'A');
+            __m256i y = caseFlip32(_mm256_loadu_si256((const __m256i*) (s + i + n - 1)), 'A');
+            Uint32  m = (Uint32) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(x, f), _mm256_cmpeq_epi8(y, l)));
+
+            while ( m != 0 )
+            {
+                Size c = i + (Size) __builtin_ctz(m);
+
+                if ( caseCmp(s + c, pat, n) == 0 )
+                {
+                    i = c;
+                    return true;
+                }
+
+                m &= m - 1;
+            }
+        }
+
+        return false;
+    }
+
+#endif
+
+static void caseConvert(char* dst, const char* src, Size len, char lo)
+{
+    Size i = 0;
+
+    #if defined CASE_AVX2
+
+        if ( caseAvx2 ) i = caseConvert32(dst, src, len, lo);
+
+    #endif
+
+    #if defined __SSE2__
+
+        for ( ; i + 16 <= len; i += 16 )
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+            _mm_storeu_si128((__m128i*) (dst + i), caseFlip16(v, lo));
+        }
+
+    #endif
+
+    for ( ; i < len; i++ ) dst[i] = caseFlip(src[i], lo);
+}
+
+// Copies len bytes from src to dst (which may be the same) converting ASCII
+// letters to lower case.
+
+void caseToLower(char* dst, const char* src, Size len)
+{
+    caseConvert(dst, src, len, 'A');
+}
+
+void caseToUpper(char* dst, const char* src, Size len)
+{
+    caseConvert(dst, src, len, 'a');
+}
+
+// Compares len bytes ignoring the case of ASCII letters. The result is as
+// for memcmp() after converting both to lower case.
+
+int caseCmp(const char* a, const char* b, Size len)
+{
+    Size i = 0;
+
+    #if defined CASE_AVX2
+
+        if ( caseAvx2 ) i = caseSame32(a, b, len);
+
+    #endif
+
+    #if defined __SSE2__
+
+        // vectors only skip what is the same; the scalar loop pinpoints
+
+        for ( ; i + 16 <= len; i += 16 )
+        {
+            __m128i x = caseFlip16(_mm_loadu_si128((const __m128i*) (a + i)), 'A');
+            __m128i y = caseFlip16(_mm_loadu_si128((const __m128i*) (b + i)), 'A');
+
+            if ( _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF ) break;
+        }
+
+    #endif
+
+    for ( ; i < len; i++ )
+    {
+        int x = (Uint8) caseFlip(a[i], 'A');
+        int y = (Uint8) caseFlip(b[i], 'A');
+
+        if ( x != y ) return x - y;
+    }
+
+    return 0;
+}
+
+// Finds the first occurrence of pat (n bytes) in s (len bytes) ignoring the
+// case of ASCII letters, or returns 0. Candidates are filtered on the first
+// and last bytes of pat before being compared in full.
+
+const char* caseFind(const char* s, Size len, const char* pat, Size n)
+{
+    Size i = 0;
+    Size last;
+    char f, l;
+
+    if ( n == 0 ) return s;
+    if ( n > len ) return 0;
+
+    last = len - n;
+
+    #if defined CASE_AVX2
+
+        if ( caseAvx2 && caseFind32(s, last, pat, n, i) ) return s + i;
+
+    #endif
+
+    f = caseFlip(pat[0], 'A');
+    l = caseFlip(pat[n - 1], 'A');
+
+    #if defined __SSE2__
+
+        const __m128i vf = _mm_set1_epi8(f);
+        const __m128i vl = _mm_set1_epi8(l);
+
+        for ( ; i + 16 <= last + 1; i += 16 )
+        {
+            __m128i x = caseFlip16(_mm_loadu_si128((const __m128i*) (s + i)), 'A');
+            __m128i y = caseFlip16(_mm_loadu_si128((const __m128i*) (s + i + n - 1)), 'A');
+            Uint32  m = (Uint32) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(x, vf), _mm_cmpeq_epi8(y, vl)));
+
+            while ( m != 0 )
+            {
+                Size c = i + (Size) __builtin_ctz(m);
+
+                if ( caseCmp(s + c, pat, n) == 0 ) return s + c;
+                m &= m - 1;
+            }
+        }
+
+    #endif
+
+    for ( ; i <= last; i++ )
     {
-        s[i] = (char) toupper(s[i]);
+        if ( caseFlip(s[i], 'A') != f || caseFlip(s[i + n - 1], 'A') != l ) continue;
+        if ( caseCmp(s + i, pat, n) == 0 ) return s + i;
     }
+
+    return 0;
 }
 
 const char* findDupChar(const char* s)
@@ -680,7 +1022,7 @@ char* trimWhite(char* s)
 {
     char *e;
 
-    while ( isspace(*s) )
+    while ( isspace((Uint8) *s) )
     {
         s++;
     }
@@ -692,7 +1034,7 @@ char* trimWhite(char* s)
 
     e = s + strlen(s) - 1;
 
-    while ( e > s && isspace(*e) )
+    while ( e > s && isspace((Uint8) *e) )
     {
         e--;
     }
@@ -5,54 +5,144 @@
     #error "do not include str.h separately - use core.h instead!"
 #endif
 
-// optimally pack string in 32 bytes regardless of target
-// this means the internal string buffer size is:
+// A string packs its length, capacity, pointer and an internal buffer for
+// short strings into a given number of bytes regardless of target. A Str is
+// packed in 32 bytes, so its internal buffer size is:
 // 24 bytes (23 chars) in a typical 32-bit target.
 // 20 bytes (19 chars) in a typical 64-bit target.
+// A PathStr is packed in 128 bytes (115 chars on 64-bit), enough to hold
+// most paths without a heap allocation.
 
-const Size STRBUF_SIZE = 32 - 2 * sizeof(Uint16) - sizeof(char*);
+const Size STR_HEAD_SIZE = 2 * sizeof(Uint16) + sizeof(char*);
+const Size STR_SIZE = 32;
+const Size PATHSTR_SIZE = 128;
+const Size STR_LEN_MAX = UINT16_VAL_MAX;
+const Size STR_NONE = SIZE_VAL_MAX;     // not found (see StrView::find())
 
-class Str
+template <Size SIZE> class StrT;
+
+typedef StrT<STR_SIZE> Str;
+typedef StrT<PATHSTR_SIZE> PathStr;
+
+// a view of chars held elsewhere which is not necessarily null terminated
+// and is valid only for as long as they are
+
+class StrView
+{
+public:
+    StrView();
+    StrView(const char* s);
+    StrView(const char* s, Size len);
+    template <Size SIZE> StrView(const StrT<SIZE>& str);
+    Size len() const;
+    bool isEmpty() const;
+    const char* cb() const;
+    const char* ce() const;
+    char operator[](Size i) const;
+    bool operator==(StrView rhs) const;
+    bool operator!=(StrView rhs) const;
+    int cmp(StrView v) const;
+    bool startsWith(StrView v) const;
+    bool endsWith(StrView v) const;
+    Size find(char c, Size from = 0) const;
+    Size find(StrView v, Size from = 0) const;
+    Size findLast(char c) const;
+    StrView sub(Size pos, Size len = STR_NONE) const;
+    bool split(char sep, StrView& head, StrView& tail) const;
+
+private:
+    const char* mP;
+    Size        mLen;
+};
+
+// The size is a template parameter so that strings of a known kind (e.g.
+// paths) can be given a larger internal buffer. Only Str and PathStr are
+// built (see str.cpp) and they convert to each other through StrView.
+
+template <Size SIZE>
+class StrT
 {
 public:
-    Str();
-    ~Str();
-    Str(const Str& str);
-    Str(const char* s);
-    Str(const char c);
-    Str& operator=(const Str& rhs);
-    Str& operator=(const char* rhs);
-    Str& operator=(const char rhs);
-    Str& operator+=(const Str& rhs);
-    Str& operator+=(const char* rhs);
-    Str& operator+=(const char rhs);
-    bool operator==(const Str& rhs) const;
+    StrT();
+    ~StrT();
+    StrT(const StrT& str);
+    StrT(StrT&& str);
+    StrT(const char* s);
+    StrT(const char c);
+    StrT(StrView v);
+    StrT& operator=(const StrT& rhs);
+    StrT& operator=(StrT&& rhs);
+    StrT& operator=(const char* rhs);
+    StrT& operator=(const char rhs);
+    StrT& operator=(StrView rhs);
+    StrT& operator+=(const StrT& rhs);
+    StrT& operator+=(const char* rhs);
+    StrT& operator+=(const char rhs);
+    StrT& operator+=(StrView rhs);
+    bool operator==(const StrT& rhs) const;
     bool operator==(const char* rhs) const;
     bool operator==(const char rhs) const;
+    bool operator==(StrView rhs) const;
     Size len() const;
+    Size cap() const;
+    void reserve(Size len);
     const char* cb() const;
     const char* ce() const;
-    int cmp(const Str& str) const;
+    int cmp(const StrT& str) const;
     int cmp(const char* s) const;
 
-    friend Str operator+(const Str& lhs, const Str& rhs);
-    friend Str operator+(const Str& lhs, const char* rhs);
-    friend Str operator+(const char* lhs, const Str& rhs);
-    friend Str operator+(const Str& lhs, const char rhs);
-    friend Str operator+(const char lhs, const Str& rhs);
-
 private:
-    char    mBuf[STRBUF_SIZE];          // (see STRBUF_SIZE definition!!!)
+    void fit(Size len);
+    void assign(const char* s, Size n);
+    void append(const char* s, Size n);
+
+    char    mBuf[SIZE - STR_HEAD_SIZE]; // (see STR_HEAD_SIZE definition!!!)
     Uint16  mLen;                       // 2 bytes
     Uint16  mCap;                       // 2 bytes
     char*   mC;                         // target dependent
 };
 
-extern Str operator+(const Str& lhs, const Str& rhs);
-extern Str operator+(const Str& lhs, const char* rhs);
-extern Str operator+(const char* lhs, const Str& rhs);
-extern Str operator+(const Str& lhs, const char rhs);
-extern Str operator+(const char lhs, const Str& rhs);
+extern template class StrT<STR_SIZE>;
+extern template class StrT<PATHSTR_SIZE>;
+
+// concatenation is defined for each string type (built in str.cpp)
+
+template <Size SIZE> StrT<SIZE> operator+(const StrT<SIZE>& lhs, const StrT<SIZE>& rhs);
+template <Size SIZE> StrT<SIZE> operator+(const StrT<SIZE>& lhs, const char* rhs);
+template <Size SIZE> StrT<SIZE> operator+(const char* lhs, const StrT<SIZE>& rhs);
+template <Size SIZE> StrT<SIZE> operator+(const StrT<SIZE>& lhs, const char rhs);
+template <Size SIZE> StrT<SIZE> operator+(const char lhs, const StrT<SIZE>& rhs);
+template <Size SIZE> StrT<SIZE> operator+(StrT<SIZE>&& lhs, const StrT<SIZE>& rhs);
+template <Size SIZE> StrT<SIZE> operator+(StrT<SIZE>&& lhs, const char* rhs);
+template <Size SIZE> StrT<SIZE> operator+(StrT<SIZE>&& lhs, const char rhs);
+template <Size SIZE> StrT<SIZE> operator+(StrT<SIZE>&& lhs, StrView rhs);
+
+// the common accessors are inline so a view costs no more than the
+// pointer and length it replaces
+
+inline StrView::StrView() : mP(""), mLen(0) {}
+inline StrView::StrView(const char* s) : mP(s == 0 ? "" : s), mLen(s == 0 ? 0 : strlen(s)) {}
+inline StrView::StrView(const char* s, Size len) : mP(s), mLen(len) {}
+template <Size SIZE>
+inline StrView::StrView(const StrT<SIZE>& str) : mP(str.cb()), mLen(str.len()) {}
+
+inline Size StrView::len() const { return mLen; }
+inline bool StrView::isEmpty() const { return mLen == 0; }
+inline const char* StrView::cb() const { return mP; }
+inline const char* StrView::ce() const { return mP + mLen; }
+inline char StrView::operator[](Size i) const { return mP[i]; }
+
+inline bool StrView::operator==(StrView rhs) const
+{
+    return mLen == rhs.mLen && memcmp(mP, rhs.mP, mLen) == 0;
+}
+
+inline bool StrView::operator!=(StrView rhs) const
+{
+    return !( *this == rhs );
+}
+
+extern int pathJoin(char* buf, Size max, StrView dir, StrView name);
 
 extern bool strlenz(const char* s);
 extern int strleni(const char* s);
@@ -68,6 +158,11 @@ extern void strToUpper(char* s);
 extern void strnToLower(char* s, Size max);
 extern void strnToUpper(char* s, Size max);
 
+extern void caseToLower(char* dst, const char* src, Size len);
+extern void caseToUpper(char* dst, const char* src, Size len);
+extern int caseCmp(const char* a, const char* b, Size len);
+extern const char* caseFind(const char* s, Size len, const char* pat, Size n);
+
 extern const char* findDupChar(const char* s);
 extern const char* findOddChar(const char* s, const char* range);
 
@@ -1,13 +1,65 @@
 // Copyright 2015-2016 RVJ Callanan.
 // Released under the GNU General Public License (Version 3).
 
+#include <new>
 #include <string.h>
 
 #include "core.h"
 
 Value::Value()
 {
-    setNull();
+    mVar = 0;
+}
+
+Value::~Value()
+{
+    hold(0);
+}
+
+Value::Value(const Value& val) : Value()
+{
+    *this = val;
+}
+
+Value::Value(Value&& val) : Value()
+{
+    *this = static_cast<Value&&>(val);
+}
+
+Value& Value::operator=(const Value& val)
+{
+    if ( this == &val ) return *this;
+
+    hold(val.mVar);
+
+    if ( mVar == 0 ) return *this;
+
+    switch (mVar->typnum)
+    {
+        case TYP_FLAG: mFlag = val.mFlag; break;
+        case TYP_TEXT: mText = val.mText; break;
+        case TYP_INUM: mInum = val.mInum; break;
+        case TYP_FNUM: mFnum = val.mFnum; break;
+        case TYP_PICK: mPick = val.mPick; break;
+
+        default: ASSERT(false);
+    }
+
+    return *this;
+}
+
+// text is moved, leaving the other value holding an empty string
+
+Value& Value::operator=(Value&& val)
+{
+    if ( this == &val ) return *this;
+
+    if ( val.mVar == 0 || val.mVar->typnum != TYP_TEXT ) return *this = val;
+
+    hold(val.mVar);
+    mText = static_cast<Text&&>(val.mText);
+
+    return *this;
 }
 
 bool Value::isNull() const
@@ -59,50 +111,52 @@ const Pick& Value::pick() const
 
 void Value::setNull()
 {
-    mVar = 0;
+    hold(0);
 }
 
 void Value::setFlag(const Flag& flag, const Var* var)
 {
     ASSERT(var->typnum == TYP_FLAG);
+    hold(var);
     mFlag = flag;
-    mVar = var;
 }
 
 void Value::setText(const Text& text, const Var* var)
 {
     ASSERT(var->typnum == TYP_TEXT);
+    hold(var);
     mText = text;
-    mVar = var;
 }
 
 void Value::setInum(const Inum& inum, const Var* var)
 {
     ASSERT(var->typnum == TYP_INUM);
+    hold(var);
     mInum = inum;
-    mVar = var;
 }
 
 void Value::setFnum(const Fnum& fnum, const Var* var)
 {
     ASSERT(var->typnum == TYP_FNUM);
+    hold(var);
     mFnum = fnum;
-    mVar = var;
 }
 
 void Value::setPick(const Pick& pick, const Var* var)
 {
     ASSERT(var->typnum == TYP_PICK);
+    hold(var);
     mPick = pick;
-    mVar = var;
 }
 
+// the value is only kept if it parses
+
 void Value::parse(const char* s, const Var* var)
 {
     ASSERT(s != 0);
 
     perClear();
-    setNull();
+    hold(var);
 
     switch (var->typnum)
     {
@@ -115,7 +169,7 @@ void Value::parse(const char* s, const Var* var)
         default: ASSERT(false);
     }
 
-    if ( pen == PE_OK ) mVar = var;
+    if ( pen != PE_OK ) setNull();
 }
 
 int Value::format(char* s, Size max, FmtSpec spec) const
@@ -141,4 +195,31 @@ int Value::format(char* s, Size max, FmtSpec spec) const
     return -1;
 }
 
+// Makes the value one of the type of var: the member in use (if any) is
+// destroyed and a cleared one of the new type constructed in its place,
+// unless the type is the same, when it is kept as it is.
+
+void Value::hold(const Var* var)
+{
+    TypNum from = mVar == 0 ? TYP_NONE : mVar->typnum;
+    TypNum to = var == 0 ? TYP_NONE : var->typnum;
+
+    mVar = var;
+
+    if ( to == from ) return;
+
+    if ( from == TYP_TEXT ) mText.~Text();
+
+    switch (to)
+    {
+        case TYP_FLAG: new (&mFlag) Flag(false); break;
+        case TYP_TEXT: new (&mText) Text(); break;
+        case TYP_INUM: new (&mInum) Inum(0); break;
+        case TYP_FNUM: new (&mFnum) Fnum(0.0); break;
+        case TYP_PICK: new (&mPick) Pick(); break;
+
+        default: break;
+    }
+}
+
 // EOF
\ No newline at end of file
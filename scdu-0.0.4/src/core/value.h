@@ -5,10 +5,19 @@
 #error "do not include value.h separately - use core.h instead!"
 #endif
 
+// The value is held in a union tagged by its Var: the member of the Var's
+// type is in use (none when null) and is constructed and destroyed in place
+// as the type changes, so a value is no bigger than a Text and a pointer.
+
 class Value
 {
 public:
     Value();
+    ~Value();
+    Value(const Value& val);
+    Value(Value&& val);
+    Value& operator=(const Value& val);
+    Value& operator=(Value&& val);
     bool isNull() const;
     TypNum typNum() const;
     QtyNum qtyNum() const;
@@ -27,15 +36,18 @@ public:
     int format(char* s, Size max, FmtSpec spec) const;
 
 private:
-    const Var*  mVar;
+    void hold(const Var* var);
 
-    // note: cannot use union due to non-trivial types
+    const Var*  mVar;                   // type of member in use (0 = none)
 
-    Flag        mFlag;
-    Text        mText;
-    Inum        mInum;
-    Fnum        mFnum;
-    Pick        mPick;
+    union
+    {
+        Flag    mFlag;
+        Text    mText;
+        Inum    mInum;
+        Fnum    mFnum;
+        Pick    mPick;
+    };
 };
 
 // EOF
\ No newline at end of file
@@ -0,0 +1,346 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "../core/core.h"
+
+#include "cache.h"
+
+// A cache file is a fixed header followed by records sorted on (dev, ino).
+// Integers are stored in native byte order; the version field doubles as a
+// byte order check since a foreign file will not match.
+//
+// Each save is a session, numbered in the header, and each record notes the
+// session it was last put in. A record which has not been put for
+// CACHE_AGE_MAX sessions is dropped on save, which purges deleted files and
+// trees no longer scanned. Older files have zeros in both places, which
+// reads as session 0.
+
+const char   CACHE_MAGIC[8] = { 'S', 'C', 'D', 'U', 'S', 'C', 'A', 'N' };
+const Uint32 CACHE_VERSION = 1;
+const Uint32 CACHE_AGE_MAX = 32;        // sessions a record outlives unseen
+
+struct CacheHead
+{
+    char    magic[8];
+    Uint32  version;
+    Uint32  recSize;
+    Uint64  count;
+    Uint64  session;                    // number of the last save
+    Uint64  spare[4];
+};
+
+static_assert(sizeof(CacheHead) == 64, "cache header must be 64 bytes");
+static_assert(sizeof(CacheRec) == 64, "cache record must be 64 bytes");
+
+static int compareRec(const void* a, const void* b);
+static bool isSameStamp(const CacheRec& a, const CacheRec& b);
+static bool isStale(const CacheRec& r, Uint32 session);
+static void absorb(CacheRec& to, const CacheRec& from);
+
+ScanCache::ScanCache()
+{
+    mPath = "";
+    mMap = 0;
+    mMapSize = 0;
+    mRecs = 0;
+    mCount = 0;
+    mNew = 0;
+    mNewCount = 0;
+    mNewCap = 0;
+    mSession = 1;
+}
+
+ScanCache::~ScanCache()
+{
+    close();
+}
+
+bool ScanCache::isOpen() const
+{
+    return (mPath.len() != 0);
+}
+
+bool ScanCache::open(const char* path)
+{
+    const CacheHead* h;
+
+    ASSERT(!isOpen());
+
+    mPath = path;
+
+    // a missing cache is simply empty
+
+    mMap = fileMap(path, mMapSize);
+    if ( mMap == 0 ) return true;
+
+    h = (const CacheHead*) mMap;
+
+    if (    mMapSize < sizeof(CacheHead) ||
+            memcmp(h->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+            h->version != CACHE_VERSION ||
+            h->recSize != sizeof(CacheRec) ||
+            h->count != (mMapSize - sizeof(CacheHead)) / sizeof(CacheRec) ||
+            (mMapSize - sizeof(CacheHead)) % sizeof(CacheRec) != 0 )
+    {
+        // unusable contents will be replaced on save
+
+        fileUnmap(mMap, mMapSize);
+        mMap = 0;
+        mMapSize = 0;
+        return false;
+    }
+
+    mRecs = (const CacheRec*) ((const Uint8*) mMap + sizeof(CacheHead));
+    mCount = (Size) h->count;
+    mSession = (Uint32) h->session + 1;
+
+    return true;
+}
+
+bool ScanCache::save()
+{
+    File*       f;
+    CacheHead   h;
+    CacheRec    r;
+    Str         tmp;
+    Size        i, j, n;
+    bool        ok;
+
+    ASSERT(isOpen());
+
+    // coalesce session records for the same file
+
+    if ( mNewCount > 1 ) qsort(mNew, mNewCount, sizeof(CacheRec), compareRec);
+
+    n = 0;
+
+    for ( i = 0; i < mNewCount; i++ )
+    {
+        if ( n > 0 && mNew[n-1].dev == mNew[i].dev && mNew[n-1].ino == mNew[i].ino )
+        {
+            if ( isSameStamp(mNew[n-1], mNew[i]) ) absorb(mNew[n-1], mNew[i]);
+            else mNew[n-1] = mNew[i];
+        }
+        else
+        {
+            mNew[n++] = mNew[i];
+        }
+    }
+
+    mNewCount = n;
+
+    // count merged records so the header can be written first
+    // (old records which are stale and not replaced are dropped)
+
+    n = 0;
+    i = 0;
+    j = 0;
+
+    while ( i < mCount || j < mNewCount )
+    {
+        int c = i == mCount ? 1 : j == mNewCount ? -1 : compareRec(mRecs + i, mNew + j);
+
+        if ( c < 0 && isStale(mRecs[i], mSession) )
+        {
+            i++;
+            continue;
+        }
+
+        if ( c <= 0 ) i++;
+        if ( c >= 0 ) j++;
+        n++;
+    }
+
+    memcpy(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    h.version = CACHE_VERSION;
+    h.recSize = sizeof(CacheRec);
+    h.count = n;
+    h.session = mSession;
+    memset(h.spare, 0, sizeof(h.spare));
+
+    // write alongside and replace so an interrupted save loses nothing
+
+    tmp = mPath;
+    tmp += ".tmp";
+
+    f = fileOpen(tmp.cb(), "wb");
+    ok = f != 0;
+
+    if ( ok ) ok = fileWrite(&h, sizeof(CacheHead), 1, f) == 1;
+
+    i = 0;
+    j = 0;
+
+    while ( ok && ( i < mCount || j < mNewCount ) )
+    {
+        int c = i == mCount ? 1 : j == mNewCount ? -1 : compareRec(mRecs + i, mNew + j);
+
+        if ( c < 0 )
+        {
+            r = mRecs[i++];
+            if ( isStale(r, mSession) ) continue;
+        }
+        else if ( c > 0 )
+        {
+            r = mNew[j++];
+        }
+        else
+        {
+            r = mNew[j++];
+            if ( isSameStamp(r, mRecs[i]) ) absorb(r, mRecs[i]);
+            i++;
+        }
+
+        ok = fileWrite(&r, sizeof(CacheRec), 1, f) == 1;
+    }
+
+    if ( f != 0 && fileClose(f) != 0 ) ok = false;
+
+    // Windows will not replace a file which is still mapped
+
+    if ( mMap != 0 )
+    {
+        fileUnmap(mMap, mMapSize);
+        mMap = 0;
+        mMapSize = 0;
+        mRecs = 0;
+        mCount = 0;
+    }
+
+    if ( ok ) ok = fileReplace(tmp.cb(), mPath.cb()) == 0;
+
+    close();
+
+    return ok;
+}
+
+void ScanCache::close()
+{
+    if ( mMap != 0 ) fileUnmap(mMap, mMapSize);
+    if ( mNew != 0 ) memFree(&mNew, mNewCap * sizeof(CacheRec));
+
+    mPath = "";
+    mMap = 0;
+    mMapSize = 0;
+    mRecs = 0;
+    mCount = 0;
+    mNew = 0;
+    mNewCount = 0;
+    mNewCap = 0;
+    mSession = 1;
+}
+
+bool ScanCache::find(const FileInfo& info, CacheRec& rec) const
+{
+    const CacheRec* r;
+
+    // only records from previous sessions are searched,
+    // which makes concurrent lookups safe
+
+    r = search(info.dev, info.ino);
+
+    if ( r == 0 ) return false;
+
+    if ( r->size != info.size || r->mtime != info.mtime || r->ctime != info.ctime )
+    {
+        return false;
+    }
+
+    rec = *r;
+    return true;
+}
+
+void ScanCache::put(const FileInfo& info, Uint32 flags, Uint64 prefix, Uint64 digest)
+{
+    Size cap;
+
+    ASSERT(isOpen());
+
+    if ( info.dev == 0 && info.ino == 0 ) return;   // identity unknown
+
+    if ( mNewCount == mNewCap )
+    {
+        cap = mNewCap == 0 ? 1024 : mNewCap * 2;
+
+        if ( mNew == 0 ) memAlloc(&mNew, cap * sizeof(CacheRec));
+        else memRealloc(&mNew, cap * sizeof(CacheRec), mNewCap * sizeof(CacheRec));
+
+        mNewCap = cap;
+    }
+
+    CacheRec& r = mNew[mNewCount++];
+
+    r.dev = info.dev;
+    r.ino = info.ino;
+    r.size = info.size;
+    r.mtime = info.mtime;
+    r.ctime = info.ctime;
+    r.prefix = prefix;
+    r.digest = digest;
+    r.flags = flags;
+    r.seen = mSession;
+}
+
+Size ScanCache::count() const
+{
+    return mCount;
+}
+
+const CacheRec* ScanCache::search(Uint64 dev, Uint64 ino) const
+{
+    Size lo, hi, mid;
+
+    lo = 0;
+    hi = mCount;
+
+    while ( lo < hi )
+    {
+        mid = lo + (hi - lo) / 2;
+
+        const CacheRec& r = mRecs[mid];
+
+        if ( r.dev < dev || ( r.dev == dev && r.ino < ino ) ) lo = mid + 1;
+        else if ( r.dev == dev && r.ino == ino ) return &r;
+        else hi = mid;
+    }
+
+    return 0;
+}
+
+static int compareRec(const void* a, const void* b)
+{
+    const CacheRec* x = (const CacheRec*) a;
+    const CacheRec* y = (const CacheRec*) b;
+
+    if ( x->dev != y->dev ) return x->dev < y->dev ? -1 : 1;
+    if ( x->ino != y->ino ) return x->ino < y->ino ? -1 : 1;
+
+    return 0;
+}
+
+static bool isSameStamp(const CacheRec& a, const CacheRec& b)
+{
+    return a.size == b.size && a.mtime == b.mtime && a.ctime == b.ctime;
+}
+
+// sessions are compared modulo 2^32 so the count may wrap
+
+static bool isStale(const CacheRec& r, Uint32 session)
+{
+    return (Uint32) (session - r.seen) >= CACHE_AGE_MAX;
+}
+
+static void absorb(CacheRec& to, const CacheRec& from)
+{
+    // keep digests the newer record lacks
+
+    if ( !(to.flags & CF_PREFIX) && (from.flags & CF_PREFIX) ) to.prefix = from.prefix;
+    if ( !(to.flags & CF_DIGEST) && (from.flags & CF_DIGEST) ) to.digest = from.digest;
+
+    to.flags |= from.flags;
+}
+
+// EOF
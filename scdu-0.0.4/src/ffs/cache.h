@@ -0,0 +1,58 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined CACHE_H
+
+    #define CACHE_H
+
+    const Uint32 CF_PREFIX  = 0x01;     // prefix digest is valid
+    const Uint32 CF_DIGEST  = 0x02;     // full content digest is valid
+
+    // records are fixed-size and naturally aligned so that a cache file
+    // can be used directly from a read-only memory mapping
+
+    struct CacheRec
+    {
+        Uint64  dev;                    // key: identity of file
+        Uint64  ino;
+        Int64   size;                   // stamp: any change invalidates
+        Int64   mtime;
+        Int64   ctime;
+        Uint64  prefix;                 // digest of first and last blocks
+        Uint64  digest;                 // digest of entire content
+        Uint32  flags;                  // CF_* validity flags
+        Uint32  seen;                   // session last put in
+    };
+
+    class ScanCache
+    {
+    public:
+        ScanCache();
+        ~ScanCache();
+        ScanCache(const ScanCache&) = delete;
+        ScanCache& operator=(const ScanCache&) = delete;
+        bool isOpen() const;
+        bool open(const char* path);
+        bool save();
+        void close();
+        bool find(const FileInfo& info, CacheRec& rec) const;
+        void put(const FileInfo& info, Uint32 flags, Uint64 prefix, Uint64 digest);
+        Size count() const;
+
+    private:
+        const CacheRec* search(Uint64 dev, Uint64 ino) const;
+
+        Str             mPath;
+        const void*     mMap;           // mapped cache file (read-only)
+        Size            mMapSize;
+        const CacheRec* mRecs;          // records within mapping (sorted)
+        Size            mCount;
+        CacheRec*       mNew;           // records added this session
+        Size            mNewCount;
+        Size            mNewCap;
+        Uint32          mSession;       // number of this session
+    };
+
+#endif // CACHE_H
+
+// EOF
@@ -62,7 +62,12 @@ Int64 FileBuffer::lastCount() const
     return mLastCount;
 }
 
-const Str& FileBuffer::path() const
+const Uint8* FileBuffer::data() const
+{
+    return mStart;
+}
+
+const PathStr& FileBuffer::path() const
 {
     return mPath;
 }
@@ -90,7 +95,7 @@ void FileBuffer::reserve(Size chunks)
     ASSERT(mPath.len() == 0);
 
     n = chunks*cmd.env.chunkSize;
-    memAlloc(&mBase, n);
+    bufAlloc(&mBase, n);
     mTop = mBase + n;
 }
 
@@ -104,7 +109,7 @@ void FileBuffer::release()
     ASSERT(mFile == 0);
     ASSERT(mPath.len() == 0);
 
-    memFree(&mBase, mTop - mBase);
+    bufFree(&mBase, mTop - mBase);
     mTop = 0;
 }
 
@@ -193,6 +198,28 @@ Int64 FileReader::pos() const
     return mLastCount + mStart - mEnd;
 }
 
+void FileReader::seek(Int64 pos)
+{
+    ferClear();
+
+    ASSERT(isOpen());
+    ASSERT(pos >= 0 && pos <= mSize);
+
+    // buffered data is discarded so the next fill starts at pos
+
+    if ( fileSeek(mFile, pos, SEEK_SET) < 0 )
+    {
+        fer(FE_SEEK, mPath.cb());
+        return;
+    }
+
+    mStart = mTop;
+    mEnd = mTop;
+    mLastCount = pos;
+
+    ASSERT(!fen);
+}
+
 void FileReader::fill()
 {
     Size rcount, rcap;
@@ -209,7 +236,7 @@ void FileReader::fill()
     {
         if ( rcount == 0 || (rcount > 0 && !feof(mFile)) )
         {
-            fer(FE_READ, mPath);
+            fer(FE_READ, mPath.cb());
             return;
         }
     }
@@ -221,6 +248,13 @@ void FileReader::fill()
     ASSERT(!fen);
 }
 
+void FileReader::drop(Size n)
+{
+    ASSERT(n <= len());
+
+    mStart += n;
+}
+
 Uint8 FileReader::get()
 {
     if (mStart == mEnd)
@@ -315,7 +349,7 @@ void FileWriter::flush()
     wcount = fileWrite(mStart, 1, len(), mFile);
     if ( wcount < len() )
     {
-        fer(FE_WRITE, mPath);
+        fer(FE_WRITE, mPath.cb());
         return;
     }
 
@@ -332,7 +366,7 @@ void FileWriter::flushToDisk()
 
     if ( fileFlush(mFile) < 0 )
     {
-        fer(FE_WRITE, mPath);
+        fer(FE_WRITE, mPath.cb());
         return;
     }
 
@@ -34,7 +34,8 @@
         Size cap() const;
         Size len() const;
         Int64 lastCount() const;
-        const Str& path() const;
+        const Uint8* data() const;
+        const PathStr& path() const;
         bool isReserved() const;
         bool isOpen() const;
         void reserve(Size chunks);
@@ -51,7 +52,7 @@
         Uint8*  mEnd;                   // enqueued data end address
         Int64   mLastCount;             // last fill/flush count for current file
         File*   mFile;                  // stream associated with current file
-        Str     mPath;                  // path of current file
+        PathStr mPath;                  // path of current file
     };
 
     class FileReader : public FileBuffer
@@ -67,7 +68,9 @@
         void close();
         Int64 size() const;
         Int64 pos() const;
+        void seek(Int64 pos);
         void fill();
+        void drop(Size n);
         Uint8 get();
 
     private:
@@ -0,0 +1,209 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+
+#include "../core/core.h"
+
+#include "lines.h"
+
+// An index file is a fixed header followed by the byte offset of every
+// LINE_STRIDE-th line, in native byte order. Entries are only ever appended
+// as far as a file has been read, so an index may cover just the start of a
+// file and is extended by later views which go further.
+
+const char   LINES_MAGIC[8] = { 'S', 'C', 'D', 'U', 'L', 'I', 'D', 'X' };
+const Uint32 LINES_VERSION = 1;
+
+struct LinesHead
+{
+    char    magic[8];
+    Uint32  version;
+    Uint32  stride;
+    Int64   size;                       // stamp of indexed file
+    Int64   mtime;
+    Uint64  count;                      // entries following header
+    Uint64  spare[3];
+};
+
+static_assert(sizeof(LinesHead) == 64, "line index header must be 64 bytes");
+
+LineIndex::LineIndex()
+{
+    mPath = "";
+    mSize = 0;
+    mMtime = 0;
+    mEntries = 0;
+    mCount = 0;
+    mCap = 0;
+    mNext = 0;
+    mDirty = false;
+}
+
+LineIndex::~LineIndex()
+{
+    close();
+}
+
+bool LineIndex::isOpen() const
+{
+    return (mPath.len() != 0);
+}
+
+// Loads the index at path if it was built for the file described by info.
+// Otherwise (or if there is no usable index) the index starts out empty and
+// false is returned; either way, entries may then be found and added.
+
+bool LineIndex::open(const char* path, const FileInfo& info)
+{
+    File*       f;
+    LinesHead   h;
+    Size        cap;
+    bool        ok;
+
+    ASSERT(!isOpen());
+
+    mPath = path;
+    mSize = info.size;
+    mMtime = info.mtime;
+
+    // line 1 always starts at offset 0
+
+    mCap = 1024;
+    memAlloc(&mEntries, mCap * sizeof(Int64));
+    mEntries[0] = 0;
+    mCount = 1;
+    mNext = (Int64) LINE_STRIDE + 1;
+    mDirty = false;
+
+    f = fileOpen(path, "rb");
+    if ( f == 0 ) return false;
+
+    ok =    fileRead(&h, sizeof(LinesHead), 1, f) == 1 &&
+            memcmp(h.magic, LINES_MAGIC, sizeof(LINES_MAGIC)) == 0 &&
+            h.version == LINES_VERSION &&
+            h.stride == LINE_STRIDE &&
+            h.size == info.size &&
+            h.mtime == info.mtime &&
+            h.count >= 1;
+
+    if ( ok )
+    {
+        cap = mCap;
+        while ( cap < h.count ) cap *= 2;
+
+        if ( cap != mCap )
+        {
+            memRealloc(&mEntries, cap * sizeof(Int64), mCap * sizeof(Int64));
+            mCap = cap;
+        }
+
+        ok =    fileRead(mEntries, sizeof(Int64), (Size) h.count, f) == h.count &&
+                mEntries[0] == 0;
+    }
+
+    fileClose(f);
+
+    if ( !ok )
+    {
+        // stale or unusable: start again (it is replaced on save)
+
+        mEntries[0] = 0;
+        return false;
+    }
+
+    mCount = (Size) h.count;
+    mNext = (Int64) (mCount * LINE_STRIDE) + 1;
+
+    return true;
+}
+
+bool LineIndex::save()
+{
+    File*       f;
+    LinesHead   h;
+    Str         tmp;
+    bool        ok;
+
+    ASSERT(isOpen());
+
+    if ( !mDirty ) return true;
+
+    memcpy(h.magic, LINES_MAGIC, sizeof(LINES_MAGIC));
+    h.version = LINES_VERSION;
+    h.stride = LINE_STRIDE;
+    h.size = mSize;
+    h.mtime = mMtime;
+    h.count = mCount;
+    memset(h.spare, 0, sizeof(h.spare));
+
+    // write alongside and replace so an interrupted save loses nothing
+
+    tmp = mPath;
+    tmp += ".tmp";
+
+    f = fileOpen(tmp.cb(), "wb");
+    ok = f != 0;
+
+    if ( ok ) ok = fileWrite(&h, sizeof(LinesHead), 1, f) == 1;
+    if ( ok ) ok = fileWrite(mEntries, sizeof(Int64), mCount, f) == mCount;
+
+    if ( f != 0 && fileClose(f) != 0 ) ok = false;
+    if ( ok ) ok = fileReplace(tmp.cb(), mPath.cb()) == 0;
+
+    if ( ok ) mDirty = false;
+
+    return ok;
+}
+
+void LineIndex::close()
+{
+    if ( mEntries != 0 ) memFree(&mEntries, mCap * sizeof(Int64));
+
+    mPath = "";
+    mSize = 0;
+    mMtime = 0;
+    mCount = 0;
+    mCap = 0;
+    mNext = 0;
+    mDirty = false;
+}
+
+// Finds the nearest indexed line at or before line (1-based).
+
+void LineIndex::find(Int64 line, Int64& at, Int64& offset) const
+{
+    Size i;
+
+    ASSERT(isOpen());
+    ASSERT(line >= 1);
+
+    i = (Size) ((line - 1) / (Int64) LINE_STRIDE);
+    if ( i >= mCount ) i = mCount - 1;
+
+    at = (Int64) (i * LINE_STRIDE) + 1;
+    offset = mEntries[i];
+}
+
+// Notes where a line starts. Lines may be reported in any quantity but must
+// be contiguous from the last entry; only every stride-th line is kept.
+
+void LineIndex::add(Int64 line, Int64 offset)
+{
+    Size cap;
+
+    if ( line != mNext ) return;
+
+    if ( mCount == mCap )
+    {
+        cap = mCap * 2;
+        memRealloc(&mEntries, cap * sizeof(Int64), mCap * sizeof(Int64));
+        mCap = cap;
+    }
+
+    mEntries[mCount++] = offset;
+    mNext += LINE_STRIDE;
+    mDirty = true;
+}
+
+// EOF
@@ -0,0 +1,37 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined LINES_H
+
+    #define LINES_H
+
+    const Size LINE_STRIDE = 4096;      // lines per index entry
+
+    class LineIndex
+    {
+    public:
+        LineIndex();
+        ~LineIndex();
+        LineIndex(const LineIndex&) = delete;
+        LineIndex& operator=(const LineIndex&) = delete;
+        bool isOpen() const;
+        bool open(const char* path, const FileInfo& info);
+        bool save();
+        void close();
+        void find(Int64 line, Int64& at, Int64& offset) const;
+        void add(Int64 line, Int64 offset);
+
+    private:
+        Str         mPath;
+        Int64       mSize;              // stamp of indexed file
+        Int64       mMtime;
+        Int64*      mEntries;           // offset of line (i * stride + 1)
+        Size        mCount;
+        Size        mCap;
+        Int64       mNext;              // line of next entry to be added
+        bool        mDirty;
+    };
+
+#endif // LINES_H
+
+// EOF
@@ -0,0 +1,419 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+#include <stdio.h>
+
+#include "../core/core.h"
+
+#include "magic.h"
+
+// Signatures are compiled into a trie keyed on their leading bytes (those at
+// offset 0 up to the first masked byte). The root is a dense table indexed by
+// the first byte of the file; deeper levels have few children and are held
+// as sibling lists. Each node lists the signatures whose key ends there, to
+// be confirmed against any remaining parts. Signatures without a usable key
+// (nothing at offset 0) are tried last. Parts which lie beyond the prefix
+// are read on demand, only once a signature is otherwise a candidate.
+
+const Size MAGIC_KEY_MAX = 8;           // deepest level of dispatch trie
+const Size MAGIC_PART_MAX = 16;         // longest byte sequence of a part
+const Size MAGIC_PARTS = 2;             // parts per signature
+
+struct MagicPart
+{
+    Uint32      offset;
+    Uint32      len;                    // 0 = unused part
+    const char* bytes;
+    const char* mask;                   // 0 = all bits significant
+};
+
+struct MagicSig
+{
+    MagicNum    num;
+    MagicPart   parts[MAGIC_PARTS];
+};
+
+struct MagicNode
+{
+    Uint16  first;                      // first child (0 = none)
+    Uint16  next;                       // next sibling (0 = none)
+    Uint16  sigs;                       // first candidate + 1 (0 = none)
+    Uint8   byte;
+    Uint8   depth;
+};
+
+#define MP(o, b)        { o, sizeof(b) - 1, b, 0 }
+#define MPM(o, b, m)    { o, sizeof(b) - 1, b, m }
+#define MP0             { 0, 0, 0, 0 }
+
+const MagicDef magicDefs[] =
+{
+    { MN_UNKNOWN,   "unknown",  "unrecognised content"              },
+    { MN_EMPTY,     "empty",    "no content"                        },
+    { MN_ELF,       "elf",      "ELF executable or object"          },
+    { MN_EXE,       "exe",      "DOS or Windows executable"         },
+    { MN_MACHO,     "macho",    "Mach-O executable or object"       },
+    { MN_CLASS,     "class",    "Java class file"                   },
+    { MN_WASM,      "wasm",     "WebAssembly module"                },
+    { MN_SCRIPT,    "script",   "interpreter script"                },
+    { MN_ZIP,       "zip",      "ZIP archive (incl. office, jar)"   },
+    { MN_GZIP,      "gzip",     "gzip compressed data"              },
+    { MN_BZIP2,     "bzip2",    "bzip2 compressed data"             },
+    { MN_XZ,        "xz",       "xz compressed data"                },
+    { MN_ZSTD,      "zstd",     "Zstandard compressed data"         },
+    { MN_7Z,        "7z",       "7-Zip archive"                     },
+    { MN_RAR,       "rar",      "RAR archive"                       },
+    { MN_TAR,       "tar",      "POSIX tar archive"                 },
+    { MN_CAB,       "cab",      "Microsoft cabinet archive"         },
+    { MN_ISO,       "iso",      "ISO 9660 disk image"               },
+    { MN_PDF,       "pdf",      "PDF document"                      },
+    { MN_PS,        "ps",       "PostScript document"               },
+    { MN_RTF,       "rtf",      "rich text document"                },
+    { MN_OLE,       "ole",      "OLE compound document"             },
+    { MN_XML,       "xml",      "XML document"                      },
+    { MN_HTML,      "html",     "HTML document"                     },
+    { MN_SQLITE,    "sqlite",   "SQLite database"                   },
+    { MN_PNG,       "png",      "PNG image"                         },
+    { MN_JPEG,      "jpeg",     "JPEG image"                        },
+    { MN_GIF,       "gif",      "GIF image"                         },
+    { MN_BMP,       "bmp",      "bitmap image"                      },
+    { MN_TIFF,      "tiff",     "TIFF image"                        },
+    { MN_WEBP,      "webp",     "WebP image"                        },
+    { MN_ICO,       "ico",      "icon image"                        },
+    { MN_PSD,       "psd",      "Photoshop image"                   },
+    { MN_MP3,       "mp3",      "MPEG audio"                        },
+    { MN_FLAC,      "flac",     "FLAC audio"                        },
+    { MN_OGG,       "ogg",      "Ogg media"                         },
+    { MN_WAV,       "wav",      "WAVE audio"                        },
+    { MN_MIDI,      "midi",     "MIDI sequence"                     },
+    { MN_AVI,       "avi",      "AVI video"                         },
+    { MN_MP4,       "mp4",      "ISO media (mp4, mov, heic)"        },
+    { MN_MKV,       "mkv",      "Matroska or WebM media"            }
+};
+
+// Where signatures share a key, the first listed is tried first.
+
+const MagicSig magicSigs[] =
+{
+    { MN_ELF,       { MP(0, "\x7F" "ELF"),                  MP0                     } },
+    { MN_EXE,       { MP(0, "MZ"),                          MP0                     } },
+    { MN_MACHO,     { MP(0, "\xFE\xED\xFA\xCE"),            MP0                     } },
+    { MN_MACHO,     { MP(0, "\xFE\xED\xFA\xCF"),            MP0                     } },
+    { MN_MACHO,     { MP(0, "\xCE\xFA\xED\xFE"),            MP0                     } },
+    { MN_MACHO,     { MP(0, "\xCF\xFA\xED\xFE"),            MP0                     } },
+    { MN_CLASS,     { MP(0, "\xCA\xFE\xBA\xBE"),            MP0                     } },
+    { MN_WASM,      { MP(0, "\0asm"),                       MP0                     } },
+    { MN_SCRIPT,    { MP(0, "#!"),                          MP0                     } },
+    { MN_ZIP,       { MP(0, "PK\x03\x04"),                  MP0                     } },
+    { MN_ZIP,       { MP(0, "PK\x05\x06"),                  MP0                     } },
+    { MN_GZIP,      { MP(0, "\x1F\x8B"),                    MP0                     } },
+    { MN_BZIP2,     { MP(0, "BZh"),                         MP0                     } },
+    { MN_XZ,        { MP(0, "\xFD" "7zXZ\0"),               MP0                     } },
+    { MN_ZSTD,      { MP(0, "\x28\xB5\x2F\xFD"),            MP0                     } },
+    { MN_7Z,        { MP(0, "7z\xBC\xAF\x27\x1C"),          MP0                     } },
+    { MN_RAR,       { MP(0, "Rar!\x1A\x07"),                MP0                     } },
+    { MN_TAR,       { MP(257, "ustar"),                     MP0                     } },
+    { MN_CAB,       { MP(0, "MSCF\0\0\0\0"),                MP0                     } },
+    { MN_ISO,       { MP(32769, "CD001"),                   MP0                     } },
+    { MN_PDF,       { MP(0, "%PDF-"),                       MP0                     } },
+    { MN_PS,        { MP(0, "%!PS"),                        MP0                     } },
+    { MN_RTF,       { MP(0, "{\\rtf"),                      MP0                     } },
+    { MN_OLE,       { MP(0, "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1"), MP0                } },
+    { MN_XML,       { MP(0, "<?xml"),                       MP0                     } },
+    { MN_XML,       { MP(0, "\xEF\xBB\xBF<?xml"),           MP0                     } },
+    { MN_HTML,      { MPM(0, "<!DOCTYPE HTML", "\xFF\xFF\xDF\xDF\xDF\xDF\xDF\xDF\xDF\xFF\xDF\xDF\xDF\xDF"), MP0 } },
+    { MN_HTML,      { MPM(0, "<HTML", "\xFF\xDF\xDF\xDF\xDF"), MP0                  } },
+    { MN_SQLITE,    { MP(0, "SQLite format 3\0"),           MP0                     } },
+    { MN_PNG,       { MP(0, "\x89PNG\r\n\x1A\n"),           MP0                     } },
+    { MN_JPEG,      { MP(0, "\xFF\xD8\xFF"),                MP0                     } },
+    { MN_GIF,       { MP(0, "GIF87a"),                      MP0                     } },
+    { MN_GIF,       { MP(0, "GIF89a"),                      MP0                     } },
+    { MN_BMP,       { MP(0, "BM"),                          MP(6, "\0\0\0\0")       } },
+    { MN_TIFF,      { MP(0, "II*\0"),                       MP0                     } },
+    { MN_TIFF,      { MP(0, "MM\0*"),                       MP0                     } },
+    { MN_WEBP,      { MP(0, "RIFF"),                        MP(8, "WEBP")           } },
+    { MN_WAV,       { MP(0, "RIFF"),                        MP(8, "WAVE")           } },
+    { MN_AVI,       { MP(0, "RIFF"),                        MP(8, "AVI ")           } },
+    { MN_ICO,       { MP(0, "\0\0\1\0"),                    MP0                     } },
+    { MN_PSD,       { MP(0, "8BPS"),                        MP0                     } },
+    { MN_MP3,       { MP(0, "ID3"),                         MP0                     } },
+    { MN_MP3,       { MPM(0, "\xFF\xE2", "\xFF\xE6"),       MP0                     } },
+    { MN_FLAC,      { MP(0, "fLaC"),                        MP0                     } },
+    { MN_OGG,       { MP(0, "OggS"),                        MP0                     } },
+    { MN_MIDI,      { MP(0, "MThd"),                        MP0                     } },
+    { MN_MP4,       { MP(4, "ftyp"),                        MP0                     } },
+    { MN_MKV,       { MP(0, "\x1A\x45\xDF\xA3"),            MP0                     } }
+};
+
+const Size MAGIC_SIG_COUNT = sizeof(magicSigs) / sizeof(MagicSig);
+
+static_assert(sizeof(magicDefs) / sizeof(MagicDef) == MN_COUNT, "magicDefs out of step with MagicNum");
+
+static Size keyLen(const MagicSig& sig);
+
+Magic::Magic()
+{
+    memset(mRoot, 0, sizeof(mRoot));
+    mNodes = 0;
+    mNodeCount = 0;
+    mNodeCap = 0;
+    mChain = 0;
+    mLoose = 0;
+    mHead = 0;
+}
+
+Magic::~Magic()
+{
+    release();
+}
+
+void Magic::compile()
+{
+    Size    cap, k, n, end;
+    Uint16  node, c;
+    Uint16* tail;
+
+    if ( mNodes != 0 ) return;  // already compiled
+
+    // worst case is one node per key byte (plus unused node 0)
+
+    cap = 1;
+
+    for ( Size i = 0; i < MAGIC_SIG_COUNT; i++ ) cap += keyLen(magicSigs[i]);
+
+    memAlloc(&mNodes, cap * sizeof(MagicNode));
+    memAlloc(&mChain, MAGIC_SIG_COUNT * sizeof(Uint16));
+    memset(mNodes, 0, cap * sizeof(MagicNode));
+    memset(mChain, 0, MAGIC_SIG_COUNT * sizeof(Uint16));
+
+    mNodeCap = cap;
+    mNodeCount = 1;
+    mHead = 0;
+
+    for ( Size i = 0; i < MAGIC_SIG_COUNT; i++ )
+    {
+        const MagicSig& sig = magicSigs[i];
+
+        for ( Size p = 0; p < MAGIC_PARTS && sig.parts[p].len != 0; p++ )
+        {
+            ASSERT(sig.parts[p].len <= MAGIC_PART_MAX);
+
+            end = sig.parts[p].offset + sig.parts[p].len;
+            if ( end <= MAGIC_HEAD_MAX && end > mHead ) mHead = end;
+        }
+
+        k = keyLen(sig);
+
+        if ( k == 0 )
+        {
+            tail = &mLoose;
+        }
+        else
+        {
+            const Uint8* key = (const Uint8*) sig.parts[0].bytes;
+
+            node = mRoot[key[0]];
+
+            if ( node == 0 )
+            {
+                node = (Uint16) mNodeCount++;
+                mNodes[node].byte = key[0];
+                mNodes[node].depth = 1;
+                mRoot[key[0]] = node;
+            }
+
+            for ( n = 1; n < k; n++ )
+            {
+                c = child(node, key[n]);
+
+                if ( c == 0 )
+                {
+                    c = (Uint16) mNodeCount++;
+                    mNodes[c].byte = key[n];
+                    mNodes[c].depth = (Uint8) (n + 1);
+                    mNodes[c].next = mNodes[node].first;
+                    mNodes[node].first = c;
+                }
+
+                node = c;
+            }
+
+            tail = &mNodes[node].sigs;
+        }
+
+        // append to candidate chain to preserve table order
+
+        while ( *tail != 0 ) tail = &mChain[*tail - 1];
+        *tail = (Uint16) (i + 1);
+    }
+
+    ASSERT(mNodeCount <= mNodeCap);
+}
+
+void Magic::release()
+{
+    if ( mNodes != 0 ) memFree(&mNodes, mNodeCap * sizeof(MagicNode));
+    if ( mChain != 0 ) memFree(&mChain, MAGIC_SIG_COUNT * sizeof(Uint16));
+
+    memset(mRoot, 0, sizeof(mRoot));
+    mNodeCount = 0;
+    mNodeCap = 0;
+    mLoose = 0;
+    mHead = 0;
+}
+
+Size Magic::head() const
+{
+    return mHead;
+}
+
+bool Magic::identify(const char* path, Int64 size, Uint8* buf, MagicNum& num) const
+{
+    File*   f;
+    Size    n;
+
+    ASSERT(mNodes != 0);
+
+    if ( size == 0 )
+    {
+        num = MN_EMPTY;
+        return true;
+    }
+
+    f = fileOpen(path, "rb");
+    if ( f == 0 ) return false;
+
+    // the few bytes needed are read directly rather than a stream buffer full
+
+    fileUnbuffer(f);
+
+    n = size < (Int64) mHead ? (Size) size : mHead;
+
+    if ( fileRead(buf, 1, n, f) != n )
+    {
+        fileClose(f);
+        return false;
+    }
+
+    num = match(buf, n, f, size);
+
+    fileClose(f);
+
+    return true;
+}
+
+MagicNum Magic::match(const Uint8* data, Size len, File* file, Int64 size) const
+{
+    Uint16  path[MAGIC_KEY_MAX];
+    Uint16  node, s;
+    Size    depth;
+
+    depth = 0;
+
+    if ( len != 0 )
+    {
+        node = mRoot[data[0]];
+
+        while ( node != 0 )
+        {
+            path[depth++] = node;
+
+            if ( depth == MAGIC_KEY_MAX || depth == len ) break;
+
+            node = child(node, data[depth]);
+        }
+    }
+
+    // longest keys are the most specific so they are tried first
+
+    while ( depth > 0 )
+    {
+        for ( s = mNodes[path[--depth]].sigs; s != 0; s = mChain[s - 1] )
+        {
+            if ( verify(magicSigs[s - 1], data, len, file, size) ) return magicSigs[s - 1].num;
+        }
+    }
+
+    for ( s = mLoose; s != 0; s = mChain[s - 1] )
+    {
+        if ( verify(magicSigs[s - 1], data, len, file, size) ) return magicSigs[s - 1].num;
+    }
+
+    return MN_UNKNOWN;
+}
+
+bool Magic::verify(const MagicSig& sig, const Uint8* data, Size len, File* file, Int64 size) const
+{
+    Uint8           probe[MAGIC_PART_MAX];
+    const Uint8*    p;
+
+    for ( Size i = 0; i < MAGIC_PARTS && sig.parts[i].len != 0; i++ )
+    {
+        const MagicPart& part = sig.parts[i];
+        const Uint8* b = (const Uint8*) part.bytes;
+        const Uint8* m = (const Uint8*) part.mask;
+
+        if ( (Int64) part.offset + part.len > size ) return false;
+
+        if ( part.offset + part.len <= len )
+        {
+            p = data + part.offset;
+        }
+        else
+        {
+            // beyond the prefix: read just this part
+
+            if ( file == 0 ) return false;
+            if ( fileSeek(file, part.offset, SEEK_SET) != 0 ) return false;
+            if ( fileRead(probe, 1, part.len, file) != part.len ) return false;
+
+            p = probe;
+        }
+
+        if ( m == 0 )
+        {
+            if ( memcmp(p, b, part.len) != 0 ) return false;
+        }
+        else
+        {
+            for ( Size j = 0; j < part.len; j++ )
+            {
+                if ( (p[j] & m[j]) != (b[j] & m[j]) ) return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+Uint16 Magic::child(Uint16 node, Uint8 byte) const
+{
+    Uint16 c;
+
+    for ( c = mNodes[node].first; c != 0; c = mNodes[c].next )
+    {
+        if ( mNodes[c].byte == byte ) return c;
+    }
+
+    return 0;
+}
+
+static Size keyLen(const MagicSig& sig)
+{
+    const MagicPart& part = sig.parts[0];
+    Size n;
+
+    if ( part.len == 0 || part.offset != 0 ) return 0;
+
+    // key stops at the first byte with insignificant bits
+
+    for ( n = 0; n < part.len && n < MAGIC_KEY_MAX; n++ )
+    {
+        if ( part.mask != 0 && (Uint8) part.mask[n] != 0xFF ) break;
+    }
+
+    return n;
+}
+
+// EOF
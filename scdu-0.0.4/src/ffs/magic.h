@@ -0,0 +1,96 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined MAGIC_H
+
+    #define MAGIC_H
+
+    const Size MAGIC_HEAD_MAX = 512;    // largest prefix read in one go
+
+    enum MagicNum
+    {
+        MN_UNKNOWN = 0,
+        MN_EMPTY,
+        MN_ELF,
+        MN_EXE,
+        MN_MACHO,
+        MN_CLASS,
+        MN_WASM,
+        MN_SCRIPT,
+        MN_ZIP,
+        MN_GZIP,
+        MN_BZIP2,
+        MN_XZ,
+        MN_ZSTD,
+        MN_7Z,
+        MN_RAR,
+        MN_TAR,
+        MN_CAB,
+        MN_ISO,
+        MN_PDF,
+        MN_PS,
+        MN_RTF,
+        MN_OLE,
+        MN_XML,
+        MN_HTML,
+        MN_SQLITE,
+        MN_PNG,
+        MN_JPEG,
+        MN_GIF,
+        MN_BMP,
+        MN_TIFF,
+        MN_WEBP,
+        MN_ICO,
+        MN_PSD,
+        MN_MP3,
+        MN_FLAC,
+        MN_OGG,
+        MN_WAV,
+        MN_MIDI,
+        MN_AVI,
+        MN_MP4,
+        MN_MKV,
+        MN_COUNT
+    };
+
+    struct MagicDef
+    {
+        const MagicNum  num;
+        const char*     name;
+        const char*     desc;
+    };
+
+    struct MagicSig;
+    struct MagicNode;
+
+    class Magic
+    {
+    public:
+        Magic();
+        ~Magic();
+        Magic(const Magic&) = delete;
+        Magic& operator=(const Magic&) = delete;
+        void compile();
+        void release();
+        Size head() const;
+        bool identify(const char* path, Int64 size, Uint8* buf, MagicNum& num) const;
+        MagicNum match(const Uint8* data, Size len, File* file, Int64 size) const;
+
+    private:
+        bool verify(const MagicSig& sig, const Uint8* data, Size len, File* file, Int64 size) const;
+        Uint16 child(Uint16 node, Uint8 byte) const;
+
+        Uint16      mRoot[256];         // dispatch on first byte
+        MagicNode*  mNodes;             // node 0 is unused
+        Size        mNodeCount;
+        Size        mNodeCap;
+        Uint16*     mChain;             // next candidate + 1 for each signature
+        Uint16      mLoose;             // first unkeyed signature + 1
+        Size        mHead;              // prefix needed for unprobed parts
+    };
+
+    extern const MagicDef magicDefs[];
+
+#endif // MAGIC_H
+
+// EOF
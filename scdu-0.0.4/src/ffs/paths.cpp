@@ -0,0 +1,372 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+
+#include "../core/core.h"
+#include "../alg/hash.h"
+
+#include "paths.h"
+
+// A path is held as a chain of nodes, one per component, each of which
+// names its parent. Both nodes and names are hash-consed: a (parent, name)
+// pair is stored once however many times it is added, so a subtree is
+// shared by every path within it, and a name is stored once however many
+// directories it appears in (e.g. ".git", "node_modules" or "index.js").
+//
+// Names are packed into one text buffer, each after a 2-byte length, and
+// are known by their offset there. A node is two 32-bit numbers, so a file
+// costs 8 bytes, a hash slot or two and its name (plus 2 bytes) if new.
+
+const Uint32 NODE_TOP = UINT32_VAL_MAX;     // parent of a top node
+const Size   NAME_LEN_MAX = UINT16_VAL_MAX;
+const Size   SLOTS_MIN = 1024;
+
+struct PathNode
+{
+    Uint32  parent;                     // node number or NODE_TOP
+    Uint32  name;                       // offset of name in text
+};
+
+static inline bool isSep(char c);
+static inline Uint32 nodeHash(Uint32 parent, Uint32 name);
+static inline bool isFull(Size count, Size cap);
+
+PathStore::PathStore()
+{
+    mNodes = 0;
+    mNodeCount = 0;
+    mNodeCap = 0;
+    mNodeSlots = 0;
+    mNodeSlotCap = 0;
+    mText = 0;
+    mTextLen = 0;
+    mTextCap = 0;
+    mNameCount = 0;
+    mNameSlots = 0;
+    mNameSlotCap = 0;
+    mDirNode = PATHS_NONE;
+}
+
+PathStore::~PathStore()
+{
+    release();
+}
+
+void PathStore::release()
+{
+    if ( mNodes != 0 ) memFree(&mNodes, mNodeCap * sizeof(PathNode));
+    if ( mNodeSlots != 0 ) memFree(&mNodeSlots, mNodeSlotCap * sizeof(Uint32));
+    if ( mText != 0 ) memFree(&mText, mTextCap);
+    if ( mNameSlots != 0 ) memFree(&mNameSlots, mNameSlotCap * sizeof(Uint32));
+
+    mNodeCount = 0;
+    mNodeCap = 0;
+    mNodeSlotCap = 0;
+    mTextLen = 0;
+    mTextCap = 0;
+    mNameCount = 0;
+    mNameSlotCap = 0;
+    mDirNode = PATHS_NONE;
+}
+
+// Paths are split at either separator. Paths from a walk arrive directory
+// by directory, so the parent of one is nearly always that of the last and
+// the components above it need not be looked up again: it is enough to
+// compare the directory with the names of that node and its ancestors.
+
+Size PathStore::add(StrView path)
+{
+    Size    at, from, node;
+    StrView dir;
+
+    at = path.len();
+    while ( at > 0 && !isSep(path[at - 1]) ) at--;
+
+    if ( at == 0 ) return add(PATHS_NONE, path);
+
+    dir = path.sub(0, at - 1);
+
+    if ( mDirNode == PATHS_NONE || !isPath(mDirNode, dir) )
+    {
+        node = PATHS_NONE;
+        from = 0;
+
+        for ( Size i = 0; i <= dir.len(); i++ )
+        {
+            if ( i == dir.len() || isSep(dir[i]) )
+            {
+                node = add(node, dir.sub(from, i - from));
+                from = i + 1;
+            }
+        }
+
+        mDirNode = node;
+    }
+
+    return add(mDirNode, path.sub(at));
+}
+
+// Returns the node for name within parent (PATHS_NONE for a top node),
+// adding it if new.
+
+Size PathStore::add(Size parent, StrView name)
+{
+    Uint32  p, n, k;
+    Size    i, cap;
+
+    ASSERT(parent == PATHS_NONE || parent < mNodeCount);
+
+    p = parent == PATHS_NONE ? NODE_TOP : (Uint32) parent;
+    n = (Uint32) intern(name);
+
+    if ( isFull(mNodeCount + 1, mNodeSlotCap) ) growNodeSlots();
+
+    for ( i = nodeHash(p, n) & (mNodeSlotCap - 1); (k = mNodeSlots[i]) != 0; i = (i + 1) & (mNodeSlotCap - 1) )
+    {
+        const PathNode& node = mNodes[k - 1];
+
+        if ( node.parent == p && node.name == n ) return k - 1;
+    }
+
+    if ( mNodeCount == PATHS_MAX ) xer(XE_MEMOUT);
+
+    if ( mNodeCount == mNodeCap )
+    {
+        cap = mNodeCap == 0 ? 1024 : mNodeCap * 2;
+
+        if ( mNodes == 0 ) memAlloc(&mNodes, cap * sizeof(PathNode));
+        else memRealloc(&mNodes, cap * sizeof(PathNode), mNodeCap * sizeof(PathNode));
+
+        mNodeCap = cap;
+    }
+
+    PathNode& node = mNodes[mNodeCount++];
+
+    node.parent = p;
+    node.name = n;
+    mNodeSlots[i] = (Uint32) mNodeCount;
+
+    return mNodeCount - 1;
+}
+
+// Rebuilds the path of a node into buf (with PATH_SEP between components)
+// working back from the end, so no stack of components is needed. Returns
+// its length or -1 if it is longer than max.
+
+int PathStore::path(Size node, char* buf, Size max) const
+{
+    Size    len, at;
+    Uint32  k;
+
+    ASSERT(node < mNodeCount);
+
+    len = 0;
+
+    for ( k = (Uint32) node; k != NODE_TOP; k = mNodes[k].parent )
+    {
+        len += text(mNodes[k].name).len();
+        if ( mNodes[k].parent != NODE_TOP ) len++;
+    }
+
+    if ( len > max ) return -1;
+
+    at = len;
+    buf[at] = 0;
+
+    for ( k = (Uint32) node; k != NODE_TOP; k = mNodes[k].parent )
+    {
+        StrView name = text(mNodes[k].name);
+
+        at -= name.len();
+        memcpy(buf + at, name.cb(), name.len());
+
+        if ( mNodes[k].parent != NODE_TOP ) buf[--at] = PATH_SEP;
+    }
+
+    return (int) len;
+}
+
+StrView PathStore::name(Size node) const
+{
+    ASSERT(node < mNodeCount);
+
+    return text(mNodes[node].name);
+}
+
+Size PathStore::parent(Size node) const
+{
+    ASSERT(node < mNodeCount);
+
+    return mNodes[node].parent == NODE_TOP ? PATHS_NONE : mNodes[node].parent;
+}
+
+Size PathStore::count() const
+{
+    return mNodeCount;
+}
+
+Size PathStore::names() const
+{
+    return mNameCount;
+}
+
+// all memory held, including spare capacity
+
+Size PathStore::bytes() const
+{
+    return  mNodeCap * sizeof(PathNode) +
+            ( mNodeSlotCap + mNameSlotCap ) * sizeof(Uint32) +
+            mTextCap;
+}
+
+// the length is stored low byte first as names are not aligned
+
+StrView PathStore::text(Size at) const
+{
+    const Uint8* t = mText + at;
+
+    return StrView((const char*) t + 2, (Size) t[0] | (Size) t[1] << 8);
+}
+
+// true if path (split at either separator) leads to node
+
+bool PathStore::isPath(Size node, StrView path) const
+{
+    Size    at = path.len();
+    Uint32  k = (Uint32) node;
+
+    while ( true )
+    {
+        StrView name = text(mNodes[k].name);
+
+        if ( name.len() > at ) return false;
+
+        at -= name.len();
+        if ( memcmp(path.cb() + at, name.cb(), name.len()) != 0 ) return false;
+
+        k = mNodes[k].parent;
+        if ( k == NODE_TOP ) return at == 0;
+
+        if ( at == 0 || !isSep(path[--at]) ) return false;
+    }
+}
+
+// Returns the offset of name in text, adding it if new.
+
+Size PathStore::intern(StrView name)
+{
+    Uint32  h, k;
+    Size    i, n, cap;
+
+    ASSERT_ALWAYS(name.len() <= NAME_LEN_MAX);
+
+    h = (Uint32) hash64(name.cb(), name.len());
+
+    if ( isFull(mNameCount + 1, mNameSlotCap) ) growNameSlots();
+
+    for ( i = h & (mNameSlotCap - 1); (k = mNameSlots[i]) != 0; i = (i + 1) & (mNameSlotCap - 1) )
+    {
+        if ( text(k - 1) == name ) return k - 1;
+    }
+
+    n = 2 + name.len();
+
+    if ( mTextLen + n > PATHS_MAX ) xer(XE_MEMOUT);
+
+    if ( mTextLen + n > mTextCap )
+    {
+        cap = mTextCap == 0 ? 65536 : mTextCap * 2;
+        while ( mTextLen + n > cap ) cap *= 2;
+
+        if ( mText == 0 ) memAlloc(&mText, cap);
+        else memRealloc(&mText, cap, mTextCap);
+
+        mTextCap = cap;
+    }
+
+    Uint8* t = mText + mTextLen;
+
+    t[0] = (Uint8) name.len();
+    t[1] = (Uint8) (name.len() >> 8);
+    memcpy(t + 2, name.cb(), name.len());
+
+    mNameSlots[i] = (Uint32) (mTextLen + 1);
+    mNameCount++;
+    mTextLen += n;
+
+    return mTextLen - n;
+}
+
+// Tables are kept at most three quarters full and doubled (and refilled)
+// when not. Names are rehashed from the text, which holds them in order.
+
+void PathStore::growNodeSlots()
+{
+    Size cap = mNodeSlotCap == 0 ? SLOTS_MIN : mNodeSlotCap * 2;
+    Size i;
+
+    if ( mNodeSlots != 0 ) memFree(&mNodeSlots, mNodeSlotCap * sizeof(Uint32));
+
+    memAlloc(&mNodeSlots, cap * sizeof(Uint32));
+    memset(mNodeSlots, 0, cap * sizeof(Uint32));
+    mNodeSlotCap = cap;
+
+    for ( Size k = 0; k < mNodeCount; k++ )
+    {
+        i = nodeHash(mNodes[k].parent, mNodes[k].name) & (cap - 1);
+        while ( mNodeSlots[i] != 0 ) i = (i + 1) & (cap - 1);
+
+        mNodeSlots[i] = (Uint32) (k + 1);
+    }
+}
+
+void PathStore::growNameSlots()
+{
+    Size    cap = mNameSlotCap == 0 ? SLOTS_MIN : mNameSlotCap * 2;
+    Size    i;
+    StrView name;
+
+    if ( mNameSlots != 0 ) memFree(&mNameSlots, mNameSlotCap * sizeof(Uint32));
+
+    memAlloc(&mNameSlots, cap * sizeof(Uint32));
+    memset(mNameSlots, 0, cap * sizeof(Uint32));
+    mNameSlotCap = cap;
+
+    for ( Size at = 0; at < mTextLen; at += 2 + name.len() )
+    {
+        name = text(at);
+
+        i = (Uint32) hash64(name.cb(), name.len()) & (cap - 1);
+        while ( mNameSlots[i] != 0 ) i = (i + 1) & (cap - 1);
+
+        mNameSlots[i] = (Uint32) (at + 1);
+    }
+}
+
+static inline bool isSep(char c)
+{
+    return c == '/' || c == PATH_SEP;
+}
+
+// mixes both numbers into every bit (the finaliser of MurmurHash3)
+
+static inline Uint32 nodeHash(Uint32 parent, Uint32 name)
+{
+    Uint64 k = ((Uint64) parent << 32) | name;
+
+    k ^= k >> 33;
+    k *= U64(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= U64(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+
+    return (Uint32) k;
+}
+
+static inline bool isFull(Size count, Size cap)
+{
+    return 4 * count > 3 * cap;
+}
+
+// EOF
@@ -0,0 +1,56 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined PATHS_H
+
+    #define PATHS_H
+
+    const Size PATHS_NONE = SIZE_VAL_MAX;   // no node (parent of a top node)
+    const Size PATHS_MAX = (Size) UINT32_VAL_MAX - 1;   // nodes or names
+
+    struct PathNode;
+
+    // paths are added by one thread at a time (callers must lock) but may
+    // be read concurrently once complete; a name is valid until the next add
+
+    class PathStore
+    {
+    public:
+        PathStore();
+        ~PathStore();
+        PathStore(const PathStore&) = delete;
+        PathStore& operator=(const PathStore&) = delete;
+        Size add(StrView path);
+        Size add(Size parent, StrView name);
+        int path(Size node, char* buf, Size max) const;
+        StrView name(Size node) const;
+        Size parent(Size node) const;
+        Size count() const;
+        Size names() const;
+        Size bytes() const;
+        void release();
+
+    private:
+        StrView text(Size at) const;
+        bool isPath(Size node, StrView path) const;
+        Size intern(StrView name);
+        void growNodeSlots();
+        void growNameSlots();
+
+        PathNode*   mNodes;             // parent and name of each node
+        Size        mNodeCount;
+        Size        mNodeCap;
+        Uint32*     mNodeSlots;         // open-addressed hash of nodes (+1)
+        Size        mNodeSlotCap;
+        Uint8*      mText;              // distinct names, each after its length
+        Size        mTextLen;
+        Size        mTextCap;
+        Size        mNameCount;
+        Uint32*     mNameSlots;         // open-addressed hash of names (+1)
+        Size        mNameSlotCap;
+        Size        mDirNode;           // parent of last path added
+    };
+
+#endif // PATHS_H
+
+// EOF
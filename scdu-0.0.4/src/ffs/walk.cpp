@@ -0,0 +1,626 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "../core/core.h"
+#include "../alg/match.h"
+
+#include "walk.h"
+
+const Size POLL_MSECS = 10;
+
+const Size WALK_DIR_SIZE = 256;         // of directories taken from pool
+
+struct WalkDir
+{
+    WalkDir*    next;
+    Size        depth;
+    Size        len;
+    char        path[WALK_DIR_SIZE - 3 * sizeof(Size)]; // or allocated to fit
+};
+
+struct WalkItem
+{
+    Size        name;                   // offset in slot name arena
+    Size        len;                    // length of name
+    FileInfo    info;
+};
+
+struct WalkSlot
+{
+    Walker*     walker;
+    Size        worker;
+    WalkItem*   items;                  // entries of current directory
+    Size        itemCount;
+    Size        itemCap;
+    char*       names;
+    Size        nameLen;
+    Size        nameCap;
+    char        path[UPATH_MAX + 1];
+};
+
+static WalkDir* dirNew(Pool<WalkDir>& pool, const char* path, Size len, Size depth);
+static void dirDelete(Pool<WalkDir>& pool, WalkDir* dir);
+static bool isWanted(EntType type, Uint32 fields);
+static int compareIno(const void* a, const void* b);
+
+Walker::Walker()
+{
+    mOrder = WO_DFS;
+    mFields = FF_SIZE;
+    mRecurse = true;
+    mThreads = 1;
+
+    #if defined SCDU_OS_WINDOWS
+        mCaseless = true;
+    #else
+        mCaseless = false;
+    #endif
+
+    mInclude = 0;
+    mExclude = 0;
+
+    mVisit = 0;
+    mArg = 0;
+    mCrewSize = 0;
+    mSlots = 0;
+
+    mHead = 0;
+    mTail = 0;
+    mBusy = 0;
+    mExited = 0;
+    mDirs = 0;
+    mEntries = 0;
+
+    mFailText = 0;
+    mFailLen = 0;
+    mFailCap = 0;
+    mFailIdx = 0;
+    mFailCount = 0;
+    mFailIdxCap = 0;
+}
+
+Walker::~Walker()
+{
+    ASSERT(mHead == 0);
+    ASSERT(mSlots == 0);
+
+    clear();
+}
+
+void Walker::configure()
+{
+    const Options& o = cmd.options;
+
+    setRecurse(o.recurse);
+    setThreads(cmd.env.threads);
+
+    if      ( o.walkOrder.B ) setOrder(WO_BFS);
+    else if ( o.walkOrder.I ) setOrder(WO_INODE);
+    else                      setOrder(WO_DFS);
+
+    setInclude(o.include.len() != 0 ? o.include.cb() : 0);
+    setExclude(o.exclude.len() != 0 ? o.exclude.cb() : 0);
+}
+
+void Walker::setOrder(WalkOrder order)
+{
+    ASSERT(order > WO_DFS - 1 && order < WO_COUNT);
+
+    mOrder = order;
+}
+
+void Walker::setFields(Uint32 fields)
+{
+    ASSERT((fields & ~FF_ALL) == 0);
+
+    mFields = fields;
+}
+
+void Walker::setRecurse(bool recurse)
+{
+    mRecurse = recurse;
+}
+
+void Walker::setThreads(Size threads)
+{
+    if ( threads == 0 ) threads = 1;
+    if ( threads > THREADS_MAX ) threads = THREADS_MAX;
+
+    mThreads = threads;
+}
+
+void Walker::setCaseless(bool caseless)
+{
+    mCaseless = caseless;
+}
+
+void Walker::setInclude(const char* pat)
+{
+    mInclude = pat;
+}
+
+void Walker::setExclude(const char* pat)
+{
+    mExclude = pat;
+}
+
+void Walker::walk(const char* root, WalkVisit visit, void* arg, WalkPoll poll)
+{
+    WalkEntry   e;
+    Size        n;
+
+    ASSERT(mSlots == 0);
+
+    clear();
+
+    mVisit = visit;
+    mArg = arg;
+    mDirs = 0;
+    mEntries = 0;
+
+    n = strlen(root);
+    while ( n > 1 && ( root[n-1] == '/' || root[n-1] == PATH_SEP ) ) n--;
+
+    if ( n > UPATH_MAX )
+    {
+        fail(root);
+        return;
+    }
+
+    if ( fileInfo(root, e.info, mFields) < 0 )
+    {
+        fail(root);
+        return;
+    }
+
+    // a root which is not a directory is simply visited in place
+
+    if ( e.info.type != ET_DIR )
+    {
+        e.path = root;
+        e.name = root;
+        e.len = n;
+        e.depth = 0;
+
+        mEntries++;
+        mVisit(e, 0, mArg);
+        return;
+    }
+
+    // patterns are applied to every name listed so they are compiled once
+    // (and released at the end so nothing is left over between walks)
+
+    if ( mInclude != 0 ) mIncludePat.compile(mInclude, mCaseless);
+    if ( mExclude != 0 ) mExcludePat.compile(mExclude, mCaseless);
+
+    mHead = mTail = dirNew(mDirPool, root, n, 0);
+    mBusy = 0;
+    mExited = 0;
+
+    mCrewSize = mThreads;
+
+    memAlloc(&mSlots, mCrewSize * sizeof(WalkSlot));
+
+    for ( Size i = 0; i < mCrewSize; i++ )
+    {
+        WalkSlot& s = mSlots[i];
+
+        s.walker = this;
+        s.worker = i;
+        s.items = 0;
+        s.itemCount = 0;
+        s.itemCap = 0;
+        s.names = 0;
+        s.nameLen = 0;
+        s.nameCap = 0;
+
+        mCrew[i].start(work, &s);
+    }
+
+    // channels are not thread-safe so the caller's progress reporting
+    // is done here on the calling thread while workers are busy
+
+    if ( poll != 0 )
+    {
+        while ( atomicGet(&mExited) < mCrewSize )
+        {
+            poll(mArg);
+            milliSleep(POLL_MSECS);
+        }
+    }
+
+    for ( Size i = 0; i < mCrewSize; i++ )
+    {
+        WalkSlot& s = mSlots[i];
+
+        mCrew[i].join();
+
+        if ( s.items != 0 ) memFree(&s.items, s.itemCap * sizeof(WalkItem));
+        if ( s.names != 0 ) memFree(&s.names, s.nameCap);
+    }
+
+    memFree(&mSlots, mCrewSize * sizeof(WalkSlot));
+
+    mIncludePat.release();
+    mExcludePat.release();
+    mDirPool.release();
+
+    ASSERT(mHead == 0);
+    ASSERT(mBusy == 0);
+
+    if ( poll != 0 ) poll(mArg);
+}
+
+Size Walker::threads() const
+{
+    return mCrewSize;
+}
+
+Size Walker::dirs() const
+{
+    return atomicGet(&mDirs);
+}
+
+Size Walker::entries() const
+{
+    return atomicGet(&mEntries);
+}
+
+Size Walker::failures() const
+{
+    return mFailCount;
+}
+
+const char* Walker::failure(Size i) const
+{
+    ASSERT(i < mFailCount);
+
+    return mFailText + mFailIdx[i];
+}
+
+void Walker::work(void* arg)
+{
+    WalkSlot&   slot = *(WalkSlot*) arg;
+    Walker&     w = *slot.walker;
+    WalkDir*    d;
+
+    while ( true )
+    {
+        w.mMutex.lock();
+
+        while ( w.mHead == 0 && w.mBusy > 0 )
+        {
+            w.mCond.wait(w.mMutex);
+        }
+
+        d = w.mHead;
+
+        if ( d == 0 )
+        {
+            // queue is empty and nobody is listing so nothing can follow
+
+            w.mCond.broadcast();
+            w.mMutex.unlock();
+            break;
+        }
+
+        w.mHead = d->next;
+        if ( w.mHead == 0 ) w.mTail = 0;
+        w.mBusy++;
+
+        w.mMutex.unlock();
+
+        w.list(slot, *d);
+        dirDelete(w.mDirPool, d);
+
+        w.mMutex.lock();
+        w.mBusy--;
+        if ( w.mHead == 0 && w.mBusy == 0 ) w.mCond.broadcast();
+        w.mMutex.unlock();
+    }
+
+    atomicAdd(&w.mExited, 1);
+}
+
+void Walker::list(WalkSlot& slot, const WalkDir& dir)
+{
+    DirStream*  ds;
+    DirEntry    de;
+    WalkEntry   e;
+    WalkDir*    first;
+    WalkDir*    last;
+    WalkDir*    child;
+    Uint32      more;
+    Size        n, cap, base;
+    bool        descend;
+
+    // there must be room for a separator after the path (see below)
+
+    if ( dir.len >= UPATH_MAX )
+    {
+        fail(dir.path);
+        return;
+    }
+
+    ds = dirOpen(dir.path);
+
+    if ( ds == 0 )
+    {
+        fail(dir.path);
+        return;
+    }
+
+    atomicAdd(&mDirs, 1);
+
+    slot.itemCount = 0;
+    slot.nameLen = 0;
+
+    // gather names and whatever the listing provides for free first
+    // so that filtered entries are never stat'ed
+
+    while ( dirRead(ds, de, mFields & FF_LISTED) )
+    {
+        // names are matched where they lie in the listing
+
+        if ( mExclude != 0 && mExcludePat.isMatch(de.name, de.len) ) continue;
+
+        if ( mInclude != 0 && de.info.type != ET_DIR )
+        {
+            if ( !mIncludePat.isMatch(de.name, de.len) ) continue;
+        }
+
+        n = de.len + 1;
+
+        if ( slot.itemCount == slot.itemCap )
+        {
+            cap = slot.itemCap == 0 ? 256 : slot.itemCap * 2;
+
+            if ( slot.items == 0 ) memAlloc(&slot.items, cap * sizeof(WalkItem));
+            else memRealloc(&slot.items, cap * sizeof(WalkItem), slot.itemCap * sizeof(WalkItem));
+
+            slot.itemCap = cap;
+        }
+
+        if ( slot.nameLen + n > slot.nameCap )
+        {
+            cap = slot.nameCap == 0 ? 8192 : slot.nameCap * 2;
+            while ( slot.nameLen + n > cap ) cap *= 2;
+
+            if ( slot.names == 0 ) memAlloc(&slot.names, cap);
+            else memRealloc(&slot.names, cap, slot.nameCap);
+
+            slot.nameCap = cap;
+        }
+
+        WalkItem& item = slot.items[slot.itemCount++];
+
+        item.name = slot.nameLen;
+        item.len = de.len;
+        item.info = de.info;
+
+        memcpy(slot.names + slot.nameLen, de.name, n);
+        slot.nameLen += n;
+    }
+
+    more = mFields & ~FF_LISTED;
+
+    // inode order keeps metadata reads sequential on disk; where a listing
+    // lacks inodes they are fetched first, at a call per entry
+
+    if ( mOrder == WO_INODE && slot.itemCount > 1 )
+    {
+        if ( !INO_LISTED )
+        {
+            // best effort, like the listing: an entry whose id cannot be
+            // read (e.g. a locked file) keeps zero and is not skipped
+
+            for ( Size i = 0; i < slot.itemCount; i++ )
+            {
+                WalkItem& item = slot.items[i];
+
+                dirInfo(ds, slot.names + item.name, item.info, FF_ID);
+            }
+
+            more &= ~FF_ID;
+        }
+
+        qsort(slot.items, slot.itemCount, sizeof(WalkItem), compareIno);
+    }
+
+    if ( more != 0 )
+    {
+        for ( Size i = 0; i < slot.itemCount; i++ )
+        {
+            WalkItem& item = slot.items[i];
+
+            if ( isWanted(item.info.type, more) )
+            {
+                if ( dirInfo(ds, slot.names + item.name, item.info, more) < 0 )
+                {
+                    item.info.type = ET_NONE;   // vanished since listed
+                }
+            }
+        }
+    }
+
+    dirClose(ds);
+
+    // a root such as "/" already ends with a separator
+
+    memcpy(slot.path, dir.path, dir.len);
+    base = dir.len;
+
+    if ( base == 0 || ( slot.path[base-1] != '/' && slot.path[base-1] != PATH_SEP ) )
+    {
+        slot.path[base++] = PATH_SEP;
+    }
+
+    first = 0;
+    last = 0;
+
+    for ( Size i = 0; i < slot.itemCount; i++ )
+    {
+        WalkItem&   item = slot.items[i];
+        const char* name = slot.names + item.name;
+
+        if ( item.info.type == ET_NONE ) continue;
+
+        n = item.len;
+
+        if ( base + n > UPATH_MAX )
+        {
+            slot.path[base] = 0;
+            fail(slot.path);
+            continue;
+        }
+
+        memcpy(slot.path + base, name, n + 1);
+
+        e.path = slot.path;
+        e.name = slot.path + base;
+        e.len = base + n;
+        e.depth = dir.depth + 1;
+        e.info = item.info;
+
+        atomicAdd(&mEntries, 1);
+        descend = mVisit(e, slot.worker, mArg);
+
+        if ( e.info.type == ET_DIR && descend && mRecurse )
+        {
+            child = dirNew(mDirPool, e.path, e.len, e.depth);
+
+            if ( last == 0 ) first = child;
+            else last->next = child;
+
+            last = child;
+        }
+    }
+
+    if ( first != 0 ) push(first, last);
+}
+
+void Walker::push(WalkDir* first, WalkDir* last)
+{
+    mMutex.lock();
+
+    if ( mOrder == WO_BFS )
+    {
+        // subdirectories join the back of the queue (level order)
+
+        if ( mTail == 0 ) mHead = first;
+        else mTail->next = first;
+
+        mTail = last;
+    }
+    else
+    {
+        // subdirectories jump the queue in listing order (pre-order)
+
+        last->next = mHead;
+        if ( mHead == 0 ) mTail = last;
+
+        mHead = first;
+    }
+
+    mCond.broadcast();
+    mMutex.unlock();
+}
+
+void Walker::fail(const char* path)
+{
+    Size n, cap;
+
+    n = strlen(path) + 1;
+
+    mMutex.lock();
+
+    if ( mFailCount == mFailIdxCap )
+    {
+        cap = mFailIdxCap == 0 ? 16 : mFailIdxCap * 2;
+
+        if ( mFailIdx == 0 ) memAlloc(&mFailIdx, cap * sizeof(Size));
+        else memRealloc(&mFailIdx, cap * sizeof(Size), mFailIdxCap * sizeof(Size));
+
+        mFailIdxCap = cap;
+    }
+
+    if ( mFailLen + n > mFailCap )
+    {
+        cap = mFailCap == 0 ? 1024 : mFailCap * 2;
+        while ( mFailLen + n > cap ) cap *= 2;
+
+        if ( mFailText == 0 ) memAlloc(&mFailText, cap);
+        else memRealloc(&mFailText, cap, mFailCap);
+
+        mFailCap = cap;
+    }
+
+    mFailIdx[mFailCount++] = mFailLen;
+    memcpy(mFailText + mFailLen, path, n);
+    mFailLen += n;
+
+    mMutex.unlock();
+}
+
+void Walker::clear()
+{
+    if ( mFailText != 0 ) memFree(&mFailText, mFailCap);
+    if ( mFailIdx != 0 ) memFree(&mFailIdx, mFailIdxCap * sizeof(Size));
+
+    mFailLen = 0;
+    mFailCap = 0;
+    mFailCount = 0;
+    mFailIdxCap = 0;
+}
+
+// Directories are queued and listed in great numbers by all workers so most
+// are taken from a pool; only those with paths too long for an item are
+// allocated to fit.
+
+static WalkDir* dirNew(Pool<WalkDir>& pool, const char* path, Size len, Size depth)
+{
+    WalkDir* d = 0;
+
+    if ( len < sizeof(d->path) ) d = pool.take();
+    else memAlloc(&d, offsetof(WalkDir, path) + len + 1);
+
+    d->next = 0;
+    d->depth = depth;
+    d->len = len;
+
+    memcpy(d->path, path, len);
+    d->path[len] = 0;
+
+    return d;
+}
+
+static void dirDelete(Pool<WalkDir>& pool, WalkDir* dir)
+{
+    if ( dir->len < sizeof(dir->path) ) pool.give(dir);
+    else memFree(&dir, offsetof(WalkDir, path) + dir->len + 1);
+}
+
+static bool isWanted(EntType type, Uint32 fields)
+{
+    // only regular files have a content size
+
+    if ( type == ET_FILE ) return fields != 0;
+
+    return (fields & ~FF_SIZE) != 0;
+}
+
+static int compareIno(const void* a, const void* b)
+{
+    const WalkItem* x = (const WalkItem*) a;
+    const WalkItem* y = (const WalkItem*) b;
+
+    if ( x->info.ino != y->info.ino ) return x->info.ino < y->info.ino ? -1 : 1;
+
+    return 0;
+}
+
+// EOF
@@ -0,0 +1,100 @@
+// Copyright 2015-2016 RVJ Callanan.
+// Released under the GNU General Public License (Version 3).
+
+#if !defined WALK_H
+
+    #define WALK_H
+
+    enum WalkOrder
+    {
+        WO_DFS = 0,                     // depth-first
+        WO_BFS,                         // breadth-first
+        WO_INODE,                       // depth-first, entries in inode order
+        WO_COUNT
+    };
+
+    struct WalkEntry
+    {
+        const char* path;               // valid for duration of visit only
+        const char* name;               // final component of path
+        Size        len;                // length of path
+        Size        depth;              // 1 for entries of root directory
+        FileInfo    info;
+    };
+
+    // visits are made concurrently from worker threads; the worker number
+    // (0 .. threads - 1) allows results to be accumulated without locking;
+    // returning false from a directory visit prevents its descent
+
+    typedef bool (*WalkVisit)(const WalkEntry& entry, Size worker, void* arg);
+    typedef void (*WalkPoll)(void* arg);
+
+    struct WalkDir;
+    struct WalkSlot;
+
+    class Walker
+    {
+    public:
+        Walker();
+        ~Walker();
+        Walker(const Walker&) = delete;
+        Walker& operator=(const Walker&) = delete;
+        void configure();
+        void setOrder(WalkOrder order);
+        void setFields(Uint32 fields);
+        void setRecurse(bool recurse);
+        void setThreads(Size threads);
+        void setCaseless(bool caseless);
+        void setInclude(const char* pat);
+        void setExclude(const char* pat);
+        void walk(const char* root, WalkVisit visit, void* arg, WalkPoll poll = 0);
+        Size threads() const;
+        Size dirs() const;
+        Size entries() const;
+        Size failures() const;
+        const char* failure(Size i) const;
+
+    private:
+        static void work(void* arg);
+        void list(WalkSlot& slot, const WalkDir& dir);
+        void push(WalkDir* first, WalkDir* last);
+        void fail(const char* path);
+        void clear();
+
+        WalkOrder   mOrder;
+        Uint32      mFields;            // FF_* fields wanted by visitor
+        bool        mRecurse;
+        Size        mThreads;           // workers requested
+        bool        mCaseless;
+        const char* mInclude;           // patterns for non-directories
+        const char* mExclude;           // patterns for all entries
+        PatternSet  mIncludePat;        // compiled for each walk
+        PatternSet  mExcludePat;
+        Pool<WalkDir> mDirPool;         // queued directories
+
+        WalkVisit   mVisit;
+        void*       mArg;
+        Size        mCrewSize;          // workers started
+        Thread      mCrew[THREADS_MAX];
+        WalkSlot*   mSlots;
+
+        Mutex       mMutex;             // guards queue and failures
+        Cond        mCond;
+        WalkDir*    mHead;              // queue of directories to list
+        WalkDir*    mTail;
+        Size        mBusy;              // workers listing a directory
+        Size        mExited;            // workers finished (atomic)
+        Size        mDirs;              // directories listed (atomic)
+        Size        mEntries;           // entries visited (atomic)
+
+        char*       mFailText;          // paths of unlistable directories
+        Size        mFailLen;
+        Size        mFailCap;
+        Size*       mFailIdx;
+        Size        mFailCount;
+        Size        mFailIdxCap;
+    };
+
+#endif // WALK_H
+
+// EOF